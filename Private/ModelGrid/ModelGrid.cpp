@@ -2,8 +2,12 @@
 #include "ModelGrid/ModelGrid.h"
 #include "GenericGrid/BoxIndexing.h"
 #include "Core/gs_debug.h"
+#include "Core/ParallelFor.h"
 #include "Intersection/GSRayBoxIntersection.h"
 
+#include <bit>
+#include <memory>
+
 using namespace GS;
 using namespace GS::ModelGridInternal;
 
@@ -424,6 +428,116 @@ bool ModelGrid::ReinitializeCell(CellKey Cell, const ModelGridCell& CopyFromCell
 }
 
 
+int ModelGrid::EditBlockCells(const Vector3i& BlockIndex, const CellKey* Keys, int NumKeys,
+	FunctionRef<bool(int KeyIndex, const ModelGridCell& CurCell, ModelGridCell& NewCell)> EditFunc)
+{
+	BlockData* Data = nullptr;
+	uint16_t StorageIndex = IndexGrid[BlockIndex];
+	if (StorageIndex != UNALLOCATED)
+		Data = AllocatedBlocks[StorageIndex].Data;
+
+	Vector3i BlockMinKey = GetKeyRangeForChunk(BlockIndex).Min;
+	int NumWritten = 0;
+	for (int k = 0; k < NumKeys; ++k)
+	{
+		Vector3i LocalIndex = Keys[k] - BlockMinKey;
+		gs_debug_assert(CellIndexBounds.Contains(Keys[k]) && GetChunkIndexForKey(Keys[k]) == BlockIndex);
+
+		ModelGridCell CurCell = (Data != nullptr) ? UnpackToCell(*Data, LocalIndex) : EmptyCell;
+		ModelGridCell NewCell = CurCell;
+		if (EditFunc(k, CurCell, NewCell) == false)
+			continue;
+
+		if (Data == nullptr)
+			Data = GetOrAllocateChunk(BlockIndex);
+		ModifiedKeyBounds.Contain(Keys[k]);
+		ReinitializeCell_Internal(*Data, Data->CellType.ToLinearIndex(LocalIndex), NewCell);
+		NumWritten++;
+	}
+	return NumWritten;
+}
+
+
+void ModelGrid::EditMultipleBlockCells_Parallel(const std::vector<Vector3i>& BlockIndices, const std::vector<int>& BlockKeyOffsets, const CellKey* Keys,
+	FunctionRef<bool(int KeyIndex, const ModelGridCell& CurCell, ModelGridCell& NewCell)> EditFunc,
+	std::vector<int>* NumWrittenOut)
+{
+	int NumBlocks = (int)BlockIndices.size();
+	gs_debug_assert(BlockKeyOffsets.size() == (size_t)NumBlocks + 1);
+
+	struct PendingCellWrite
+	{
+		Vector3i LocalIndex;
+		ModelGridCell NewCell;
+	};
+	struct PendingBlockWrites
+	{
+		BlockData* Data = nullptr;
+		std::vector<PendingCellWrite> Writes;
+		AxisBox3i WrittenKeyBounds = AxisBox3i::Empty();
+	};
+	std::vector<PendingBlockWrites> BlockWrites;
+	BlockWrites.resize(NumBlocks);
+
+	// compute new cells for each block. Grid storage is not modified here, so blocks can be read concurrently.
+	// Repeated keys see the new cell from the previous edit, as they would with sequential edits.
+	GS::ParallelFor((uint32_t)NumBlocks, [&](int BlockListIndex)
+	{
+		PendingBlockWrites& Pending = BlockWrites[BlockListIndex];
+		Vector3i BlockIndex = BlockIndices[BlockListIndex];
+		const BlockData* Data = GetAllocatedChunk(BlockIndex);
+		Vector3i BlockMinKey = GetKeyRangeForChunk(BlockIndex).Min;
+
+		ModelGridCell PrevCell;
+		for (int k = BlockKeyOffsets[BlockListIndex]; k < BlockKeyOffsets[BlockListIndex+1]; ++k)
+		{
+			Vector3i LocalIndex = Keys[k] - BlockMinKey;
+			gs_debug_assert(CellIndexBounds.Contains(Keys[k]) && GetChunkIndexForKey(Keys[k]) == BlockIndex);
+
+			bool bIsRepeat = (k > BlockKeyOffsets[BlockListIndex] && Keys[k] == Keys[k-1]);
+			ModelGridCell CurCell = (bIsRepeat) ? PrevCell : 
+				((Data != nullptr) ? UnpackToCell(*Data, LocalIndex) : EmptyCell);
+			ModelGridCell NewCell = CurCell;
+			if (EditFunc(k, CurCell, NewCell) == false)
+			{
+				PrevCell = CurCell;
+				continue;
+			}
+
+			Pending.Writes.push_back(PendingCellWrite{ LocalIndex, NewCell });
+			Pending.WrittenKeyBounds.Contain(Keys[k]);
+			PrevCell = NewCell;
+		}
+	});
+
+	// allocating blocks modifies AllocatedBlocks and IndexGrid, so has to be done serially
+	for (int k = 0; k < NumBlocks; ++k)
+	{
+		if (BlockWrites[k].Writes.size() > 0)
+		{
+			BlockWrites[k].Data = GetOrAllocateChunk(BlockIndices[k]);
+			ModifiedKeyBounds.Contain(BlockWrites[k].WrittenKeyBounds.Min);
+			ModifiedKeyBounds.Contain(BlockWrites[k].WrittenKeyBounds.Max);
+		}
+	}
+
+	// each block has separate storage, so writes to different blocks can be done concurrently
+	GS::ParallelFor((uint32_t)NumBlocks, [&](int BlockListIndex)
+	{
+		PendingBlockWrites& Pending = BlockWrites[BlockListIndex];
+		for (const PendingCellWrite& Write : Pending.Writes)
+			ReinitializeCell_Internal(*Pending.Data, Pending.Data->CellType.ToLinearIndex(Write.LocalIndex), Write.NewCell);
+	});
+
+	if (NumWrittenOut != nullptr)
+	{
+		NumWrittenOut->resize(NumBlocks);
+		for (int k = 0; k < NumBlocks; ++k)
+			(*NumWrittenOut)[k] = (int)BlockWrites[k].Writes.size();
+	}
+}
+
+
 void ModelGrid::EnumerateAdjacentConnectedChunks(CellKey Cell, FunctionRef<void(Vector3i, CellKey)> ProcessFunc) const
 {
 	Vector3i CellChunkIndex = GetChunkIndexForKey(Cell);
@@ -685,6 +799,189 @@ void ModelGrid::EnumerateConnectedPlanarCells(
 }
 
 
+void ModelGrid::EnumerateConnectedCells_Scanline(
+	CellKey InitialCellKey,
+	const ScanlineFillParams& Params,
+	FunctionRef<void(CellKey Key, const ModelGridCell& CellInfo)> ApplyFunc,
+	const std::atomic<bool>* CancelFlag) const
+{
+	static_assert(BlockSize_XY == 16, "EnumerateConnectedCells_Scanline assumes 16-cell rows along X");
+	constexpr int RowsPerBlock = BlockSize_XY * BlockSize_Z;
+	constexpr uint32_t FullRow = 0xFFFF;
+	constexpr uint32_t LastBit = 1u << (BlockSize_XY - 1);
+
+	// occupancy and visited bits for a block. Each uint16 is a row of cells along X, indexed by (LocalY + LocalZ*BlockSize_XY)
+	struct ScanlineBlockBits
+	{
+		const BlockData* Data = nullptr;
+		uint16_t Occupied[RowsPerBlock] = {};
+		uint16_t Visited[RowsPerBlock] = {};
+	};
+
+	const Vector3i NumBlocks = BlockIndexGrid::TypeDimensions();
+	const Vector3i GridDims = ModelGridDimensions();
+	const Vector3i InitialShift = InitialCellKey - MinCoordCorner;
+	if (Params.PlaneAxis >= 0 && (InitialShift[Params.PlaneAxis] < 0 || InitialShift[Params.PlaneAxis] >= GridDims[Params.PlaneAxis]))
+		return;		// plane does not intersect the grid
+
+	// rows are identified by (BlockX, ShiftY, ShiftZ), where Shift = Key - MinCoordCorner. Block bits are initialized on first access.
+	std::vector<std::unique_ptr<ScanlineBlockBits>> BlockBits;
+	BlockBits.resize((size_t)NumBlocks.X * NumBlocks.Y * NumBlocks.Z);
+	auto GetBlockBits = [&](int BlockX, int ShiftY, int ShiftZ) -> ScanlineBlockBits&
+	{
+		Vector3i BlockIndex(BlockX, ShiftY / BlockSize_XY, ShiftZ / BlockSize_Z);
+		std::unique_ptr<ScanlineBlockBits>& Bits = BlockBits[BlockIndex.X + NumBlocks.X * (BlockIndex.Y + NumBlocks.Y * BlockIndex.Z)];
+		if (!Bits)
+		{
+			Bits = std::make_unique<ScanlineBlockBits>();
+			Bits->Data = GetAllocatedChunk(BlockIndex);
+			if (Bits->Data != nullptr)
+			{
+				for (int z = 0; z < BlockSize_Z; ++z)
+				{
+					for (int y = 0; y < BlockSize_XY; ++y)
+					{
+						uint16_t Row = 0;
+						for (int x = 0; x < BlockSize_XY; ++x)
+						{
+							if ((EModelGridCellType)Bits->Data->CellType.Get(Vector3i(x, y, z)) != EModelGridCellType::Empty)
+								Row |= (uint16_t)(1u << x);
+						}
+						Bits->Occupied[y + z * BlockSize_XY] = Row;
+					}
+				}
+			}
+		}
+		return *Bits;
+	};
+	auto GetRowIndex = [](int ShiftY, int ShiftZ) { return (ShiftY % BlockSize_XY) + (ShiftZ % BlockSize_Z) * BlockSize_XY; };
+
+	// occupancy of the row starting at X=(BlockX*BlockSize_XY + XOffset). Cells outside the grid are considered empty.
+	auto GetOffsetOccupancy = [&](int BlockX, int ShiftY, int ShiftZ, int XOffset) -> uint32_t
+	{
+		if (ShiftY < 0 || ShiftY >= GridDims.Y || ShiftZ < 0 || ShiftZ >= GridDims.Z)
+			return 0;
+		int StartX = BlockX * BlockSize_XY + XOffset;
+		int StartBlockX = (StartX >= 0) ? (StartX / BlockSize_XY) : -((BlockSize_XY - 1 - StartX) / BlockSize_XY);
+		int Shift = StartX - StartBlockX * BlockSize_XY;
+		int RowIndex = GetRowIndex(ShiftY, ShiftZ);
+		uint32_t Combined = 0;
+		if (StartBlockX >= 0 && StartBlockX < NumBlocks.X)
+			Combined |= GetBlockBits(StartBlockX, ShiftY, ShiftZ).Occupied[RowIndex];
+		if (Shift > 0 && StartBlockX + 1 >= 0 && StartBlockX + 1 < NumBlocks.X)
+			Combined |= (uint32_t)GetBlockBits(StartBlockX + 1, ShiftY, ShiftZ).Occupied[RowIndex] << BlockSize_XY;
+		return (Combined >> Shift) & FullRow;
+	};
+
+	const int InitialBlockX = (Params.PlaneAxis == 0) ? (InitialShift.X / BlockSize_XY) : 0;
+	const uint32_t InitialXBit = (Params.PlaneAxis == 0) ? (1u << (InitialShift.X % BlockSize_XY)) : 0;
+	auto GetTraversable = [&](int BlockX, int ShiftY, int ShiftZ, const ScanlineBlockBits& Bits) -> uint32_t
+	{
+		uint32_t Occupied = Bits.Occupied[GetRowIndex(ShiftY, ShiftZ)];
+		uint32_t Result = (Params.bFillSolidCells) ? Occupied : (~Occupied & FullRow);
+		if (Params.PlaneAxis == 0)
+			Result &= (BlockX == InitialBlockX) ? InitialXBit : 0;
+		if (Result != 0 && Params.bRequireEmptyAtOffset)
+			Result &= ~GetOffsetOccupancy(BlockX, ShiftY + Params.EmptyOffset.Y, ShiftZ + Params.EmptyOffset.Z, Params.EmptyOffset.X);
+		return Result;
+	};
+
+	struct ScanSeed
+	{
+		int BlockX, ShiftY, ShiftZ;
+		uint32_t Mask;
+	};
+	std::vector<ScanSeed> Stack;
+	Stack.reserve(64);
+
+	// push the cells of Mask in the row at (BlockX, ShiftY, ShiftZ) that can still be visited
+	auto PushRow = [&](int BlockX, int ShiftY, int ShiftZ, uint32_t Mask)
+	{
+		if (ShiftY < 0 || ShiftY >= GridDims.Y || ShiftZ < 0 || ShiftZ >= GridDims.Z)
+			return;
+		const ScanlineBlockBits& Bits = GetBlockBits(BlockX, ShiftY, ShiftZ);
+		Mask &= GetTraversable(BlockX, ShiftY, ShiftZ, Bits) & ~(uint32_t)Bits.Visited[GetRowIndex(ShiftY, ShiftZ)];
+		if (Mask != 0)
+			Stack.push_back(ScanSeed{ BlockX, ShiftY, ShiftZ, Mask });
+	};
+	auto PushCell = [&](const Vector3i& Shift)
+	{
+		if (Shift.X >= 0 && Shift.X < GridDims.X)
+			PushRow(Shift.X / BlockSize_XY, Shift.Y, Shift.Z, 1u << (Shift.X % BlockSize_XY));
+	};
+
+	// initial cell always connects to its neighbours, even if it is not traversable itself
+	PushCell(InitialShift);
+	if (Stack.empty())
+	{
+		for (int j = 0; j < 6; ++j)
+		{
+			if (Params.PlaneAxis < 0 || GridNeighbours6_AxisIndex[j] != Params.PlaneAxis)
+				PushCell(InitialShift + GridNeighbours6[j]);
+		}
+	}
+
+	while (Stack.size() > 0)
+	{
+		ScanSeed Seed = Stack.back();
+		Stack.pop_back();
+
+		ScanlineBlockBits& Bits = GetBlockBits(Seed.BlockX, Seed.ShiftY, Seed.ShiftZ);
+		int RowIndex = GetRowIndex(Seed.ShiftY, Seed.ShiftZ);
+		uint32_t Available = GetTraversable(Seed.BlockX, Seed.ShiftY, Seed.ShiftZ, Bits) & ~(uint32_t)Bits.Visited[RowIndex];
+		uint32_t Pending = Seed.Mask & Available;
+		while (Pending != 0)
+		{
+			if (CancelFlag != nullptr && CancelFlag->load(std::memory_order_relaxed))
+				return;
+
+			// grow lowest pending cell into the span of available cells containing it
+			uint32_t Span = 0;
+			uint32_t Grown = Pending & (~Pending + 1);
+			while (Grown != Span)
+			{
+				Span = Grown;
+				Grown = (Span | (Span << 1) | (Span >> 1)) & Available;
+			}
+			Pending &= ~Span;
+			Available &= ~Span;
+			Bits.Visited[RowIndex] |= (uint16_t)Span;
+
+			for (uint32_t Remaining = Span; Remaining != 0; Remaining &= (Remaining - 1))
+			{
+				int LocalX = std::countr_zero(Remaining);
+				CellKey Key = MinCoordCorner + Vector3i(Seed.BlockX * BlockSize_XY + LocalX, Seed.ShiftY, Seed.ShiftZ);
+				if (Key == InitialCellKey)
+					continue;
+				if (Bits.Data != nullptr)
+					ApplyFunc(Key, UnpackToCell(*Bits.Data, Vector3i(LocalX, Seed.ShiftY % BlockSize_XY, Seed.ShiftZ % BlockSize_Z)));
+				else
+					ApplyFunc(Key, EmptyCell);
+			}
+
+			// continue span into adjacent blocks along X
+			if (Params.PlaneAxis != 0)
+			{
+				if ((Span & 1) && Seed.BlockX > 0)
+					PushRow(Seed.BlockX - 1, Seed.ShiftY, Seed.ShiftZ, LastBit);
+				if ((Span & LastBit) && Seed.BlockX + 1 < NumBlocks.X)
+					PushRow(Seed.BlockX + 1, Seed.ShiftY, Seed.ShiftZ, 1);
+			}
+			if (Params.PlaneAxis != 1)
+			{
+				PushRow(Seed.BlockX, Seed.ShiftY - 1, Seed.ShiftZ, Span);
+				PushRow(Seed.BlockX, Seed.ShiftY + 1, Seed.ShiftZ, Span);
+			}
+			if (Params.PlaneAxis != 2)
+			{
+				PushRow(Seed.BlockX, Seed.ShiftY, Seed.ShiftZ - 1, Span);
+				PushRow(Seed.BlockX, Seed.ShiftY, Seed.ShiftZ + 1, Span);
+			}
+		}
+	}
+}
+
+
 void ModelGrid::EnumerateAdjacentCells(
 	CellKey InitialCellKey,
 	Vector3i HalfExtents,
@@ -781,24 +1078,7 @@ ModelGrid::CellKey ModelGrid::EnumerateCellsCache::RemoveNextFromQueue()
 
 void ModelGrid::EnumerateCellsCache::AddProcessed(CellKey Key)
 {
-	if (bUsingMap)
-	{
-		ProcessedMap.insert(Key);
-	}
-	else
-	{
-		if (ProcessedArray.size() < 100)
-		{
-			ProcessedArray.add(Key);
-		}
-		else
-		{
-			for (auto ProcessedKey : ProcessedArray)
-				ProcessedMap.insert(ProcessedKey);
-			ProcessedArray.clear();
-			bUsingMap = true;
-		}
-	}
+	ProcessedMap.Insert(Key);
 }
 
 
@@ -1,9 +1,93 @@
 // Copyright Gradientspace Corp. All Rights Reserved.
 #include "ModelGrid/ModelGridChange.h"
+#include "ModelGrid/ModelGridConstants.h"
+
+#include <algorithm>
 
 using namespace GS;
 
 
+void GridChangeInfo::AppendChange(const GridChangeInfo& Change)
+{
+	if (Change.bModified == false)
+		return;
+	bModified = true;
+	ModifiedRegion.Contain(Change.ModifiedRegion.Min);
+	ModifiedRegion.Contain(Change.ModifiedRegion.Max);
+
+	if (bHaveModifiedBlocks && Change.bHaveModifiedBlocks)
+	{
+		size_t NumExisting = ModifiedBlocks.size();
+		ModifiedBlocks.insert(ModifiedBlocks.end(), Change.ModifiedBlocks.begin(), Change.ModifiedBlocks.end());
+		std::inplace_merge(ModifiedBlocks.begin(), ModifiedBlocks.begin() + NumExisting, ModifiedBlocks.end());
+		ModifiedBlocks.erase(std::unique(ModifiedBlocks.begin(), ModifiedBlocks.end()), ModifiedBlocks.end());
+	}
+	else
+	{
+		bHaveModifiedBlocks = false;
+		ModifiedBlocks.clear();
+	}
+}
+
+void GridChangeInfo::AppendChange(const AxisBox3i& ModifiedRegionIn, const std::vector<Vector3i>& ModifiedBlocksIn)
+{
+	GridChangeInfo Tmp{ true, ModifiedRegionIn, ModifiedBlocksIn };
+	std::sort(Tmp.ModifiedBlocks.begin(), Tmp.ModifiedBlocks.end());
+	Tmp.ModifiedBlocks.erase(std::unique(Tmp.ModifiedBlocks.begin(), Tmp.ModifiedBlocks.end()), Tmp.ModifiedBlocks.end());
+	AppendChange(Tmp);
+}
+
+void GridChangeInfo::AppendChangedCells(const ModelGrid& Grid, const std::vector<Vector3i>& CellKeys)
+{
+	if (CellKeys.size() == 0)
+		return;
+	AxisBox3i CellBounds = AxisBox3i::Empty();
+	for (const Vector3i& CellKey : CellKeys)
+		CellBounds.Contain(CellKey);
+	std::vector<Vector3i> CellBlocks;
+	AppendAffectedBlocks(Grid, CellKeys, CellBlocks);
+	AppendChange(CellBounds, CellBlocks);
+}
+
+void GridChangeInfo::AppendAffectedBlocks(const ModelGrid& Grid, const std::vector<Vector3i>& CellKeys, std::vector<Vector3i>& BlocksOut)
+{
+	if (CellKeys.size() == 0)
+		return;
+	// accumulate the border faces of consecutive cells in the same block
+	Vector3i CurBlock = Grid.GetChunkIndexForKey(CellKeys[0]);
+	AxisBox3i CurBlockKeys = Grid.GetKeyRangeForChunk(CurBlock);
+	int CurBorderFaces = 0;
+	for (const Vector3i& CellKey : CellKeys)
+	{
+		if (CurBlockKeys.Contains(CellKey) == false)
+		{
+			AppendAffectedBlocks(Grid, CurBlock, CurBorderFaces, BlocksOut);
+			CurBlock = Grid.GetChunkIndexForKey(CellKey);
+			CurBlockKeys = Grid.GetKeyRangeForChunk(CurBlock);
+			CurBorderFaces = 0;
+		}
+		CurBorderFaces |= GetBlockBorderFaces(CurBlockKeys, CellKey);
+	}
+	AppendAffectedBlocks(Grid, CurBlock, CurBorderFaces, BlocksOut);
+}
+
+void GridChangeInfo::AppendAffectedBlocks(const ModelGrid& Grid, const Vector3i& BlockIndex, int BorderFaces, std::vector<Vector3i>& BlocksOut)
+{
+	BlocksOut.push_back(BlockIndex);
+	for (int j = 0; j < 6; ++j)
+	{
+		if ((BorderFaces & (1 << j)) == 0)
+			continue;
+		Vector3i NbrIndex = BlockIndex;
+		NbrIndex[j/2] += (j & 1) ? 1 : -1;
+		// blocks on the grid boundary have no neighbour on that side
+		if (Grid.IsValidCell(Grid.GetKeyRangeForChunk(NbrIndex).Min))
+			BlocksOut.push_back(NbrIndex);
+	}
+}
+
+
+
 ModelGridDeltaChange::~ModelGridDeltaChange()
 {
 	CellKeys = std::vector<Vector3i>();
@@ -22,16 +106,291 @@ void ModelGridDeltaChange::DeleteChangeFromExternalDLL(ModelGridDeltaChange* Cha
 }
 
 
+
+ModelGridCompactDeltaChange::~ModelGridCompactDeltaChange()
+{
+	Blocks = std::vector<BlockRuns>();
+	Runs = std::vector<CellRun>();
+	CellPalette = std::vector<PackedCell>();
+	FaceMaterialSets = std::vector<CellFaceMaterials>();
+}
+
+void ModelGridCompactDeltaChange::DeleteChangeFromExternalDLL(ModelGridCompactDeltaChange* Change)
+{
+	if (Change == nullptr) return;
+	delete Change;
+}
+
+
+namespace GS
+{
+namespace ModelGridCompactChangeInternal
+{
+	static constexpr int LocalIndexBits = 12;
+	static_assert(ModelGrid::BlockSize_XY * ModelGrid::BlockSize_XY * ModelGrid::BlockSize_Z <= (1 << LocalIndexBits), "ModelGridCompactDeltaChange local index does not fit in 12 bits");
+
+	static uint16_t ToLocalIndex(const Vector3i& Local)
+	{
+		return (uint16_t)(Local.X + ModelGrid::BlockSize_XY * (Local.Y + ModelGrid::BlockSize_XY * Local.Z));
+	}
+	static Vector3i FromLocalIndex(int LocalIndex)
+	{
+		return Vector3i(
+			LocalIndex % ModelGrid::BlockSize_XY,
+			(LocalIndex / ModelGrid::BlockSize_XY) % ModelGrid::BlockSize_XY,
+			LocalIndex / (ModelGrid::BlockSize_XY * ModelGrid::BlockSize_XY));
+	}
+
+	static bool IsPerFaceMaterial(EGridCellMaterialType MaterialType)
+	{
+		return (int)MaterialType >= (int)EGridCellMaterialType::BeginPerFaceTypes;
+	}
+
+	// cell with only the fields that are stored in a ModelGrid, used to find unique cells for the palette
+	struct CanonicalCell
+	{
+		ModelGridCompactDeltaChange::PackedCell Packed;
+		CellFaceMaterials Faces;
+
+		explicit CanonicalCell(const ModelGridCell& Cell)
+		{
+			Packed.CellData = Cell.CellData;
+			Packed.CellType = (uint16_t)Cell.CellType;
+			Packed.MaterialType = (uint8_t)Cell.MaterialType;
+			Packed.Reserved = 0;
+			Packed.FaceMaterialsIndex = 0xFFFFFFFF;
+			if (IsPerFaceMaterial(Cell.MaterialType))
+			{
+				Packed.CellMaterial = 0;
+				Faces = Cell.FaceMaterials;
+			}
+			else
+			{
+				// alpha of SolidColor cells is not stored in the grid, and may not be initialized
+				GridMaterial Material = Cell.CellMaterial;
+				if (Cell.MaterialType == EGridCellMaterialType::SolidColor)
+					Material.RGBAColor.Alpha = 255;
+				Packed.CellMaterial = Material.PackedValue();
+			}
+		}
+
+		bool operator==(const CanonicalCell& Other) const
+		{
+			return Packed.CellData == Other.Packed.CellData && Packed.CellMaterial == Other.Packed.CellMaterial
+				&& Packed.CellType == Other.Packed.CellType && Packed.MaterialType == Other.Packed.MaterialType
+				&& Faces == Other.Faces;
+		}
+	};
+
+	struct CanonicalCellHash
+	{
+		size_t operator()(const CanonicalCell& Cell) const
+		{
+			uint64_t Hash = Cell.Packed.CellData * 0x9E3779B97F4A7C15ull;
+			Hash ^= ((uint64_t)Cell.Packed.CellMaterial << 24) ^ ((uint64_t)Cell.Packed.CellType << 8) ^ (uint64_t)Cell.Packed.MaterialType;
+			for (int k = 0; k < CellFaceMaterials::MaxFaces; ++k)
+				Hash = (Hash ^ Cell.Faces[k].PackedValue()) * 0x100000001B3ull;
+			return (size_t)Hash;
+		}
+	};
+}
+}
+using namespace GS::ModelGridCompactChangeInternal;
+
+
+void ModelGridCompactDeltaChange::InitializeFromChange(const ModelGridDeltaChange& Change, const ModelGridConstants& GridConstants)
+{
+	Blocks.clear();
+	Runs.clear();
+	CellPalette.clear();
+	FaceMaterialSets.clear();
+	ChangeBounds = Change.ChangeBounds;
+	NumCells = (int64_t)Change.CellKeys.size();
+	if (NumCells == 0)
+		return;
+
+	// sort cells by block and then local index. Keys in the change are unique, so the order of the cells does not matter.
+	struct SortedCell
+	{
+		uint64_t SortKey;
+		uint32_t CellIndex;
+	};
+	std::vector<SortedCell> SortedCells;
+	SortedCells.reserve(NumCells);
+	for (int64_t k = 0; k < NumCells; ++k)
+	{
+		Vector3i BlockIndex, LocalIndex;
+		GridConstants.ToGlobalLocal(Change.CellKeys[k], BlockIndex, LocalIndex);
+		uint64_t BlockBits = ((uint64_t)BlockIndex.Z << 32) | ((uint64_t)BlockIndex.Y << 16) | (uint64_t)BlockIndex.X;
+		SortedCells.push_back(SortedCell{ (BlockBits << LocalIndexBits) | ToLocalIndex(LocalIndex), (uint32_t)k });
+	}
+	std::sort(SortedCells.begin(), SortedCells.end(), [](const SortedCell& A, const SortedCell& B) { return A.SortKey < B.SortKey; });
+
+	std::unordered_map<CanonicalCell, uint32_t, CanonicalCellHash> PaletteMap;
+	auto GetPaletteIndex = [&](const ModelGridCell& Cell) -> uint32_t
+	{
+		CanonicalCell Canonical(Cell);
+		auto found_itr = PaletteMap.find(Canonical);
+		if (found_itr != PaletteMap.end())
+			return found_itr->second;
+
+		uint32_t NewIndex = (uint32_t)CellPalette.size();
+		PackedCell NewPacked = Canonical.Packed;
+		if (IsPerFaceMaterial(Cell.MaterialType))
+		{
+			NewPacked.FaceMaterialsIndex = (uint32_t)FaceMaterialSets.size();
+			FaceMaterialSets.push_back(Canonical.Faces);
+		}
+		CellPalette.push_back(NewPacked);
+		PaletteMap.insert({ Canonical, NewIndex });
+		return NewIndex;
+	};
+
+	const uint64_t LocalIndexMask = (1 << LocalIndexBits) - 1;
+	for (int64_t k = 0; k < NumCells; ++k)
+	{
+		uint64_t BlockBits = SortedCells[k].SortKey >> LocalIndexBits;
+		uint16_t LocalIndex = (uint16_t)(SortedCells[k].SortKey & LocalIndexMask);
+		uint32_t CellIndex = SortedCells[k].CellIndex;
+		uint32_t BeforeCell = GetPaletteIndex(Change.CellsBefore[CellIndex]);
+		uint32_t AfterCell = GetPaletteIndex(Change.CellsAfter[CellIndex]);
+
+		if (k == 0 || BlockBits != (SortedCells[k-1].SortKey >> LocalIndexBits))
+		{
+			Vector3i BlockIndex, Local;
+			GridConstants.ToGlobalLocal(Change.CellKeys[CellIndex], BlockIndex, Local);
+			Blocks.push_back(BlockRuns{ BlockIndex, (uint32_t)Runs.size(), 0 });
+		}
+		BlockRuns& CurBlock = Blocks.back();
+
+		// extend the previous run if this cell is the next local index and has the same before/after cells
+		if (CurBlock.NumRuns > 0)
+		{
+			CellRun& PrevRun = Runs.back();
+			if (PrevRun.LocalIndex + PrevRun.NumCells == LocalIndex && PrevRun.BeforeCell == BeforeCell && PrevRun.AfterCell == AfterCell)
+			{
+				PrevRun.NumCells++;
+				continue;
+			}
+		}
+		Runs.push_back(CellRun{ LocalIndex, 1, BeforeCell, AfterCell });
+		CurBlock.NumRuns++;
+	}
+}
+
+
+ModelGridCell ModelGridCompactDeltaChange::GetPaletteCell(uint32_t PaletteIndex) const
+{
+	const PackedCell& Packed = CellPalette[PaletteIndex];
+	ModelGridCell Cell;
+	Cell.CellType = (EModelGridCellType)Packed.CellType;
+	Cell.CellData = Packed.CellData;
+	Cell.MaterialType = (EGridCellMaterialType)Packed.MaterialType;
+	if (IsPerFaceMaterial(Cell.MaterialType))
+		Cell.FaceMaterials = FaceMaterialSets[Packed.FaceMaterialsIndex];
+	else
+		Cell.CellMaterial = GridMaterial(Packed.CellMaterial);
+	return Cell;
+}
+
+
+void ModelGridCompactDeltaChange::ExpandCells(const ModelGridConstants& GridConstants, bool bBefore,
+	std::vector<Vector3i>& BlockIndicesOut, std::vector<int>& BlockKeyOffsetsOut,
+	std::vector<Vector3i>& CellKeysOut, std::vector<uint32_t>& PaletteCellsOut) const
+{
+	BlockIndicesOut.clear();
+	BlockKeyOffsetsOut.clear();
+	CellKeysOut.clear();
+	PaletteCellsOut.clear();
+	CellKeysOut.reserve(NumCells);
+	PaletteCellsOut.reserve(NumCells);
+
+	for (const BlockRuns& Block : Blocks)
+	{
+		BlockIndicesOut.push_back(Block.BlockIndex);
+		BlockKeyOffsetsOut.push_back((int)CellKeysOut.size());
+		for (uint32_t ri = Block.FirstRun; ri < Block.FirstRun + Block.NumRuns; ++ri)
+		{
+			const CellRun& Run = Runs[ri];
+			uint32_t PaletteCell = (bBefore) ? Run.BeforeCell : Run.AfterCell;
+			for (int k = 0; k < Run.NumCells; ++k)
+			{
+				CellKeysOut.push_back(GridConstants.ToKey(Block.BlockIndex, FromLocalIndex(Run.LocalIndex + k)));
+				PaletteCellsOut.push_back(PaletteCell);
+			}
+		}
+	}
+	BlockKeyOffsetsOut.push_back((int)CellKeysOut.size());
+}
+
+
+void ModelGridCompactDeltaChange::ExtractToChange(ModelGridDeltaChange& ChangeOut, const ModelGridConstants& GridConstants) const
+{
+	ChangeOut.CellKeys.clear();
+	ChangeOut.CellsBefore.clear();
+	ChangeOut.CellsAfter.clear();
+	ChangeOut.CellKeys.reserve(NumCells);
+	ChangeOut.CellsBefore.reserve(NumCells);
+	ChangeOut.CellsAfter.reserve(NumCells);
+	ChangeOut.ChangeBounds = ChangeBounds;
+
+	for (const BlockRuns& Block : Blocks)
+	{
+		for (uint32_t ri = Block.FirstRun; ri < Block.FirstRun + Block.NumRuns; ++ri)
+		{
+			const CellRun& Run = Runs[ri];
+			ModelGridCell BeforeCell = GetPaletteCell(Run.BeforeCell);
+			ModelGridCell AfterCell = GetPaletteCell(Run.AfterCell);
+			for (int k = 0; k < Run.NumCells; ++k)
+			{
+				ChangeOut.CellKeys.push_back(GridConstants.ToKey(Block.BlockIndex, FromLocalIndex(Run.LocalIndex + k)));
+				ChangeOut.CellsBefore.push_back(BeforeCell);
+				ChangeOut.CellsAfter.push_back(AfterCell);
+			}
+		}
+	}
+}
+
+
+void ModelGridCompactDeltaChange::AppendAffectedBlocks(const ModelGrid& Grid, std::vector<Vector3i>& BlocksOut) const
+{
+	const AxisBox3i LocalKeyRange(Vector3i::Zero(), Vector3i(ModelGrid::BlockSize_XY-1, ModelGrid::BlockSize_XY-1, ModelGrid::BlockSize_Z-1));
+	const int AllFaces = (1 << 6) - 1;
+	for (const BlockRuns& Block : Blocks)
+	{
+		int BorderFaces = 0;
+		for (uint32_t ri = Block.FirstRun; ri < Block.FirstRun + Block.NumRuns && BorderFaces != AllFaces; ++ri)
+		{
+			const CellRun& Run = Runs[ri];
+			for (int k = 0; k < Run.NumCells; ++k)
+				BorderFaces |= GridChangeInfo::GetBlockBorderFaces(LocalKeyRange, FromLocalIndex(Run.LocalIndex + k));
+		}
+		GridChangeInfo::AppendAffectedBlocks(Grid, Block.BlockIndex, BorderFaces, BlocksOut);
+	}
+}
+
+
+size_t ModelGridCompactDeltaChange::GetMemorySize() const
+{
+	return sizeof(ModelGridCompactDeltaChange)
+		+ Blocks.capacity() * sizeof(BlockRuns)
+		+ Runs.capacity() * sizeof(CellRun)
+		+ CellPalette.capacity() * sizeof(PackedCell)
+		+ FaceMaterialSets.capacity() * sizeof(CellFaceMaterials);
+}
+
+
+
 ModelGridDeltaChangeTracker::~ModelGridDeltaChangeTracker()
 {
 	if (Change)
 		Change.reset();
-	KeyIndex.clear();
+	KeyIndex.Clear();
 }
 
 void ModelGridDeltaChangeTracker::AllocateNewChange()
 {
-	KeyIndex.clear();		// any existing is no longer valid
+	KeyIndex.Clear();		// any existing is no longer valid
 	Change = GSMakeUniquePtr<ModelGridDeltaChange>();
 }
 
@@ -47,7 +406,7 @@ GS::AxisBox3i ModelGridDeltaChangeTracker::GetCurrentChangeBounds() const
 
 void ModelGridDeltaChangeTracker::Reset()
 {
-	KeyIndex.clear();
+	KeyIndex.Clear();
 	if (Change)
 	{
 		Change->CellKeys.clear();
@@ -63,18 +422,57 @@ void ModelGridDeltaChangeTracker::AppendModifiedCell(const Vector3i& CellKey, co
 
 	Change->ChangeBounds.Contain(CellKey);
 
-	auto found_itr = KeyIndex.find(CellKey);
-	if (found_itr == KeyIndex.end())
+	int* FoundIndex = KeyIndex.Find(CellKey);
+	if (FoundIndex == nullptr || *FoundIndex < 0)
 	{
 		int NewIndex = (int)Change->CellKeys.size();
 		Change->CellKeys.push_back(CellKey);
 		Change->CellsBefore.push_back(PreviousState);
 		Change->CellsAfter.push_back(NewState);
-		KeyIndex.insert({ CellKey, NewIndex });
+		if (FoundIndex != nullptr)
+			*FoundIndex = NewIndex;
+		else
+			KeyIndex.Insert(CellKey, NewIndex);
 	}
 	else
 	{
-		int index = found_itr->second;
-		Change->CellsAfter[index] = NewState;
+		Change->CellsAfter[*FoundIndex] = NewState;
+	}
+}
+
+bool ModelGridDeltaChangeTracker::RemoveModifiedCell(const Vector3i& CellKey, ModelGridCell& PreviousStateOut)
+{
+	if (!Change) return false;
+
+	int* FoundIndex = KeyIndex.Find(CellKey);
+	if (FoundIndex == nullptr || *FoundIndex < 0)
+		return false;
+
+	// swap last cell into removed slot
+	int RemoveIndex = *FoundIndex;
+	int LastIndex = (int)Change->CellKeys.size() - 1;
+	PreviousStateOut = Change->CellsBefore[RemoveIndex];
+	if (RemoveIndex != LastIndex)
+	{
+		Change->CellKeys[RemoveIndex] = Change->CellKeys[LastIndex];
+		Change->CellsBefore[RemoveIndex] = Change->CellsBefore[LastIndex];
+		Change->CellsAfter[RemoveIndex] = Change->CellsAfter[LastIndex];
+		*KeyIndex.Find(Change->CellKeys[RemoveIndex]) = RemoveIndex;
 	}
+	Change->CellKeys.pop_back();
+	Change->CellsBefore.pop_back();
+	Change->CellsAfter.pop_back();
+	*FoundIndex = -1;
+	return true;
+}
+
+void ModelGridDeltaChangeTracker::ReserveAdditional(size_t NumCells)
+{
+	if (!Change) return;
+
+	size_t NewSize = Change->CellKeys.size() + NumCells;
+	Change->CellKeys.reserve(NewSize);
+	Change->CellsBefore.reserve(NewSize);
+	Change->CellsAfter.reserve(NewSize);
+	KeyIndex.Reserve(NewSize);
 }
@@ -1,28 +1,79 @@
 // Copyright Gradientspace Corp. All Rights Reserved.
 #include "ModelGrid/ModelGridCollision.h"
+#include "ModelGrid/ModelGridMesher.h"
+#include "ModelGrid/ModelGridCell_Extended.h"
+#include "ModelGrid/ModelGridChange.h"
 #include "Core/ParallelFor.h"
 #include "Core/gs_debug.h"
 #include "GenericGrid/BoxIndexing.h"
 #include "Intersection/GSRayBoxIntersection.h"
 
+#include <utility>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
 using namespace GS;
 
 ModelGridCollider::~ModelGridCollider()
 {
-	for (auto Pair : ActiveChunks)
+	// no queries can be in progress at this point
+	if (ChunkTable)
 	{
-		GridChunkCollider* collider = Pair.second;
-		if (collider != nullptr)
-			delete collider;
+		for (int k = 0; k < ChunkTableSize; ++k)
+		{
+			GridChunkCollider* collider = ChunkTable[k].exchange(nullptr);
+			if (collider != nullptr)
+				delete collider;
+		}
 	}
-	ActiveChunks.clear();
+	for (GridChunkCollider* collider : RetiredChunks)
+		delete collider;
+	for (GridChunkCollider* collider : WaitingChunks)
+		delete collider;
 }
 
 void ModelGridCollider::Initialize(const ModelGrid& TargetGridIn)
 {
 	GridConstants = ModelGridConstants(TargetGridIn);
 
-	gs_debug_assert(ActiveChunks.size() == 0);		// otherwise need to delete
+	gs_debug_assert(NumActiveChunks == 0);		// otherwise need to delete
+	ChunkTable = std::make_unique<std::atomic<GridChunkCollider*>[]>(ChunkTableSize);
+	for (int k = 0; k < ChunkTableSize; ++k)
+		ChunkTable[k] = nullptr;
+
+	// extract face planes of the unit cell shapes
+	ModelGridMesher UnitShapes;
+	UnitShapes.Initialize(GridConstants.CellDimensions);
+	auto AddUnitShape = [&](EModelGridCellType CellType, const PolyMesh& UnitMesh)
+	{
+		unsafe_vector<Vector3d>& FacePoints = UnitShapeFacePoints[(int)CellType];
+		FacePoints.clear(false);
+		int FaceCount = UnitMesh.GetFaceCount();
+		for (int fid = 0; fid < FaceCount; ++fid)
+		{
+			InlineIndexList Vertices;
+			bool bOK = UnitMesh.GetFaceVertexIndices(UnitMesh.GetFace(fid), Vertices);
+			if (!bOK || Vertices.Size() < 3) continue;
+			for (int j = 0; j < 3; ++j)
+				FacePoints.add(UnitMesh.GetPosition(Vertices[j]));
+		}
+	};
+	AddUnitShape(EModelGridCellType::Slab_Parametric, UnitShapes.UnitBoxMesh_Poly);
+	AddUnitShape(EModelGridCellType::Ramp_Parametric, UnitShapes.UnitRampMesh_Poly);
+	AddUnitShape(EModelGridCellType::Corner_Parametric, UnitShapes.UnitCornerMesh_Poly);
+	AddUnitShape(EModelGridCellType::Pyramid_Parametric, UnitShapes.UnitPyramidMesh_Poly);
+	AddUnitShape(EModelGridCellType::Peak_Parametric, UnitShapes.UnitPeakMesh_Poly);
+	AddUnitShape(EModelGridCellType::Cylinder_Parametric, UnitShapes.UnitCylinderMesh_Poly);
+	AddUnitShape(EModelGridCellType::CutCorner_Parametric, UnitShapes.UnitCutCornerMesh_Poly);
+}
+
+
+const ModelGridCollider::NonBoxCell* ModelGridCollider::GridChunkCollider::FindNonBoxCell(int BitIndex) const
+{
+	auto found_itr = std::lower_bound(NonBoxCells.begin(), NonBoxCells.end(), BitIndex,
+		[](const NonBoxCell& Cell, int Index) { return (int)Cell.BitIndex < Index; });
+	return (found_itr != NonBoxCells.end() && (int)found_itr->BitIndex == BitIndex) ? &(*found_itr) : nullptr;
 }
 
 
@@ -32,126 +83,978 @@ void ModelGridCollider::UpdateInBounds(const ModelGrid& TargetGrid, const AxisBo
 	if (ChunkIdxRange.IsValid() == false) return;
 	Vector3i Dims = (Vector3i)ChunkIdxRange.AxisCounts();
 
-	std::vector<Vector3i> UpdateChunks;
-	UpdateChunks.reserve((Dims.X + 1) * (Dims.Y + 1) * (Dims.Z + 1));
+	std::vector<Vector3i> RangeChunks;
+	RangeChunks.reserve((Dims.X + 1) * (Dims.Y + 1) * (Dims.Z + 1));
 	for (int zi = ChunkIdxRange.Min.Z; zi <= ChunkIdxRange.Max.Z; zi++)
 	{
 		for (int yi = ChunkIdxRange.Min.Y; yi <= ChunkIdxRange.Max.Y; yi++)
 		{
 			for (int xi = ChunkIdxRange.Min.X; xi <= ChunkIdxRange.Max.X; xi++)
-			{
-				Vector3i ChunkIndex(xi, yi, zi);
-				if (TargetGrid.IsChunkIndexAllocated(ChunkIndex))
-				{
-					UpdateChunks.push_back(ChunkIndex);
-
-					if (ActiveChunks.contains(ChunkIndex) == false)
-					{
-						GridChunkCollider* ChunkCollider = new GridChunkCollider();
-						ChunkCollider->ChunkIndex = ChunkIndex;
-						ChunkCollider->ChunkBounds = GridConstants.GetChunkBounds(ChunkIndex);
-						ActiveChunks.insert({ ChunkIndex, ChunkCollider });
-					}
-				}
-			}
+				RangeChunks.push_back(Vector3i(xi, yi, zi));
 		}
 	}
+	UpdateBlocks(TargetGrid, RangeChunks);
+}
+
+
+void ModelGridCollider::UpdateBlocks(const ModelGrid& TargetGrid, const std::vector<Vector3i>& BlockIndices)
+{
+	std::scoped_lock update_lock(UpdateLock);
+
+	std::vector<Vector3i> UpdateChunks;
+	UpdateChunks.reserve(BlockIndices.size());
+	for (Vector3i ChunkIndex : BlockIndices)
+	{
+		if (TargetGrid.IsChunkIndexAllocated(ChunkIndex))
+			UpdateChunks.push_back(ChunkIndex);
+	}
 
+	// build new chunk colliders in parallel, and then publish them
+	std::vector<GridChunkCollider*> NewChunks(UpdateChunks.size(), nullptr);
 	GS::ParallelFor((uint32_t)UpdateChunks.size(), [&](int Index)
 	{
-		Vector3i ChunkIndex = UpdateChunks[Index];
-		auto found_itr = ActiveChunks.find(ChunkIndex);
-		if (found_itr != ActiveChunks.end())
+		GridChunkCollider* NewChunk = CreateChunk(UpdateChunks[Index]);
+		UpdateChunkCells(TargetGrid, *NewChunk);
+		NewChunks[Index] = NewChunk;
+	});
+	for (GridChunkCollider* NewChunk : NewChunks)
+		PublishChunk(NewChunk);
+
+	ReclaimRetiredChunks_Locked();
+}
+
+
+ModelGridCollider::GridChunkCollider* ModelGridCollider::CreateChunk(const Vector3i& ChunkIndex) const
+{
+	GridChunkCollider* ChunkCollider = new GridChunkCollider();
+	ChunkCollider->ChunkIndex = ChunkIndex;
+	ChunkCollider->ChunkBounds = GridConstants.GetChunkBounds(ChunkIndex);
+	return ChunkCollider;
+}
+
+void ModelGridCollider::PublishChunk(GridChunkCollider* NewChunk)
+{
+	// expand range before the chunk becomes visible
+	for (int k = 0; k < 3; ++k)
+	{
+		if (NewChunk->ChunkIndex[k] < ActiveChunksRangeMin[k].load())
+			ActiveChunksRangeMin[k] = NewChunk->ChunkIndex[k];
+		if (NewChunk->ChunkIndex[k] > ActiveChunksRangeMax[k].load())
+			ActiveChunksRangeMax[k] = NewChunk->ChunkIndex[k];
+	}
+
+	GridChunkCollider* PrevChunk = ChunkTable[ToChunkTableIndex(NewChunk->ChunkIndex)].exchange(NewChunk);
+	if (PrevChunk != nullptr)
+		RetiredChunks.push_back(PrevChunk);
+	else
+		NumActiveChunks++;
+}
+
+AxisBox3i ModelGridCollider::GetActiveChunksRange() const
+{
+	AxisBox3i Range;
+	for (int k = 0; k < 3; ++k)
+	{
+		Range.Min[k] = ActiveChunksRangeMin[k].load();
+		Range.Max[k] = ActiveChunksRangeMax[k].load();
+	}
+	return Range;
+}
+
+
+void ModelGridCollider::ReclaimRetiredChunks()
+{
+	std::scoped_lock update_lock(UpdateLock);
+	ReclaimRetiredChunks_Locked();
+}
+
+void ModelGridCollider::ReclaimRetiredChunks_Locked()
+{
+	auto DeleteWaitingIfUnreferenced = [this]()
+	{
+		if (WaitingChunks.size() == 0 || EpochReaderCounts[WaitingEpochSlot].load() != 0)
+			return;
+		for (GridChunkCollider* Chunk : WaitingChunks)
+			delete Chunk;
+		WaitingChunks.clear();
+	};
+
+	DeleteWaitingIfUnreferenced();
+
+	// Flip the epoch. Queries that might have loaded a retired chunk registered before the flip, and so are counted in the
+	// previous epoch slot. Queries that register after the flip can only load the chunks that replaced them.
+	if (WaitingChunks.size() == 0 && RetiredChunks.size() > 0)
+	{
+		WaitingEpochSlot = (int)(ReadEpoch.load() & 1);
+		ReadEpoch.fetch_add(1);
+		std::swap(WaitingChunks, RetiredChunks);
+		DeleteWaitingIfUnreferenced();
+	}
+}
+
+
+void ModelGridCollider::UpdateModifiedCells(const ModelGrid& TargetGrid, const std::vector<Vector3i>& ModifiedCellKeys)
+{
+	// modified cells and their 6-neighbours, as the surface state of the neighbours depends on the modified cells.
+	// Sorted by chunk so that each chunk is copied and republished once.
+	struct ChunkCell
+	{
+		Vector3i ChunkIndex;
+		Vector3i CellKey;
+	};
+	std::vector<ChunkCell> UpdateCells;
+	UpdateCells.reserve(ModifiedCellKeys.size() * 7);
+	for (const Vector3i& CellKey : ModifiedCellKeys)
+	{
+		for (int j = -1; j < 6; ++j)
 		{
-			GridChunkCollider* FoundCollider = found_itr->second;
-			UpdateChunkCells(TargetGrid, *FoundCollider);
+			Vector3i UpdateKey = (j < 0) ? CellKey : (CellKey + FaceIndexToOffset(j));
+			if (GridConstants.IsValidCell(UpdateKey))
+				UpdateCells.push_back(ChunkCell{ GridConstants.GetChunkIndexForKey(UpdateKey), UpdateKey });
 		}
+	}
+	auto LessThan = [](const Vector3i& A, const Vector3i& B) {
+		return (A.Z != B.Z) ? (A.Z < B.Z) : ((A.Y != B.Y) ? (A.Y < B.Y) : (A.X < B.X));
+	};
+	std::sort(UpdateCells.begin(), UpdateCells.end(), [&](const ChunkCell& A, const ChunkCell& B) {
+		return (A.ChunkIndex != B.ChunkIndex) ? LessThan(A.ChunkIndex, B.ChunkIndex) : LessThan(A.CellKey, B.CellKey);
 	});
+	UpdateCells.erase(std::unique(UpdateCells.begin(), UpdateCells.end(), [](const ChunkCell& A, const ChunkCell& B) { 
+		return A.CellKey == B.CellKey; }), UpdateCells.end());
+
+	std::scoped_lock update_lock(UpdateLock);
+
+	// modified copy of the current chunk, published when all its cells are updated
+	GridChunkCollider* EditChunk = nullptr;
+	Vector3i CurChunkIndex = Vector3i::MaxInt();
+	for (const ChunkCell& UpdateCell : UpdateCells)
+	{
+		if (UpdateCell.ChunkIndex != CurChunkIndex)
+		{
+			if (EditChunk != nullptr)
+				PublishChunk(EditChunk);
+			EditChunk = nullptr;
+			CurChunkIndex = UpdateCell.ChunkIndex;
 
+			const GridChunkCollider* ExistingChunk = GetChunk(CurChunkIndex);
+			if (ExistingChunk != nullptr)
+				EditChunk = new GridChunkCollider(*ExistingChunk);
+			else if (TargetGrid.IsChunkIndexAllocated(CurChunkIndex))
+			{
+				// new chunk is built from scratch, so it does not need per-cell updates
+				GridChunkCollider* NewChunk = CreateChunk(CurChunkIndex);
+				UpdateChunkCells(TargetGrid, *NewChunk);
+				PublishChunk(NewChunk);
+			}
+		}
+		if (EditChunk != nullptr)
+			UpdateSingleCell(TargetGrid, *EditChunk, UpdateCell.CellKey);
+	}
+	if (EditChunk != nullptr)
+		PublishChunk(EditChunk);
+
+	ReclaimRetiredChunks_Locked();
+}
+
+void ModelGridCollider::UpdateFromChange(const ModelGrid& TargetGrid, const ModelGridDeltaChange& Change)
+{
+	UpdateModifiedCells(TargetGrid, Change.CellKeys);
+}
+
+
+static inline void SetCellBit(uint64_t* Bits, int BitIndex, bool bValue, int& SetBitCount)
+{
+	uint64_t Mask = (uint64_t)1 << (BitIndex & 63);
+	bool bWasSet = (Bits[BitIndex >> 6] & Mask) != 0;
+	if (bValue == bWasSet) return;
+	if (bValue) {
+		Bits[BitIndex >> 6] |= Mask;
+		SetBitCount++;
+	} else {
+		Bits[BitIndex >> 6] &= ~Mask;
+		SetBitCount--;
+	}
+}
+
+void ModelGridCollider::UpdateSingleCell(const ModelGrid& TargetGrid, GridChunkCollider& Chunk, const Vector3i& CellKey)
+{
+	bool bIsInGrid = false;
+	ModelGridCell CellInfo = TargetGrid.GetCellInfo(CellKey, bIsInGrid);
+	bool bNonEmpty = bIsInGrid && CellInfo.CellType != EModelGridCellType::Empty;
+	bool bIsSurface = false;
+	if (bNonEmpty)
+	{
+		for (int j = 0; j < 6 && bIsSurface == false; ++j)
+			bIsSurface = (TargetGrid.IsCellSolid(CellKey + FaceIndexToOffset(j)) == false);
+	}
+
+	Vector3i BlockIndex, LocalIndex;
+	GridConstants.ToGlobalLocal(CellKey, BlockIndex, LocalIndex);
+	int BitIndex = ToCellBitIndex(LocalIndex);
+	SetCellBit(Chunk.OccupiedCellBits, BitIndex, bNonEmpty, Chunk.NumOccupiedCells);
+	SetCellBit(Chunk.SurfaceCellBits, BitIndex, bIsSurface, Chunk.NumSurfaceCells);
+
+	// keep sorted NonBoxCells list in sync
+	auto found_itr = std::lower_bound(Chunk.NonBoxCells.begin(), Chunk.NonBoxCells.end(), BitIndex,
+		[](const NonBoxCell& Cell, int Index) { return (int)Cell.BitIndex < Index; });
+	int64_t ListIndex = (int64_t)(found_itr - Chunk.NonBoxCells.begin());
+	bool bInList = (found_itr != Chunk.NonBoxCells.end() && (int)found_itr->BitIndex == BitIndex);
+	if (bStoreNonBoxCells && bIsSurface && CellInfo.CellType != EModelGridCellType::Filled)
+	{
+		NonBoxCell NewCell{ (uint16_t)BitIndex, CellInfo.CellType, CellInfo.CellData };
+		if (bInList)
+			Chunk.NonBoxCells[ListIndex] = NewCell;
+		else
+		{
+			Chunk.NonBoxCells.add(NewCell);
+			std::rotate(Chunk.NonBoxCells.begin() + ListIndex, Chunk.NonBoxCells.end() - 1, Chunk.NonBoxCells.end());
+		}
+	}
+	else if (bInList)
+	{
+		Chunk.NonBoxCells.remove_at(ListIndex);
+	}
 }
 
 
 void ModelGridCollider::UpdateChunkCells(const ModelGrid& TargetGrid, GridChunkCollider& ChunkCollider)
 {
-	ChunkCollider.CellBounds.clear();
+	constexpr int SizeXY = ModelGrid::BlockSize_XY;
+	constexpr int SizeZ = ModelGrid::BlockSize_Z;
+	static_assert(SizeXY + 2 <= 32, "occupancy rows must fit in 32 bits");
+	static_assert(64 % SizeXY == 0, "rows of cells must pack into 64-bit words");
 
+	// Filled-cell occupancy of the block and a 1-cell apron of the 6-neighbour blocks. Each row is a
+	// sequence of X cells, bit 0 is X = -1 and bit SizeXY+1 is X = SizeXY. Rows are indexed by [Z+1][Y+1].
+	// Non-box cells do not occlude their neighbours, as rays can pass through the empty part of the cell.
+	uint32_t Occupied[SizeZ + 2][SizeXY + 2];
+	// non-empty-cell occupancy of the block itself, same row layout
+	uint32_t NonEmpty[SizeZ + 2][SizeXY + 2];
+	for (int zi = 0; zi < SizeZ + 2; ++zi)
+		for (int yi = 0; yi < SizeXY + 2; ++yi)
+			Occupied[zi][yi] = NonEmpty[zi][yi] = 0;
+
+	ChunkCollider.NonBoxCells.clear(false);
 	TargetGrid.EnumerateFilledChunkCells(ChunkCollider.ChunkIndex,
 		[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo, const AxisBox3d& LocalBounds)
 	{
+		Vector3i BlockIndex, LocalIndex;
+		GridConstants.ToGlobalLocal(Key, BlockIndex, LocalIndex);
+		NonEmpty[LocalIndex.Z + 1][LocalIndex.Y + 1] |= (1u << (LocalIndex.X + 1));
+		if (CellInfo.CellType == EModelGridCellType::Filled)
+			Occupied[LocalIndex.Z + 1][LocalIndex.Y + 1] |= (1u << (LocalIndex.X + 1));
+		else if (bStoreNonBoxCells)
+			ChunkCollider.NonBoxCells.add( NonBoxCell{ (uint16_t)ToCellBitIndex(LocalIndex), CellInfo.CellType, CellInfo.CellData } );
+	});
+
+	// fill in apron from neighbour blocks
+	AxisBox3i KeyRange = GridConstants.GetKeyRangeForChunk(ChunkCollider.ChunkIndex);
+	for (int zi = 0; zi < SizeZ; ++zi)
+	{
+		for (int yi = 0; yi < SizeXY; ++yi)
+		{
+			if (TargetGrid.IsCellSolid(KeyRange.Min + Vector3i(-1, yi, zi)))
+				Occupied[zi + 1][yi + 1] |= 1u;
+			if (TargetGrid.IsCellSolid(KeyRange.Min + Vector3i(SizeXY, yi, zi)))
+				Occupied[zi + 1][yi + 1] |= (1u << (SizeXY + 1));
+		}
+		for (int xi = 0; xi < SizeXY; ++xi)
+		{
+			if (TargetGrid.IsCellSolid(KeyRange.Min + Vector3i(xi, -1, zi)))
+				Occupied[zi + 1][0] |= (1u << (xi + 1));
+			if (TargetGrid.IsCellSolid(KeyRange.Min + Vector3i(xi, SizeXY, zi)))
+				Occupied[zi + 1][SizeXY + 1] |= (1u << (xi + 1));
+		}
+	}
+	for (int yi = 0; yi < SizeXY; ++yi)
+	{
+		for (int xi = 0; xi < SizeXY; ++xi)
+		{
+			if (TargetGrid.IsCellSolid(KeyRange.Min + Vector3i(xi, yi, -1)))
+				Occupied[0][yi + 1] |= (1u << (xi + 1));
+			if (TargetGrid.IsCellSolid(KeyRange.Min + Vector3i(xi, yi, SizeZ)))
+				Occupied[SizeZ + 1][yi + 1] |= (1u << (xi + 1));
+		}
+	}
 
-		bool bFoundEmptyNeighbour = false;
-		for (int k = 0; k < 6; ++k)
+	// a cell is a surface cell if it is non-empty and any of its 6 neighbours is not Filled. 
+	// This can be computed for an entire row at once by and-ing the shifted Filled row and the 4 adjacent Filled rows.
+	const uint32_t RowMask = ((1u << SizeXY) - 1);
+	ChunkCollider.NumSurfaceCells = 0;
+	ChunkCollider.NumOccupiedCells = 0;
+	for (int k = 0; k < BlockCellCount / 64; ++k)
+		ChunkCollider.SurfaceCellBits[k] = ChunkCollider.OccupiedCellBits[k] = 0;
+	for (int zi = 1; zi <= SizeZ; ++zi)
+	{
+		for (int yi = 1; yi <= SizeXY; ++yi)
 		{
-			Vector3i NeighbourKey = Key + GS::FaceIndexToOffset(k);
-			if (TargetGrid.IsCellEmpty(NeighbourKey))
+			uint32_t Row = NonEmpty[zi][yi];
+			if (Row == 0) continue;
+			int BitIndex = ToCellBitIndex(Vector3i(0, yi - 1, zi - 1));
+			uint64_t RowCells = (uint64_t)((Row >> 1) & RowMask);
+			ChunkCollider.OccupiedCellBits[BitIndex >> 6] |= (RowCells << (BitIndex & 63));
+			ChunkCollider.NumOccupiedCells += std::popcount(RowCells);
+
+			uint32_t Filled = Occupied[zi][yi];
+			uint32_t Interior = Row & (Filled << 1) & (Filled >> 1) & Occupied[zi][yi-1] & Occupied[zi][yi+1] & Occupied[zi-1][yi] & Occupied[zi+1][yi];
+			uint64_t Surface = (uint64_t)(((Row & ~Interior) >> 1) & RowMask);
+			if (Surface != 0)
 			{
-				bFoundEmptyNeighbour = true;
-				break;
+				ChunkCollider.SurfaceCellBits[BitIndex >> 6] |= (Surface << (BitIndex & 63));
+				ChunkCollider.NumSurfaceCells += std::popcount(Surface);
 			}
 		}
-		if (bFoundEmptyNeighbour)
-			ChunkCollider.CellBounds.add(LocalBounds);
-	});
+	}
+
+	// only keep non-box cells that are on the surface
+	if (ChunkCollider.NonBoxCells.size() > 0)
+	{
+		unsafe_vector<NonBoxCell> SurfaceNonBoxCells;
+		for (const NonBoxCell& Cell : ChunkCollider.NonBoxCells)
+		{
+			if (ChunkCollider.IsSurfaceCell(Cell.BitIndex))
+				SurfaceNonBoxCells.add(Cell);
+		}
+		std::sort(SurfaceNonBoxCells.begin(), SurfaceNonBoxCells.end(), [](const NonBoxCell& A, const NonBoxCell& B) { return A.BitIndex < B.BitIndex; });
+		ChunkCollider.NonBoxCells = std::move(SurfaceNonBoxCells);
+	}
 }
 
 
+// clip ray to box with slab test. EntryAxisOut is the axis of the box face the ray enters through, or -1 if the ray origin is inside the box
+static bool ClipRayToBox(const Ray3d& Ray, const AxisBox3d& Box, double& TMinOut, double& TMaxOut, int& EntryAxisOut)
+{
+	double TMin = 0, TMax = Mathd::SafeMaxValue();
+	EntryAxisOut = -1;
+	for (int k = 0; k < 3; ++k)
+	{
+		if (Ray.Direction[k] == 0)
+		{
+			if (Ray.Origin[k] < Box.Min[k] || Ray.Origin[k] > Box.Max[k])
+				return false;
+			continue;
+		}
+		double InvDir = 1.0 / Ray.Direction[k];
+		double T0 = (Box.Min[k] - Ray.Origin[k]) * InvDir;
+		double T1 = (Box.Max[k] - Ray.Origin[k]) * InvDir;
+		if (T0 > T1) std::swap(T0, T1);
+		if (T0 > TMin) {
+			TMin = T0;
+			EntryAxisOut = k;
+		}
+		TMax = GS::Min(TMax, T1);
+		if (TMin > TMax)
+			return false;
+	}
+	TMinOut = TMin;
+	TMaxOut = TMax;
+	return true;
+}
+
+// return axis that the ray is most aligned with, used as "entry" axis when the ray starts inside a box
+static int GetDominantAxis(const Vector3d& Direction)
+{
+	Vector3d AbsDir = Direction.Abs();
+	return (AbsDir.X >= AbsDir.Y && AbsDir.X >= AbsDir.Z) ? 0 : ((AbsDir.Y >= AbsDir.Z) ? 1 : 2);
+}
+
+/**
+ * Incremental Amanatides-Woo traversal of a regular grid of boxes of size CellSize, with box (0,0,0) having min-corner at GridOrigin.
+ * Initialize() finds the box containing the ray point at TStart, Step() advances to the next box along the ray.
+ */
+struct RayGridWalker
+{
+	Vector3i Cell;
+	Vector3i StepDir;
+	Vector3d TNext;		// ray parameter at which the ray crosses into the next cell along each axis
+	Vector3d TDelta;	// ray parameter increment to cross one cell along each axis
+	double TCur = 0;
+	int LastAxis = 0;
+
+	void Initialize(const Ray3d& Ray, const Vector3d& GridOrigin, const Vector3d& CellSize, double TStart, int EntryAxis, const AxisBox3i& CellRange)
+	{
+		TCur = TStart;
+		LastAxis = (EntryAxis >= 0) ? EntryAxis : GetDominantAxis(Ray.Direction);
+		Vector3d StartPos = Ray.PointAt(TStart);
+		for (int k = 0; k < 3; ++k)
+		{
+			double Dir = Ray.Direction[k];
+			StepDir[k] = (Dir > 0) ? 1 : ((Dir < 0) ? -1 : 0);
+
+			Cell[k] = (int)GS::Floor((StartPos[k] - GridOrigin[k]) / CellSize[k]);
+			// if we are exactly on a cell boundary we may have rounded into the cell behind us
+			if (k == EntryAxis && StepDir[k] < 0)
+			{
+				double CellMin = GridOrigin[k] + (double)Cell[k] * CellSize[k];
+				if (StartPos[k] <= CellMin)
+					Cell[k]--;
+			}
+			Cell[k] = GS::Clamp(Cell[k], CellRange.Min[k], CellRange.Max[k]);
+
+			if (StepDir[k] == 0)
+			{
+				TNext[k] = Mathd::SafeMaxValue();
+				TDelta[k] = Mathd::SafeMaxValue();
+			}
+			else
+			{
+				double NextBoundary = GridOrigin[k] + (double)(Cell[k] + ((StepDir[k] > 0) ? 1 : 0)) * CellSize[k];
+				TNext[k] = (NextBoundary - Ray.Origin[k]) / Dir;
+				TDelta[k] = CellSize[k] / GS::Abs(Dir);
+			}
+		}
+	}
+
+	// advance to next cell. Returns false if it would be beyond TEnd or outside CellRange
+	bool Step(double TEnd, const AxisBox3i& CellRange)
+	{
+		int Axis = (TNext.X < TNext.Y) ? ((TNext.X < TNext.Z) ? 0 : 2) : ((TNext.Y < TNext.Z) ? 1 : 2);
+		if (TNext[Axis] > TEnd)
+			return false;
+		TCur = TNext[Axis];
+		Cell[Axis] += StepDir[Axis];
+		TNext[Axis] += TDelta[Axis];
+		LastAxis = Axis;
+		return (Cell[Axis] >= CellRange.Min[Axis] && Cell[Axis] <= CellRange.Max[Axis]);
+	}
+
+	Vector3d GetEntryNormal() const
+	{
+		Vector3d Normal = Vector3d::Zero();
+		Normal[LastAxis] = (StepDir[LastAxis] != 0) ? -(double)StepDir[LastAxis] : 1.0;
+		return Normal;
+	}
+};
+
+
 bool ModelGridCollider::FindNearestHitCell(const Ray3d& Ray, double& RayParameterOut, Vector3d& CellFaceNormal, Vector3i& CellKey) const
 {
-	// todo obvs should find nearest chunk first...which can be done based on grid DDA...
-	// todo could test all hit chunks in parallel...
+	ReadScope ReadGuard(*this);
+	AxisBox3i ActiveChunksRange = GetActiveChunksRange();
+	if (NumActiveChunks == 0 || ActiveChunksRange.IsValid() == false)
+		return false;
+	AxisBox3d ActiveChunksBounds = GridConstants.GetChunkBounds(ActiveChunksRange.Min);
+	ActiveChunksBounds.Contain(GridConstants.GetChunkBounds(ActiveChunksRange.Max));
+
+	double RayTStart = 0, RayTEnd = 0;
+	int EntryAxis = -1;
+	if (ClipRayToBox(Ray, ActiveChunksBounds, RayTStart, RayTEnd, EntryAxis) == false)
+		return false;
+
+	// walk blocks front-to-back
+	Vector3d BlockSize = GridConstants.CellDimensions * (Vector3d)ModelGridConstants::Block_CellType::TypeDimensions();
+	Vector3d BlockGridOrigin = (Vector3d)GridConstants.MinCoordCorner * GridConstants.CellDimensions;
+
+	RayGridWalker BlockWalker;
+	BlockWalker.Initialize(Ray, BlockGridOrigin, BlockSize, RayTStart, EntryAxis, ActiveChunksRange);
+	do
+	{
+		const GridChunkCollider* Chunk = GetChunk(BlockWalker.Cell);
+		if (Chunk != nullptr && Chunk->NumSurfaceCells > 0)
+		{
+			double BlockTEnd = GS::Min(RayTEnd, GS::Min(BlockWalker.TNext.X, GS::Min(BlockWalker.TNext.Y, BlockWalker.TNext.Z)));
+			int BlockEntryAxis = (BlockWalker.TCur > 0 || EntryAxis >= 0) ? BlockWalker.LastAxis : -1;
+			if (FindNearestHitCellInChunk(*Chunk, Ray, BlockWalker.TCur, BlockTEnd, BlockEntryAxis, RayParameterOut, CellFaceNormal, CellKey))
+				return true;
+		}
+	} while (BlockWalker.Step(RayTEnd, ActiveChunksRange));
+
+	return false;
+}
+
+
+void ModelGridCollider::FindNearestHitCells(const std::vector<Ray3d>& Rays, std::vector<RayHitResult>& HitsOut) const
+{
+	HitsOut.clear();
+	HitsOut.resize(Rays.size());
+	if (Rays.size() == 0 || NumActiveChunks == 0)
+		return;
 
-	double MinHitT = Mathd::SafeMaxValue();
-	AxisBox3d MinHitBox;
-	for (const auto& Pair : ActiveChunks)
+	// sort rays by origin block and direction octant
+	struct RaySortKey
+	{
+		uint64_t Key;
+		uint32_t RayIndex;
+	};
+	std::vector<RaySortKey> SortedRays;
+	SortedRays.resize(Rays.size());
+	for (size_t k = 0; k < Rays.size(); ++k)
 	{
-		const GridChunkCollider& Chunk = *Pair.second;
+		const Ray3d& Ray = Rays[k];
+		bool bIsInGrid = false;
+		ModelGrid::CellKey OriginCell = GridConstants.GetCellAtPosition(Ray.Origin, bIsInGrid);
+		Vector3i OriginBlock = GridConstants.GetChunkIndexForKey(OriginCell);
+		int Octant = ((Ray.Direction.X < 0) ? 1 : 0) | ((Ray.Direction.Y < 0) ? 2 : 0) | ((Ray.Direction.Z < 0) ? 4 : 0);
+		// 19 bits per block axis is plenty as rays starting far outside the grid can go in any bin
+		uint64_t BlockBits = ((uint64_t)(OriginBlock.Z & 0x7FFFF) << 38) | ((uint64_t)(OriginBlock.Y & 0x7FFFF) << 19) | (uint64_t)(OriginBlock.X & 0x7FFFF);
+		SortedRays[k] = RaySortKey{ (BlockBits << 3) | (uint64_t)Octant, (uint32_t)k };
+	}
+	std::sort(SortedRays.begin(), SortedRays.end(), [](const RaySortKey& A, const RaySortKey& B) { return A.Key < B.Key; });
+
+	// process packets of sorted rays in parallel
+	constexpr int PacketSize = 32;
+	uint32_t NumPackets = (uint32_t)((SortedRays.size() + PacketSize - 1) / PacketSize);
+	GS::ParallelFor(NumPackets, [&](int PacketIndex)
+	{
+		size_t Start = (size_t)PacketIndex * PacketSize;
+		size_t End = GS::Min(Start + PacketSize, SortedRays.size());
+		for (size_t k = Start; k < End; ++k)
+		{
+			uint32_t RayIndex = SortedRays[k].RayIndex;
+			RayHitResult& Result = HitsOut[RayIndex];
+			Result.bHit = FindNearestHitCell(Rays[RayIndex], Result.RayParameter, Result.CellFaceNormal, Result.CellKey);
+		}
+	});
+}
+
+
+bool ModelGridCollider::FindNearestHitCellInChunk(const GridChunkCollider& Chunk, const Ray3d& Ray, double RayTStart, double RayTEnd, int EntryAxis,
+	double& RayParameterOut, Vector3d& CellFaceNormal, Vector3i& CellKey) const
+{
+	AxisBox3i KeyRange = GridConstants.GetKeyRangeForChunk(Chunk.ChunkIndex);
 
-		double ChunkBoxHitT = GS::TestRayBoxIntersection(Ray, Chunk.ChunkBounds);
-		if (ChunkBoxHitT < MinHitT)
+	RayGridWalker CellWalker;
+	CellWalker.Initialize(Ray, Vector3d::Zero(), GridConstants.CellDimensions, RayTStart, EntryAxis, KeyRange);
+	do
+	{
+		Vector3i LocalIndex = CellWalker.Cell - KeyRange.Min;
+		int BitIndex = ToCellBitIndex(LocalIndex);
+		if (Chunk.IsSurfaceCell(BitIndex))
 		{
-			for (const AxisBox3d& CellBox : Chunk.CellBounds)
+			const NonBoxCell* NonBox = (bExactParametricHitTests && Chunk.NonBoxCells.size() > 0) ? Chunk.FindNonBoxCell(BitIndex) : nullptr;
+			if (NonBox != nullptr)
 			{
-				double BoxHitT = GS::TestRayBoxIntersection(Ray, CellBox);
-				if (BoxHitT < MinHitT)
+				double CellTEnd = GS::Min(CellWalker.TNext.X, GS::Min(CellWalker.TNext.Y, CellWalker.TNext.Z));
+				if (FindExactHitInCell(*NonBox, CellWalker.Cell, Ray, CellWalker.TCur, CellTEnd, CellWalker.GetEntryNormal(), RayParameterOut, CellFaceNormal))
 				{
-					MinHitT = BoxHitT;
-					MinHitBox = CellBox;
-
-					bool bIsInGrid = false;
-					CellKey = GridConstants.GetCellAtPosition(CellBox.Center(), bIsInGrid);
-					gs_debug_assert(bIsInGrid);
+					CellKey = CellWalker.Cell;
+					return true;
 				}
+				continue;
 			}
+
+			RayParameterOut = CellWalker.TCur;
+			CellFaceNormal = CellWalker.GetEntryNormal();
+			CellKey = CellWalker.Cell;
+			return true;
 		}
+	} while (CellWalker.Step(RayTEnd, KeyRange));
+
+	return false;
+}
+
+
+
+// Clip ray span [TMin,TMax] against convex shape defined by face planes, each given by 3 points. Planes are
+// oriented away from InteriorPoint. NormalOut is the normal of the last plane the ray enters, and is unmodified if
+// the ray is already inside all the planes at TMin.
+static bool ClipRayToConvexShape(const Ray3d& Ray, const Vector3d* FacePoints, int NumFaces, const Vector3d& InteriorPoint,
+	double TMin, double TMax, double& TEnterOut, Vector3d& NormalOut)
+{
+	double TEnter = TMin, TExit = TMax;
+	for (int k = 0; k < NumFaces; ++k)
+	{
+		const Vector3d& A = FacePoints[3*k];
+		Vector3d N = GS::Normal(A, FacePoints[3*k+1], FacePoints[3*k+2]);
+		if (N.SquaredLength() < 0.5)
+			continue;		// degenerate face, eg due to zero-size sub-cell dimension
+		if (N.Dot(InteriorPoint - A) > 0)
+			N = -N;
+
+		double Dist = N.Dot(Ray.Origin - A);
+		double Denom = N.Dot(Ray.Direction);
+		if (Denom == 0)
+		{
+			if (Dist > 0) return false;		// parallel to plane and outside
+			continue;
+		}
+		double T = -Dist / Denom;
+		if (Denom < 0)
+		{
+			if (T > TEnter) {
+				TEnter = T;
+				NormalOut = N;
+			}
+		}
+		else
+			TExit = GS::Min(TExit, T);
+		if (TEnter > TExit)
+			return false;
 	}
+	TEnterOut = TEnter;
+	return true;
+}
 
-	if (MinHitT < Mathd::SafeMaxValue())
+
+bool ModelGridCollider::FindExactHitInCell(const NonBoxCell& Cell, const Vector3i& CellKey, const Ray3d& Ray, double RayTStart, double RayTEnd, const Vector3d& EntryNormal,
+	double& RayParameterOut, Vector3d& HitNormalOut) const
+{
+	ModelGridCell CellInfo;
+	CellInfo.CellType = Cell.CellType;
+	CellInfo.CellData = Cell.CellData;
+
+	const Vector3d& CellDims = GridConstants.CellDimensions;
+	Vector3d CellMin = (Vector3d)CellKey * CellDims;
+
+	// variable-cut shapes are a box cut by a single plane, see ModelGridMesher::AppendVariableCutCorner/AppendVariableCutEdge
+	constexpr int MaxFaces = 7;
+	Vector3d CutShapePoints[MaxFaces * 3];
+	const Vector3d* UnitFacePoints = nullptr;
+	int NumFaces = 0;
+	if (Cell.CellType == EModelGridCellType::VariableCutCorner_Parametric || Cell.CellType == EModelGridCellType::VariableCutEdge_Parametric)
 	{
-		RayParameterOut = MinHitT;
-		CellFaceNormal = Vector3d::UnitZ();
+		constexpr int NumSteps = 16;
+		double SX = CellDims.X, SY = CellDims.Y, SZ = CellDims.Z;
+		for (int k = 0; k < 3; ++k)
+		{
+			Vector3d U = Vector3d::Zero(), V = Vector3d::Zero();
+			U[(k + 1) % 3] = CellDims[(k + 1) % 3];
+			V[(k + 2) % 3] = CellDims[(k + 2) % 3];
+			Vector3d MaxOffset = Vector3d::Zero();
+			MaxOffset[k] = CellDims[k];
+			CutShapePoints[6*k] = Vector3d::Zero();  CutShapePoints[6*k+1] = U;  CutShapePoints[6*k+2] = V;
+			CutShapePoints[6*k+3] = MaxOffset;  CutShapePoints[6*k+4] = MaxOffset + U;  CutShapePoints[6*k+5] = MaxOffset + V;
+		}
 
-		// calculate normal. This is dumb and should come from ray/box intersection code.
-		Vector3d RayHitPos = Ray.PointAt(RayParameterOut);
-		Vector3d BoxCenter = MinHitBox.Center();
-		Vector3d Extents = MinHitBox.Extents();
-		double MaxDist = Extents.Dot(Extents);
-		for (int j = 0; j < 6; ++j)
+		ModelGridCellData_StandardRST_Ext ExtParams;
+		InitializeSubCellFromGridCell(CellInfo, ExtParams);
+		if (Cell.CellType == EModelGridCellType::VariableCutCorner_Parametric)
+		{
+			double dx = ((double)ExtParams.Params.ParamA + 1.0) * SX / NumSteps;
+			double dy = ((double)ExtParams.Params.ParamB + 1.0) * SY / NumSteps;
+			double dz = ((double)ExtParams.Params.ParamC + 1.0) * SZ / NumSteps;
+			CutShapePoints[18] = Vector3d(SX - dx, SY, SZ);
+			CutShapePoints[19] = Vector3d(SX, SY - dy, SZ);
+			CutShapePoints[20] = Vector3d(SX, SY, SZ - dz);
+		}
+		else
 		{
-			Vector3d FaceCenter(BoxCenter), FaceNormal(0,0,0);
-			int Axis = j / 2;
-			double Dir = (j == 0 || j == 2 || j == 4) ? 1.0 : -1.0;
-			FaceCenter[Axis] += Dir * Extents[Axis];
-			FaceNormal[Axis] += Dir;
-			double HitPosDist = GS::Abs((RayHitPos - FaceCenter).Dot(FaceNormal));
-			if (HitPosDist < MaxDist)
+			double dt = ((double)ExtParams.Params.ParamA + 1.0) * SY / NumSteps;
+			double df = ((double)ExtParams.Params.ParamB + 1.0) * SZ / NumSteps;
+			CutShapePoints[18] = Vector3d(0, SY - dt, SZ);
+			CutShapePoints[19] = Vector3d(SX, SY - dt, SZ);
+			CutShapePoints[20] = Vector3d(0, SY, SZ - df);
+		}
+		UnitFacePoints = CutShapePoints;
+		NumFaces = 7;
+	}
+	else if ((int)Cell.CellType < MaxUnitShapeTypes && UnitShapeFacePoints[(int)Cell.CellType].size() > 0)
+	{
+		UnitFacePoints = &UnitShapeFacePoints[(int)Cell.CellType][0];
+		NumFaces = (int)UnitShapeFacePoints[(int)Cell.CellType].size() / 3;
+	}
+	else
+	{
+		// unknown shape, treat as box
+		RayParameterOut = RayTStart;
+		HitNormalOut = EntryNormal;
+		return true;
+	}
+
+	TransformListd TransformSeq;
+	GetUnitCellTransform(CellInfo, CellDims, TransformSeq);
+
+	// transform face points into grid space. The shapes are convex so the average of the face points is inside.
+	constexpr int MaxStackPoints = 64;
+	Vector3d StackPoints[MaxStackPoints];
+	unsafe_vector<Vector3d> HeapPoints;
+	Vector3d* Points = StackPoints;
+	int NumPoints = NumFaces * 3;
+	if (NumPoints > MaxStackPoints)
+	{
+		HeapPoints.resize(NumPoints);
+		Points = &HeapPoints[0];
+	}
+	Vector3d InteriorPoint = Vector3d::Zero();
+	for (int k = 0; k < NumPoints; ++k)
+	{
+		Points[k] = CellMin + TransformSeq.TransformPosition(UnitFacePoints[k]);
+		InteriorPoint += Points[k];
+	}
+	InteriorPoint = InteriorPoint / (double)NumPoints;
+
+	Vector3d HitNormal = EntryNormal;
+	double HitT = RayTStart;
+	if (ClipRayToConvexShape(Ray, Points, NumFaces, InteriorPoint, RayTStart, RayTEnd, HitT, HitNormal) == false)
+		return false;
+
+	RayParameterOut = HitT;
+	HitNormalOut = HitNormal;
+	return true;
+}
+
+
+
+// cells with any part inside Box. Cells that only touch the Box are not included.
+static AxisBox3i GetOverlappedKeyRange(const AxisBox3d& Box, const Vector3d& CellDimensions)
+{
+	Vector3i MinKey, MaxKey;
+	for (int k = 0; k < 3; ++k)
+	{
+		MinKey[k] = (int)GS::Floor(Box.Min[k] / CellDimensions[k]);
+		MaxKey[k] = (int)std::ceil(Box.Max[k] / CellDimensions[k]) - 1;
+	}
+	return AxisBox3i(MinKey, MaxKey);
+}
+
+void ModelGridCollider::EnumerateOccupiedCells(const AxisBox3i& KeyRangeIn, FunctionRef<void(const Vector3i&)> CellFunc) const
+{
+	ReadScope ReadGuard(*this);
+	AxisBox3i ActiveChunksRange = GetActiveChunksRange();
+	if (NumActiveChunks == 0 || ActiveChunksRange.IsValid() == false)
+		return;
+
+	// clip to grid, GetChunkIndexForKey() is not valid outside of it
+	AxisBox3i GridRange = GridConstants.GetCellIndexRange();
+	AxisBox3i KeyRange;
+	for (int k = 0; k < 3; ++k)
+	{
+		KeyRange.Min[k] = GS::Max(KeyRangeIn.Min[k], GridRange.Min[k]);
+		KeyRange.Max[k] = GS::Min(KeyRangeIn.Max[k], GridRange.Max[k]);
+		if (KeyRange.Min[k] > KeyRange.Max[k])
+			return;
+	}
+
+	Vector3i MinChunk = GridConstants.GetChunkIndexForKey(KeyRange.Min);
+	Vector3i MaxChunk = GridConstants.GetChunkIndexForKey(KeyRange.Max);
+	for (int k = 0; k < 3; ++k)
+	{
+		MinChunk[k] = GS::Max(MinChunk[k], ActiveChunksRange.Min[k]);
+		MaxChunk[k] = GS::Min(MaxChunk[k], ActiveChunksRange.Max[k]);
+	}
+
+	for (int bz = MinChunk.Z; bz <= MaxChunk.Z; ++bz)
+	{
+		for (int by = MinChunk.Y; by <= MaxChunk.Y; ++by)
+		{
+			for (int bx = MinChunk.X; bx <= MaxChunk.X; ++bx)
 			{
-				MaxDist = HitPosDist;
-				CellFaceNormal = FaceNormal;
+				const GridChunkCollider* ChunkPtr = GetChunk(Vector3i(bx, by, bz));
+				if (ChunkPtr == nullptr || ChunkPtr->NumOccupiedCells == 0)
+					continue;
+				const GridChunkCollider& Chunk = *ChunkPtr;
+
+				AxisBox3i ChunkKeys = GridConstants.GetKeyRangeForChunk(Chunk.ChunkIndex);
+				Vector3i LocalMin, LocalMax;
+				for (int k = 0; k < 3; ++k)
+				{
+					LocalMin[k] = GS::Max(KeyRange.Min[k], ChunkKeys.Min[k]) - ChunkKeys.Min[k];
+					LocalMax[k] = GS::Min(KeyRange.Max[k], ChunkKeys.Max[k]) - ChunkKeys.Min[k];
+				}
+				uint64_t XMask = (((uint64_t)1 << (LocalMax.X - LocalMin.X + 1)) - 1) << LocalMin.X;
+
+				for (int zi = LocalMin.Z; zi <= LocalMax.Z; ++zi)
+				{
+					for (int yi = LocalMin.Y; yi <= LocalMax.Y; ++yi)
+					{
+						int BitIndex = ToCellBitIndex(Vector3i(0, yi, zi));
+						uint64_t RowCells = (Chunk.OccupiedCellBits[BitIndex >> 6] >> (BitIndex & 63)) & XMask;
+						while (RowCells != 0)
+						{
+							int xi = std::countr_zero(RowCells);
+							RowCells &= (RowCells - 1);
+							CellFunc(ChunkKeys.Min + Vector3i(xi, yi, zi));
+						}
+					}
+				}
 			}
 		}
+	}
+}
+
+
+void ModelGridCollider::FindOverlappingCells(const AxisBox3d& Box, unsafe_vector<Vector3i>& CellKeysOut) const
+{
+	CellKeysOut.clear(false);
+	EnumerateOccupiedCells(GetOverlappedKeyRange(Box, GridConstants.CellDimensions), [&](const Vector3i& CellKey)
+	{
+		CellKeysOut.add(CellKey);
+	});
+}
+
+
+// intersect the open time interval (TEnter,TExit) with the times where Origin + t*Delta is strictly inside the slab (Min,Max)
+// along one axis. Returns false if the interval becomes empty. EntryAxisOut is set to Axis if the slab increases TEnter.
+static bool ClipSweepToSlab(double Origin, double Delta, double Min, double Max, int Axis, double& TEnter, double& TExit, int& EntryAxisOut)
+{
+	if (Delta == 0)
+		return (Origin > Min && Origin < Max);
+	double InvDelta = 1.0 / Delta;
+	double T0 = (Min - Origin) * InvDelta;
+	double T1 = (Max - Origin) * InvDelta;
+	if (T0 > T1) std::swap(T0, T1);
+	if (T0 > TEnter) {
+		TEnter = T0;
+		EntryAxisOut = Axis;
+	}
+	TExit = GS::Min(TExit, T1);
+	return TEnter < TExit;
+}
 
+// intersect the open time interval (TEnter,TExit) with the times where A*t^2 + B*t + C < 0 (A >= 0)
+static bool ClipSweepToQuadratic(double A, double B, double C, double& TEnter, double& TExit)
+{
+	if (A < 1e-20)
+		return (C < 0);		// not moving relative to the shape, either always inside or always outside
+	double Disc = B * B - 4.0 * A * C;
+	if (Disc <= 0)
+		return false;
+	double SqrtDisc = std::sqrt(Disc);
+	TEnter = GS::Max(TEnter, (-B - SqrtDisc) / (2.0 * A));
+	TExit = GS::Min(TExit, (-B + SqrtDisc) / (2.0 * A));
+	return TEnter < TExit;
+}
+
+/**
+ * Find first time in range [0,1] that the point Origin + t*Delta is inside the Box rounded by Radius.
+ * The rounded box is the union of the box expanded by Radius along each axis, the 12 edge cylinders 
+ * and 8 corner spheres, so the first hit is the earliest entry into any of these. 
+ * EntryAxisOut is the axis of the face of the (fully) expanded box that the point enters through.
+ */
+static bool SweepPointVsRoundedBox(const Vector3d& Origin, const Vector3d& Delta, const AxisBox3d& Box, double Radius, double& TOut, int& EntryAxisOut)
+{
+	// test against fully-expanded box first, this is the exact answer if Radius is 0
+	double TEnter = -Mathd::SafeMaxValue(), TExit = Mathd::SafeMaxValue();
+	EntryAxisOut = -1;
+	for (int k = 0; k < 3; ++k)
+	{
+		if (ClipSweepToSlab(Origin[k], Delta[k], Box.Min[k] - Radius, Box.Max[k] + Radius, k, TEnter, TExit, EntryAxisOut) == false)
+			return false;
+	}
+	if (TExit <= 0 || TEnter > 1)
+		return false;
+	if (Radius <= 0)
+	{
+		TOut = GS::Max(TEnter, 0.0);
 		return true;
 	}
 
-	return false;
+	double BestT = Mathd::SafeMaxValue();
+	auto AddInterval = [&](double T0, double T1) {
+		if (T1 > 0 && T0 <= 1)
+			BestT = GS::Min(BestT, GS::Max(T0, 0.0));
+	};
+	int UnusedAxis = -1;
+
+	// box expanded along one axis
+	for (int j = 0; j < 3; ++j)
+	{
+		double T0 = -Mathd::SafeMaxValue(), T1 = Mathd::SafeMaxValue();
+		bool bHit = true;
+		for (int k = 0; k < 3 && bHit; ++k)
+		{
+			double Expand = (k == j) ? Radius : 0;
+			bHit = ClipSweepToSlab(Origin[k], Delta[k], Box.Min[k] - Expand, Box.Max[k] + Expand, k, T0, T1, UnusedAxis);
+		}
+		if (bHit)
+			AddInterval(T0, T1);
+	}
+
+	// edge cylinders, axis k
+	double RadiusSqr = Radius * Radius;
+	for (int k = 0; k < 3; ++k)
+	{
+		int i = (k + 1) % 3, j = (k + 2) % 3;
+		for (int ci = 0; ci < 2; ++ci)
+		{
+			for (int cj = 0; cj < 2; ++cj)
+			{
+				double Oi = Origin[i] - ((ci == 0) ? Box.Min[i] : Box.Max[i]);
+				double Oj = Origin[j] - ((cj == 0) ? Box.Min[j] : Box.Max[j]);
+				double T0 = -Mathd::SafeMaxValue(), T1 = Mathd::SafeMaxValue();
+				if (ClipSweepToQuadratic(Delta[i] * Delta[i] + Delta[j] * Delta[j], 2.0 * (Oi * Delta[i] + Oj * Delta[j]), Oi * Oi + Oj * Oj - RadiusSqr, T0, T1)
+					&& ClipSweepToSlab(Origin[k], Delta[k], Box.Min[k], Box.Max[k], k, T0, T1, UnusedAxis))
+				{
+					AddInterval(T0, T1);
+				}
+			}
+		}
+	}
+
+	// corner spheres
+	for (int Corner = 0; Corner < 8; ++Corner)
+	{
+		Vector3d C( (Corner & 1) ? Box.Max.X : Box.Min.X, (Corner & 2) ? Box.Max.Y : Box.Min.Y, (Corner & 4) ? Box.Max.Z : Box.Min.Z );
+		Vector3d O = Origin - C;
+		double T0 = -Mathd::SafeMaxValue(), T1 = Mathd::SafeMaxValue();
+		if (ClipSweepToQuadratic(Delta.Dot(Delta), 2.0 * O.Dot(Delta), O.Dot(O) - RadiusSqr, T0, T1))
+			AddInterval(T0, T1);
+	}
+
+	if (BestT > 1)
+		return false;
+	TOut = BestT;
+	return true;
+}
+
+
+bool ModelGridCollider::SweepRoundedBox(const Vector3d& Center, const Vector3d& HalfExtents, double Radius, const Vector3d& Delta,
+	double& TimeOfImpactOut, Vector3d& ContactNormalOut, Vector3i& CellKeyOut) const
+{
+	if (NumActiveChunks == 0)
+		return false;
+
+	// all cells that the shape could touch during the sweep
+	Vector3d Extents = HalfExtents + Vector3d(Radius, Radius, Radius);
+	AxisBox3d SweptBounds(Center - Extents, Center + Extents);
+	SweptBounds.Contain(Center + Delta - Extents);
+	SweptBounds.Contain(Center + Delta + Extents);
+
+	bool bHit = false;
+	double BestT = Mathd::SafeMaxValue();
+	int BestEntryAxis = -1;
+	AxisBox3d BestCellBox;
+	EnumerateOccupiedCells(GetOverlappedKeyRange(SweptBounds, GridConstants.CellDimensions), [&](const Vector3i& CellKey)
+	{
+		// sweeping the shape against the cell is equivalent to sweeping the center point against the cell box expanded by the shape
+		AxisBox3d CellBox = GridConstants.GetCellLocalBounds(CellKey);
+		AxisBox3d ExpandedBox(CellBox.Min - HalfExtents, CellBox.Max + HalfExtents);
+		double CellT = 0; int EntryAxis = -1;
+		if (SweepPointVsRoundedBox(Center, Delta, ExpandedBox, Radius, CellT, EntryAxis) && CellT < BestT)
+		{
+			bHit = true;
+			BestT = CellT;
+			BestEntryAxis = EntryAxis;
+			BestCellBox = ExpandedBox;
+			CellKeyOut = CellKey;
+		}
+	});
+	if (!bHit)
+		return false;
+
+	TimeOfImpactOut = BestT;
+
+	// contact normal points from the nearest point on the expanded box to the center
+	Vector3d HitCenter = Center + Delta * BestT;
+	Vector3d NearestPoint( GS::Clamp(HitCenter.X, BestCellBox.Min.X, BestCellBox.Max.X),
+		GS::Clamp(HitCenter.Y, BestCellBox.Min.Y, BestCellBox.Max.Y), GS::Clamp(HitCenter.Z, BestCellBox.Min.Z, BestCellBox.Max.Z) );
+	Vector3d Normal = HitCenter - NearestPoint;
+	double NormalLen = Normal.Length();
+	if (Radius > 0 && NormalLen > Radius * 1e-6)
+		ContactNormalOut = Normal / NormalLen;
+	else if (BestEntryAxis >= 0)
+	{
+		ContactNormalOut = Vector3d::Zero();
+		ContactNormalOut[BestEntryAxis] = (Delta[BestEntryAxis] > 0) ? -1.0 : 1.0;
+	}
+	else
+	{
+		// started inside the cell, push back along sweep direction
+		ContactNormalOut = (Delta.SquaredLength() > 0) ? -Normalized(Delta) : Vector3d::UnitZ();
+	}
+	return true;
+}
+
+
+bool ModelGridCollider::SweepBox(const AxisBox3d& Box, const Vector3d& Delta, double& TimeOfImpactOut, Vector3d& ContactNormalOut, Vector3i& CellKeyOut) const
+{
+	Vector3d HalfExtents = (Box.Max - Box.Min) * 0.5;
+	return SweepRoundedBox(Box.Min + HalfExtents, HalfExtents, 0, Delta, TimeOfImpactOut, ContactNormalOut, CellKeyOut);
+}
+
+
+bool ModelGridCollider::SweepCapsule(const Vector3d& Center, double HalfHeight, double Radius, const Vector3d& Delta,
+	double& TimeOfImpactOut, Vector3d& ContactNormalOut, Vector3i& CellKeyOut) const
+{
+	return SweepRoundedBox(Center, Vector3d(0, 0, HalfHeight), Radius, Delta, TimeOfImpactOut, ContactNormalOut, CellKeyOut);
 }
@@ -0,0 +1,310 @@
+// Copyright Gradientspace Corp. All Rights Reserved.
+#include "ModelGrid/ModelGridCollisionShapes.h"
+#include "ModelGrid/ModelGridMesher.h"
+#include "ModelGrid/ModelGridCell_Extended.h"
+#include "ModelGrid/ModelGridChange.h"
+#include "Core/ParallelFor.h"
+#include "GenericGrid/BoxIndexing.h"
+
+#include <bit>
+
+using namespace GS;
+
+
+void ModelGridCollisionShapeBuilder::Initialize(const ModelGrid& TargetGrid)
+{
+	GridConstants = ModelGridConstants(TargetGrid);
+	Blocks.clear();
+	ModifiedBlocks.clear();
+
+	// vertices of the unit cell shapes, hull is computed downstream by the physics system
+	ModelGridMesher UnitShapes;
+	UnitShapes.Initialize(GridConstants.CellDimensions);
+	auto AddUnitShape = [&](EModelGridCellType CellType, const PolyMesh& UnitMesh)
+	{
+		unsafe_vector<Vector3d>& Vertices = UnitShapeVertices[(int)CellType];
+		Vertices.clear(false);
+		int VertexCount = UnitMesh.GetVertexCount();
+		for (int vid = 0; vid < VertexCount; ++vid)
+			Vertices.add_unique(UnitMesh.GetPosition(vid));
+	};
+	AddUnitShape(EModelGridCellType::Slab_Parametric, UnitShapes.UnitBoxMesh_Poly);
+	AddUnitShape(EModelGridCellType::Ramp_Parametric, UnitShapes.UnitRampMesh_Poly);
+	AddUnitShape(EModelGridCellType::Corner_Parametric, UnitShapes.UnitCornerMesh_Poly);
+	AddUnitShape(EModelGridCellType::Pyramid_Parametric, UnitShapes.UnitPyramidMesh_Poly);
+	AddUnitShape(EModelGridCellType::Peak_Parametric, UnitShapes.UnitPeakMesh_Poly);
+	AddUnitShape(EModelGridCellType::Cylinder_Parametric, UnitShapes.UnitCylinderMesh_Poly);
+	AddUnitShape(EModelGridCellType::CutCorner_Parametric, UnitShapes.UnitCutCornerMesh_Poly);
+}
+
+
+void ModelGridCollisionShapeBuilder::UpdateInBounds(const ModelGrid& TargetGrid, const AxisBox3d& LocalBounds)
+{
+	AxisBox3i ChunkIdxRange = TargetGrid.GetAllocatedChunkRangeBounds(LocalBounds);
+	if (ChunkIdxRange.IsValid() == false) return;
+
+	std::vector<Vector3i> UpdateBlockIndices;
+	for (int zi = ChunkIdxRange.Min.Z; zi <= ChunkIdxRange.Max.Z; zi++)
+		for (int yi = ChunkIdxRange.Min.Y; yi <= ChunkIdxRange.Max.Y; yi++)
+			for (int xi = ChunkIdxRange.Min.X; xi <= ChunkIdxRange.Max.X; xi++)
+				UpdateBlockIndices.push_back(Vector3i(xi, yi, zi));
+
+	UpdateBlocks(TargetGrid, UpdateBlockIndices, nullptr);
+}
+
+
+void ModelGridCollisionShapeBuilder::MarkCellsModified(const std::vector<Vector3i>& ModifiedCellKeys)
+{
+	for (const Vector3i& CellKey : ModifiedCellKeys)
+	{
+		if (GridConstants.IsValidCell(CellKey) == false)
+			continue;
+		ModifiedBlocks.insert(GridConstants.GetChunkIndexForKey(CellKey));
+
+		// hull culling depends on the 6-neighbours, which may be in adjacent blocks
+		for (int j = 0; j < 6; ++j)
+		{
+			Vector3i NbrKey = CellKey + FaceIndexToOffset(j);
+			if (GridConstants.IsValidCell(NbrKey))
+				ModifiedBlocks.insert(GridConstants.GetChunkIndexForKey(NbrKey));
+		}
+	}
+}
+
+void ModelGridCollisionShapeBuilder::MarkChangeModified(const ModelGridDeltaChange& Change)
+{
+	MarkCellsModified(Change.CellKeys);
+}
+
+void ModelGridCollisionShapeBuilder::MarkBlocksModified(const std::vector<Vector3i>& BlockIndices)
+{
+	for (const Vector3i& BlockIndex : BlockIndices)
+		ModifiedBlocks.insert(BlockIndex);
+}
+
+
+void ModelGridCollisionShapeBuilder::UpdateModifiedBlocks(const ModelGrid& TargetGrid, std::vector<Vector3i>* UpdatedBlocksOut)
+{
+	if (ModifiedBlocks.size() == 0) return;
+
+	std::vector<Vector3i> UpdateBlockIndices(ModifiedBlocks.begin(), ModifiedBlocks.end());
+	ModifiedBlocks.clear();
+	UpdateBlocks(TargetGrid, UpdateBlockIndices, UpdatedBlocksOut);
+}
+
+
+void ModelGridCollisionShapeBuilder::UpdateBlocks(const ModelGrid& TargetGrid, const std::vector<Vector3i>& BlockIndices, std::vector<Vector3i>* UpdatedBlocksOut)
+{
+	// build into new BlockShapes in parallel, so that the block map is only modified serially
+	std::vector<std::unique_ptr<BlockShapes>> NewShapes(BlockIndices.size());
+	GS::ParallelFor((uint32_t)BlockIndices.size(), [&](int Index)
+	{
+		const Vector3i& BlockIndex = BlockIndices[Index];
+		if (TargetGrid.IsChunkIndexAllocated(BlockIndex) == false)
+			return;
+
+		std::unique_ptr<BlockShapes> Shapes = std::make_unique<BlockShapes>();
+		Shapes->BlockIndex = BlockIndex;
+		Shapes->BlockBounds = GridConstants.GetChunkBounds(BlockIndex);
+		BuildBlockShapes(TargetGrid, *Shapes);
+		if (Shapes->Boxes.size() > 0 || Shapes->Hulls.size() > 0)
+			NewShapes[Index] = std::move(Shapes);
+	});
+
+	for (size_t k = 0; k < BlockIndices.size(); ++k)
+	{
+		const Vector3i& BlockIndex = BlockIndices[k];
+		auto found_itr = Blocks.find(BlockIndex);
+		bool bExisted = (found_itr != Blocks.end());
+		if (NewShapes[k])
+		{
+			if (bExisted)
+			{
+				NewShapes[k]->ShapesVersion = found_itr->second->ShapesVersion + 1;
+				found_itr->second = std::move(NewShapes[k]);
+			}
+			else
+				Blocks.insert({ BlockIndex, std::move(NewShapes[k]) });
+		}
+		else if (bExisted)
+		{
+			Blocks.erase(found_itr);
+		}
+		else
+			continue;		// was empty and still is
+
+		if (UpdatedBlocksOut)
+			UpdatedBlocksOut->push_back(BlockIndex);
+	}
+}
+
+
+void ModelGridCollisionShapeBuilder::BuildBlockShapes(const ModelGrid& TargetGrid, BlockShapes& Shapes) const
+{
+	constexpr int SizeXY = ModelGrid::BlockSize_XY;
+	constexpr int SizeZ = ModelGrid::BlockSize_Z;
+	static_assert(SizeXY <= 32, "rows of cells must fit in 32 bits");
+
+	// Filled cells of the block, as rows of X bits indexed by [Z][Y]
+	uint32_t Filled[SizeZ][SizeXY];
+	for (int zi = 0; zi < SizeZ; ++zi)
+		for (int yi = 0; yi < SizeXY; ++yi)
+			Filled[zi][yi] = 0;
+
+	AxisBox3i KeyRange = GridConstants.GetKeyRangeForChunk(Shapes.BlockIndex);
+	const Vector3d& CellDims = GridConstants.CellDimensions;
+
+	TargetGrid.EnumerateFilledChunkCells(Shapes.BlockIndex,
+		[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo, const AxisBox3d& LocalBounds)
+	{
+		if (CellInfo.CellType == EModelGridCellType::Filled)
+		{
+			Vector3i LocalIndex = Key - KeyRange.Min;
+			Filled[LocalIndex.Z][LocalIndex.Y] |= (1u << LocalIndex.X);
+			return;
+		}
+
+		// parametric cells that are enclosed by Filled cells cannot be collided with
+		bool bEnclosed = true;
+		for (int j = 0; j < 6 && bEnclosed; ++j)
+			bEnclosed = TargetGrid.IsCellSolid(Key + FaceIndexToOffset(j));
+		if (bEnclosed)
+			return;
+
+		ConvexHullShape Hull;
+		Hull.CellKey = Key;
+		Hull.CellType = CellInfo.CellType;
+		if (GetCellHullVertices(CellInfo, Key, Hull.Vertices))
+			Shapes.Hulls.add_move(std::move(Hull));
+		else
+			Shapes.Boxes.add(LocalBounds);		// unknown shape, use cell box
+	});
+
+	// Greedy box decomposition. Take the first remaining run of cells in the lowest row, grow it along Y
+	// while the next row contains the entire run, and then along Z while every row of the Y-span does.
+	for (int zi = 0; zi < SizeZ; ++zi)
+	{
+		for (int yi = 0; yi < SizeXY; ++yi)
+		{
+			while (Filled[zi][yi] != 0)
+			{
+				uint32_t Row = Filled[zi][yi];
+				int X0 = std::countr_zero(Row);
+				int Width = std::countr_one(Row >> X0);
+				uint32_t RunMask = (Width == 32) ? 0xFFFFFFFFu : (((1u << Width) - 1) << X0);
+
+				int Y1 = yi + 1;
+				while (Y1 < SizeXY && (Filled[zi][Y1] & RunMask) == RunMask)
+					Y1++;
+
+				int Z1 = zi + 1;
+				while (Z1 < SizeZ)
+				{
+					bool bContained = true;
+					for (int yj = yi; yj < Y1 && bContained; ++yj)
+						bContained = (Filled[Z1][yj] & RunMask) == RunMask;
+					if (!bContained) break;
+					Z1++;
+				}
+
+				for (int zj = zi; zj < Z1; ++zj)
+					for (int yj = yi; yj < Y1; ++yj)
+						Filled[zj][yj] &= ~RunMask;
+
+				Vector3i MinKey = KeyRange.Min + Vector3i(X0, yi, zi);
+				Vector3i MaxKey = KeyRange.Min + Vector3i(X0 + Width, Y1, Z1);
+				Shapes.Boxes.add(AxisBox3d((Vector3d)MinKey * CellDims, (Vector3d)MaxKey * CellDims));
+			}
+		}
+	}
+}
+
+
+bool ModelGridCollisionShapeBuilder::GetCellHullVertices(const ModelGridCell& CellInfo, const Vector3i& CellKey, unsafe_vector<Vector3d>& VerticesOut) const
+{
+	const Vector3d& CellDims = GridConstants.CellDimensions;
+	Vector3d CellMin = (Vector3d)CellKey * CellDims;
+
+	// variable-cut shapes are a box with a corner or edge cut off by a plane, see ModelGridMesher::AppendVariableCutCorner/AppendVariableCutEdge
+	constexpr int NumSteps = 16;
+	double SX = CellDims.X, SY = CellDims.Y, SZ = CellDims.Z;
+	Vector3d CutShapeVertices[10];
+	const Vector3d* UnitVertices = nullptr;
+	int NumVertices = 0;
+	if (CellInfo.CellType == EModelGridCellType::VariableCutCorner_Parametric)
+	{
+		ModelGridCellData_StandardRST_Ext ExtParams;
+		InitializeSubCellFromGridCell(CellInfo, ExtParams);
+		double dx = ((double)ExtParams.Params.ParamA + 1.0) * SX / NumSteps;
+		double dy = ((double)ExtParams.Params.ParamB + 1.0) * SY / NumSteps;
+		double dz = ((double)ExtParams.Params.ParamC + 1.0) * SZ / NumSteps;
+		// box corners except (SX,SY,SZ), plus the three cut points
+		for (int k = 0; k < 7; ++k)
+			CutShapeVertices[k] = Vector3d((k & 1) ? SX : 0, (k & 2) ? SY : 0, (k & 4) ? SZ : 0);
+		CutShapeVertices[7] = Vector3d(SX - dx, SY, SZ);
+		CutShapeVertices[8] = Vector3d(SX, SY - dy, SZ);
+		CutShapeVertices[9] = Vector3d(SX, SY, SZ - dz);
+		UnitVertices = CutShapeVertices;
+		NumVertices = 10;
+	}
+	else if (CellInfo.CellType == EModelGridCellType::VariableCutEdge_Parametric)
+	{
+		ModelGridCellData_StandardRST_Ext ExtParams;
+		InitializeSubCellFromGridCell(CellInfo, ExtParams);
+		double dt = ((double)ExtParams.Params.ParamA + 1.0) * SY / NumSteps;
+		double df = ((double)ExtParams.Params.ParamB + 1.0) * SZ / NumSteps;
+		// box corners except the edge at (Y=SY,Z=SZ), plus the four cut points
+		for (int k = 0; k < 6; ++k)
+			CutShapeVertices[k] = Vector3d((k & 1) ? SX : 0, (k & 2) ? SY : 0, (k & 4) ? SZ : 0);
+		CutShapeVertices[6] = Vector3d(0, SY - dt, SZ);
+		CutShapeVertices[7] = Vector3d(SX, SY - dt, SZ);
+		CutShapeVertices[8] = Vector3d(0, SY, SZ - df);
+		CutShapeVertices[9] = Vector3d(SX, SY, SZ - df);
+		UnitVertices = CutShapeVertices;
+		NumVertices = 10;
+	}
+	else if ((int)CellInfo.CellType < MaxUnitShapeTypes && UnitShapeVertices[(int)CellInfo.CellType].size() > 0)
+	{
+		UnitVertices = &UnitShapeVertices[(int)CellInfo.CellType][0];
+		NumVertices = (int)UnitShapeVertices[(int)CellInfo.CellType].size();
+	}
+	else
+		return false;
+
+	TransformListd TransformSeq;
+	GetUnitCellTransform(CellInfo, CellDims, TransformSeq);
+
+	VerticesOut.resize(NumVertices);
+	for (int k = 0; k < NumVertices; ++k)
+		VerticesOut[k] = CellMin + TransformSeq.TransformPosition(UnitVertices[k]);
+	return true;
+}
+
+
+const ModelGridCollisionShapeBuilder::BlockShapes* ModelGridCollisionShapeBuilder::GetBlockShapes(const Vector3i& BlockIndex) const
+{
+	auto found_itr = Blocks.find(BlockIndex);
+	return (found_itr != Blocks.end()) ? found_itr->second.get() : nullptr;
+}
+
+void ModelGridCollisionShapeBuilder::EnumerateBlockShapes(FunctionRef<void(const BlockShapes&)> BlockFunc) const
+{
+	for (const auto& Pair : Blocks)
+		BlockFunc(*Pair.second);
+}
+
+int64_t ModelGridCollisionShapeBuilder::GetTotalBoxCount() const
+{
+	int64_t Count = 0;
+	for (const auto& Pair : Blocks)
+		Count += (int64_t)Pair.second->Boxes.size();
+	return Count;
+}
+
+int64_t ModelGridCollisionShapeBuilder::GetTotalHullCount() const
+{
+	int64_t Count = 0;
+	for (const auto& Pair : Blocks)
+		Count += (int64_t)Pair.second->Hulls.size();
+	return Count;
+}
@@ -0,0 +1,311 @@
+// Copyright Gradientspace Corp. All Rights Reserved.
+#include "ModelGrid/ModelGridDistanceField.h"
+#include "ModelGrid/ModelGridChange.h"
+#include "Core/ParallelFor.h"
+#include "Core/unsafe_vector.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace GS;
+
+
+void ModelGridDistanceField::Initialize(const ModelGrid& TargetGrid)
+{
+	GridConstants = ModelGridConstants(TargetGrid);
+	Blocks.clear();
+	ModifiedBlocks.clear();
+
+	// apron can only extend into the 26 neighbour blocks
+	ApronCells = GS::Clamp(MaxDistanceCells, 1, GS::Min(ModelGrid::BlockSize_XY, ModelGrid::BlockSize_Z));
+	const Vector3d& CellDims = GridConstants.CellDimensions;
+	MaxDistance = (double)ApronCells * GS::Min(CellDims.X, GS::Min(CellDims.Y, CellDims.Z));
+}
+
+
+void ModelGridDistanceField::UpdateInBounds(const ModelGrid& TargetGrid, const AxisBox3d& LocalBounds)
+{
+	AxisBox3i ChunkIdxRange = TargetGrid.GetAllocatedChunkRangeBounds(LocalBounds);
+	if (ChunkIdxRange.IsValid() == false) return;
+
+	// allocated blocks and their neighbours, as distances extend into empty blocks
+	AxisBox3i ValidChunks(GridConstants.GetChunkIndexForKey(GridConstants.GetCellIndexRange().Min),
+		GridConstants.GetChunkIndexForKey(GridConstants.GetCellIndexRange().Max));
+	std::unordered_set<Vector3i> UpdateSet;
+	for (int zi = ChunkIdxRange.Min.Z; zi <= ChunkIdxRange.Max.Z; zi++)
+	{
+		for (int yi = ChunkIdxRange.Min.Y; yi <= ChunkIdxRange.Max.Y; yi++)
+		{
+			for (int xi = ChunkIdxRange.Min.X; xi <= ChunkIdxRange.Max.X; xi++)
+			{
+				Vector3i ChunkIndex(xi, yi, zi);
+				if (TargetGrid.IsChunkIndexAllocated(ChunkIndex) == false)
+					continue;
+				for (int dz = -1; dz <= 1; ++dz)
+					for (int dy = -1; dy <= 1; ++dy)
+						for (int dx = -1; dx <= 1; ++dx)
+						{
+							Vector3i NbrIndex = ChunkIndex + Vector3i(dx, dy, dz);
+							if (ValidChunks.Contains(NbrIndex))
+								UpdateSet.insert(NbrIndex);
+						}
+			}
+		}
+	}
+
+	UpdateBlocks(TargetGrid, std::vector<Vector3i>(UpdateSet.begin(), UpdateSet.end()));
+}
+
+
+void ModelGridDistanceField::MarkCellsModified(const std::vector<Vector3i>& ModifiedCellKeys)
+{
+	// all blocks with the modified cell in their apron
+	AxisBox3i CellRange = GridConstants.GetCellIndexRange();
+	Vector3i Apron(ApronCells, ApronCells, ApronCells);
+	for (const Vector3i& CellKey : ModifiedCellKeys)
+	{
+		Vector3i MinKey = CellKey - Apron, MaxKey = CellKey + Apron;
+		for (int k = 0; k < 3; ++k)
+		{
+			MinKey[k] = GS::Clamp(MinKey[k], CellRange.Min[k], CellRange.Max[k]);
+			MaxKey[k] = GS::Clamp(MaxKey[k], CellRange.Min[k], CellRange.Max[k]);
+		}
+		Vector3i MinChunk = GridConstants.GetChunkIndexForKey(MinKey);
+		Vector3i MaxChunk = GridConstants.GetChunkIndexForKey(MaxKey);
+		for (int zi = MinChunk.Z; zi <= MaxChunk.Z; zi++)
+			for (int yi = MinChunk.Y; yi <= MaxChunk.Y; yi++)
+				for (int xi = MinChunk.X; xi <= MaxChunk.X; xi++)
+					ModifiedBlocks.insert(Vector3i(xi, yi, zi));
+	}
+}
+
+void ModelGridDistanceField::MarkChangeModified(const ModelGridDeltaChange& Change)
+{
+	MarkCellsModified(Change.CellKeys);
+}
+
+void ModelGridDistanceField::UpdateModifiedBlocks(const ModelGrid& TargetGrid)
+{
+	if (ModifiedBlocks.size() == 0) return;
+
+	std::vector<Vector3i> UpdateBlockIndices(ModifiedBlocks.begin(), ModifiedBlocks.end());
+	ModifiedBlocks.clear();
+	UpdateBlocks(TargetGrid, UpdateBlockIndices);
+}
+
+
+void ModelGridDistanceField::UpdateBlocks(const ModelGrid& TargetGrid, const std::vector<Vector3i>& BlockIndices)
+{
+	std::vector<std::unique_ptr<BlockDistances>> NewBlocks(BlockIndices.size());
+	GS::ParallelFor((uint32_t)BlockIndices.size(), [&](int Index)
+	{
+		std::unique_ptr<BlockDistances> NewBlock = std::make_unique<BlockDistances>();
+		NewBlock->BlockIndex = BlockIndices[Index];
+		if (ComputeBlockDistances(TargetGrid, *NewBlock))
+			NewBlocks[Index] = std::move(NewBlock);
+	});
+
+	for (size_t k = 0; k < BlockIndices.size(); ++k)
+	{
+		if (NewBlocks[k])
+			Blocks[BlockIndices[k]] = std::move(NewBlocks[k]);
+		else
+			Blocks.erase(BlockIndices[k]);
+	}
+}
+
+
+// 1D squared Euclidean distance transform of the sampled function F (Felzenszwalb & Huttenlocher 2012), with samples
+// spaced Spacing apart. Infinite values of F are skipped. V and Z are scratch buffers of size N and N+1.
+static void DistanceTransform1D(const double* F, double* DOut, int N, double Spacing, int* V, double* Z)
+{
+	constexpr double Infinity = std::numeric_limits<double>::infinity();
+	double W2 = Spacing * Spacing;
+	int k = -1;
+	for (int q = 0; q < N; ++q)
+	{
+		if (F[q] == Infinity) continue;
+		if (k < 0)
+		{
+			k = 0; V[0] = q; Z[0] = -Infinity; Z[1] = Infinity;
+			continue;
+		}
+		// intersection of parabolas at q and V[k]. Terminates at k == 0 as Z[0] is -Infinity.
+		auto Intersect = [&](int vk) { return ((F[q] + W2 * q * q) - (F[vk] + W2 * vk * vk)) / (2.0 * W2 * (q - vk)); };
+		double s = Intersect(V[k]);
+		while (s <= Z[k])
+		{
+			k--;
+			s = Intersect(V[k]);
+		}
+		k++;
+		V[k] = q; Z[k] = s; Z[k + 1] = Infinity;
+	}
+
+	if (k < 0)
+	{
+		for (int q = 0; q < N; ++q)
+			DOut[q] = Infinity;
+		return;
+	}
+	k = 0;
+	for (int q = 0; q < N; ++q)
+	{
+		while (Z[k + 1] < q) k++;
+		double dq = (double)(q - V[k]);
+		DOut[q] = W2 * dq * dq + F[V[k]];
+	}
+}
+
+// Separable 3D squared distance transform of Values in-place. Values has dimensions Dims, X fastest. The X pass covers the
+// whole domain, the Y pass only the X-range [InnerMin.X,InnerMax.X), and the Z pass only the inner XY range, as only
+// the inner part of the domain is needed in the result.
+static void DistanceTransform3D(unsafe_vector<double>& Values, const Vector3i& Dims, const Vector3d& CellDims, const Vector3i& InnerMin, const Vector3i& InnerMax)
+{
+	int MaxDim = GS::Max(Dims.X, GS::Max(Dims.Y, Dims.Z));
+	unsafe_vector<double> F, D, Z;
+	unsafe_vector<int> V;
+	F.resize(MaxDim); D.resize(MaxDim); Z.resize(MaxDim + 1); V.resize(MaxDim);
+	auto Index = [&](int x, int y, int z) { return (size_t)x + (size_t)Dims.X * ((size_t)y + (size_t)Dims.Y * (size_t)z); };
+
+	for (int z = 0; z < Dims.Z; ++z)
+		for (int y = 0; y < Dims.Y; ++y)
+		{
+			for (int x = 0; x < Dims.X; ++x) F[x] = Values[Index(x, y, z)];
+			DistanceTransform1D(&F[0], &D[0], Dims.X, CellDims.X, &V[0], &Z[0]);
+			for (int x = 0; x < Dims.X; ++x) Values[Index(x, y, z)] = D[x];
+		}
+	for (int z = 0; z < Dims.Z; ++z)
+		for (int x = InnerMin.X; x < InnerMax.X; ++x)
+		{
+			for (int y = 0; y < Dims.Y; ++y) F[y] = Values[Index(x, y, z)];
+			DistanceTransform1D(&F[0], &D[0], Dims.Y, CellDims.Y, &V[0], &Z[0]);
+			for (int y = 0; y < Dims.Y; ++y) Values[Index(x, y, z)] = D[y];
+		}
+	for (int y = InnerMin.Y; y < InnerMax.Y; ++y)
+		for (int x = InnerMin.X; x < InnerMax.X; ++x)
+		{
+			for (int z = 0; z < Dims.Z; ++z) F[z] = Values[Index(x, y, z)];
+			DistanceTransform1D(&F[0], &D[0], Dims.Z, CellDims.Z, &V[0], &Z[0]);
+			for (int z = 0; z < Dims.Z; ++z) Values[Index(x, y, z)] = D[z];
+		}
+}
+
+
+bool ModelGridDistanceField::ComputeBlockDistances(const ModelGrid& TargetGrid, BlockDistances& Block) const
+{
+	constexpr int SizeXY = ModelGrid::BlockSize_XY;
+	constexpr int SizeZ = ModelGrid::BlockSize_Z;
+	constexpr double Infinity = std::numeric_limits<double>::infinity();
+	const int A = ApronCells;
+	Vector3i Dims(SizeXY + 2 * A, SizeXY + 2 * A, SizeZ + 2 * A);
+	Vector3i InnerMin(A, A, A), InnerMax(A + SizeXY, A + SizeXY, A + SizeZ);
+	auto Index = [&](int x, int y, int z) { return (size_t)x + (size_t)Dims.X * ((size_t)y + (size_t)Dims.Y * (size_t)z); };
+
+	// solid cells of the block and the apron
+	AxisBox3i KeyRange = GridConstants.GetKeyRangeForChunk(Block.BlockIndex);
+	Vector3i DomainMin = KeyRange.Min - InnerMin;
+	unsafe_vector<uint8_t> Solid;
+	Solid.resize((size_t)Dims.X * Dims.Y * Dims.Z);
+	int NumSolid = 0;
+	for (int z = 0; z < Dims.Z; ++z)
+		for (int y = 0; y < Dims.Y; ++y)
+			for (int x = 0; x < Dims.X; ++x)
+			{
+				bool bInner = (x >= InnerMin.X && x < InnerMax.X && y >= InnerMin.Y && y < InnerMax.Y && z >= InnerMin.Z && z < InnerMax.Z);
+				bool bSolid = false;
+				if (!bInner)
+				{
+					bool bIsInGrid = false;
+					ModelGridCell CellInfo = TargetGrid.GetCellInfo(DomainMin + Vector3i(x, y, z), bIsInGrid);
+					bSolid = bIsInGrid && CellInfo.CellType != EModelGridCellType::Empty;
+				}
+				Solid[Index(x, y, z)] = bSolid ? 1 : 0;
+				NumSolid += bSolid ? 1 : 0;
+			}
+	if (TargetGrid.IsChunkIndexAllocated(Block.BlockIndex))
+	{
+		TargetGrid.EnumerateFilledChunkCells(Block.BlockIndex,
+			[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo, const AxisBox3d& LocalBounds)
+		{
+			Vector3i DomainIndex = Key - DomainMin;
+			Solid[Index(DomainIndex.X, DomainIndex.Y, DomainIndex.Z)] = 1;
+			NumSolid++;
+		});
+	}
+	if (NumSolid == 0)
+		return false;
+
+	// squared distance from each cell center to the nearest solid cell center, and to the nearest empty cell center
+	size_t NumDomainCells = Solid.size();
+	unsafe_vector<double> OutsideDist, InsideDist;
+	OutsideDist.resize(NumDomainCells);
+	InsideDist.resize(NumDomainCells);
+	for (size_t k = 0; k < NumDomainCells; ++k)
+	{
+		OutsideDist[k] = (Solid[k] != 0) ? 0.0 : Infinity;
+		InsideDist[k] = (Solid[k] != 0) ? Infinity : 0.0;
+	}
+	const Vector3d& CellDims = GridConstants.CellDimensions;
+	DistanceTransform3D(OutsideDist, Dims, CellDims, InnerMin, InnerMax);
+	if ((int)NumDomainCells != NumSolid)
+		DistanceTransform3D(InsideDist, Dims, CellDims, InnerMin, InnerMax);
+
+	double HalfCell = 0.5 * GS::Min(CellDims.X, GS::Min(CellDims.Y, CellDims.Z));
+	for (int z = 0; z < SizeZ; ++z)
+		for (int y = 0; y < SizeXY; ++y)
+			for (int x = 0; x < SizeXY; ++x)
+			{
+				size_t k = Index(x + A, y + A, z + A);
+				double Distance = (Solid[k] != 0) ? -(std::sqrt(InsideDist[k]) - HalfCell) : (std::sqrt(OutsideDist[k]) - HalfCell);
+				Block.Distances[x + SizeXY * (y + SizeXY * z)] = (float)GS::Clamp(Distance, -MaxDistance, MaxDistance);
+			}
+	return true;
+}
+
+
+double ModelGridDistanceField::GetCellDistance(const Vector3i& CellKey) const
+{
+	if (GridConstants.IsValidCell(CellKey) == false)
+		return MaxDistance;
+	Vector3i BlockIndex, LocalIndex;
+	GridConstants.ToGlobalLocal(CellKey, BlockIndex, LocalIndex);
+	auto found_itr = Blocks.find(BlockIndex);
+	if (found_itr == Blocks.end())
+		return MaxDistance;
+	return (double)found_itr->second->Distances[LocalIndex.X + ModelGrid::BlockSize_XY * (LocalIndex.Y + ModelGrid::BlockSize_XY * LocalIndex.Z)];
+}
+
+
+double ModelGridDistanceField::SampleDistance(const Vector3d& LocalPosition) const
+{
+	// continuous cell-center coordinates
+	const Vector3d& CellDims = GridConstants.CellDimensions;
+	Vector3d U(LocalPosition.X / CellDims.X - 0.5, LocalPosition.Y / CellDims.Y - 0.5, LocalPosition.Z / CellDims.Z - 0.5);
+	Vector3i Key0((int)GS::Floor(U.X), (int)GS::Floor(U.Y), (int)GS::Floor(U.Z));
+	Vector3d T(U.X - (double)Key0.X, U.Y - (double)Key0.Y, U.Z - (double)Key0.Z);
+
+	double Result = 0;
+	for (int k = 0; k < 8; ++k)
+	{
+		Vector3i Offset(k & 1, (k >> 1) & 1, (k >> 2) & 1);
+		double Weight = ((Offset.X) ? T.X : 1.0 - T.X) * ((Offset.Y) ? T.Y : 1.0 - T.Y) * ((Offset.Z) ? T.Z : 1.0 - T.Z);
+		if (Weight != 0)
+			Result += Weight * GetCellDistance(Key0 + Offset);
+	}
+	return Result;
+}
+
+
+Vector3d ModelGridDistanceField::SampleGradient(const Vector3d& LocalPosition) const
+{
+	Vector3d Gradient;
+	for (int k = 0; k < 3; ++k)
+	{
+		double h = 0.5 * GridConstants.CellDimensions[k];
+		Vector3d Delta = Vector3d::Zero();
+		Delta[k] = h;
+		Gradient[k] = (SampleDistance(LocalPosition + Delta) - SampleDistance(LocalPosition - Delta)) / (2.0 * h);
+	}
+	return Gradient;
+}
@@ -79,8 +79,8 @@ static void ApplyRegionFillModeTo2DSelection(ModelGridCellEditSet& SelectedCells
 	if (NumCells == 0 || FillMode == ModelGridEditMachine::ERegionFillMode::All)
 		return;
 
-	// this is O(N^2) and maybe could be faster? could at least sort?
-	// (but lists are generally small...)
+	ModelGridCellBitSet SelectedCellBits;
+	SelectedCells.AddToCellBitSet(SelectedCellBits);
 
 	const Vector3i* Nbrs = GS::GetGrid8NeighbourOffsetsPerpToAxis(PlaneAxisIndex);
 	ModelGridCellEditSet NewCellSet;
@@ -92,7 +92,7 @@ static void ApplyRegionFillModeTo2DSelection(ModelGridCellEditSet& SelectedCells
 		for (int j = 0; j < 8; ++j)
 		{
 			Vector3i NbrIdx = Idx + Nbrs[j];
-			if ( SelectedCells.ContainsCell(NbrIdx) )
+			if ( SelectedCellBits.Contains(NbrIdx) )
 				NbrCount++;
 			else
 				break;
@@ -110,6 +110,7 @@ static void ApplyRegionFillModeTo2DSelection(ModelGridCellEditSet& SelectedCells
 
 ModelGridEditMachine::~ModelGridEditMachine()
 {
+	CancelPreviewOfCellEdit(true);
 	TargetGrid = nullptr;
 	CurrentEditor.release();
 }
@@ -132,14 +133,13 @@ bool ModelGridEditMachine::IsTrackingChange() const
 
 void ModelGridEditMachine::ReapplyChange(const ModelGridDeltaChange& Change, bool bRevert)
 {
+	CancelPreviewOfCellEdit(true);
 	CurrentEditor->ReapplyChange(Change, bRevert);
 
 	if (Change.ChangeBounds != AxisBox3i::Empty())
 	{
 		GridChangeInfo ChangeInfo;
-		ChangeInfo.bModified = true;
-		ChangeInfo.ModifiedRegion.Contain(Change.ChangeBounds.Min);
-		ChangeInfo.ModifiedRegion.Contain(Change.ChangeBounds.Max);
+		ChangeInfo.AppendChangedCells(*TargetGrid, Change.CellKeys);
 
 		CurrentAccumChange.AppendChange(ChangeInfo);
 		ExternalIncrementalChange.AppendChange(ChangeInfo);
@@ -151,9 +151,34 @@ void ModelGridEditMachine::ReapplyChange(const ModelGridDeltaChange& Change, boo
 	}
 }
 
+std::unique_ptr<ModelGridCompactDeltaChange> ModelGridEditMachine::EndTrackedCompactChange()
+{
+	return CurrentEditor->EndCompactChange();
+}
+
+void ModelGridEditMachine::ReapplyChange(const ModelGridCompactDeltaChange& Change, bool bRevert)
+{
+	CancelPreviewOfCellEdit(true);
+	CurrentEditor->ReapplyChange(Change, bRevert);
+
+	if (Change.ChangeBounds != AxisBox3i::Empty())
+	{
+		std::vector<Vector3i> ChangeBlocks;
+		Change.AppendAffectedBlocks(*TargetGrid, ChangeBlocks);
+		GridChangeInfo ChangeInfo;
+		ChangeInfo.AppendChange(Change.ChangeBounds, ChangeBlocks);
+
+		CurrentAccumChange.AppendChange(ChangeInfo);
+		ExternalIncrementalChange.AppendChange(ChangeInfo);
+		OnGridModifiedCallback();
+	}
+}
+
 
 void ModelGridEditMachine::ApplySingleCellUpdate(ModelGrid::CellKey Cell, const ModelGridCell& NewCell)
 {
+	CancelPreviewOfCellEdit(true);
+
 	// this isn't super-efficient but this function should not be getting called that often...
 	ModelGridCellEditSet EditSet;
 	EditSet.AppendCell(Cell);
@@ -161,19 +186,18 @@ void ModelGridEditMachine::ApplySingleCellUpdate(ModelGrid::CellKey Cell, const
 		EditSet.AppendMirroredCells(MirrorXState, MirrorYState, true);
 	}
 
-	GridChangeInfo ChangeInfo;
-	ChangeInfo.bModified = false;
+	std::vector<Vector3i> UpdatedCells;
 	for (const ModelGridCellEditSet::EditCell& EditCellInfo : EditSet.Cells)
 	{
 		ModelGridCell SetCell = NewCell;
 		if (EditCellInfo.bFlipX || EditCellInfo.bFlipY)
 			GS::ApplyFlipToCell(SetCell, EditCellInfo.bFlipX, EditCellInfo.bFlipY, false);
 
-		if (CurrentEditor->UpdateCell(EditCellInfo.CellIndex, SetCell)) {
-			ChangeInfo.ModifiedRegion.Contain((Vector3i)EditCellInfo.CellIndex);
-			ChangeInfo.bModified = true;
-		}
+		if (CurrentEditor->UpdateCell(EditCellInfo.CellIndex, SetCell))
+			UpdatedCells.push_back(EditCellInfo.CellIndex);
 	}
+	GridChangeInfo ChangeInfo;
+	ChangeInfo.AppendChangedCells(*TargetGrid, UpdatedCells);
 	if (!ChangeInfo.bModified)
 		return;
 
@@ -192,6 +216,7 @@ void ModelGridEditMachine::SetCurrentGrid(ModelGrid& Grid)
 }
 void ModelGridEditMachine::Initialize(ModelGrid& Grid)
 {
+	CancelPreviewOfCellEdit(true);
 	TargetGrid = &Grid;
 	CurrentEditor = std::make_unique<ModelGridEditor>(*TargetGrid);
 
@@ -204,6 +229,8 @@ void ModelGridEditMachine::Initialize(ModelGrid& Grid)
 
 void ModelGridEditMachine::SetCurrentDrawCellType(EModelGridCellType CellType)
 {
+	if (CellType != CurrentDrawCellType)
+		bHaveAppliedParametricEdit = false;
 	CurrentDrawCellType = CellType;
 }
 
@@ -237,32 +264,44 @@ void ModelGridEditMachine::UpdateDrawCellDefaultsForType(const ModelGridCell& Ce
 	if (nIndex < 0 || nIndex >= LastCellTypeCache.size())
 		return;
 
+	if (LastCellTypeCache[nIndex] != Cell)
+		bHaveAppliedParametricEdit = false;
 	LastCellTypeCache[nIndex] = Cell;
 }
 
 
 void ModelGridEditMachine::SetCurrentMaterialMode(EMaterialMode MaterialMode)
 {
+	if (MaterialMode != CurrentMaterialMode)
+		bHaveAppliedParametricEdit = false;
 	CurrentMaterialMode = MaterialMode;
 }
 
 void ModelGridEditMachine::SetCurrentPrimaryColor(Color3b Color)
 {
+	if (Color != CurrentPrimaryColor)
+		bHaveAppliedParametricEdit = false;
 	CurrentPrimaryColor = Color;
 }
 
 void ModelGridEditMachine::SetCurrentSecondaryColor(Color3b Color)
 {
+	if (Color != CurrentSecondaryColor)
+		bHaveAppliedParametricEdit = false;
 	CurrentSecondaryColor = Color;
 }
 
 void ModelGridEditMachine::SetCurrentMaterialIndex(uint32_t Index)
 {
+	if (Index != CurrentMaterialIndex)
+		bHaveAppliedParametricEdit = false;
 	CurrentMaterialIndex = Index;
 }
 
 void ModelGridEditMachine::SetPaintWithSecondaryColor(bool bEnable)
 {
+	if (bEnable != bPaintWithSecondaryColor)
+		bHaveAppliedParametricEdit = false;
 	bPaintWithSecondaryColor = bEnable;
 }
 
@@ -274,16 +313,22 @@ void ModelGridEditMachine::SetCurrentBrushParameters(double Extent, EBrushShape
 
 void ModelGridEditMachine::SetCurrentSculptMode(ESculptMode NewMode)
 {
+	if (NewMode != CurrentSculptMode)
+		bHaveAppliedParametricEdit = false;
 	CurrentSculptMode = NewMode;
 }
 
 void ModelGridEditMachine::SetCurrentColorModifier(IGridColorModifier* ColorModifier)
 {
+	if (ColorModifier != CurrentColorModifier)
+		bHaveAppliedParametricEdit = false;
 	CurrentColorModifier = ColorModifier;
 }
 
 void ModelGridEditMachine::ClearCurrentColorModifier()
 {
+	if (CurrentColorModifier != nullptr)
+		bHaveAppliedParametricEdit = false;
 	CurrentColorModifier = nullptr;
 }
 
@@ -300,18 +345,31 @@ void ModelGridEditMachine::SetActiveDrawPlaneNormal(Vector3d LocalNormal)
 	else if (AxisDots.Y > AxisDots.X && AxisDots.Y > AxisDots.Z)
 		MaxAxisIndex = 1;
 
-	this->CurrentDrawPlaneNormal = Vector3i::Zero();
-	CurrentDrawPlaneNormal[MaxAxisIndex] = (GS::Sign(LocalNormal[MaxAxisIndex]) >= 0) ? 1 : -1;
+	Vector3i NewDrawPlaneNormal = Vector3i::Zero();
+	NewDrawPlaneNormal[MaxAxisIndex] = (GS::Sign(LocalNormal[MaxAxisIndex]) >= 0) ? 1 : -1;
+	if (NewDrawPlaneNormal != CurrentDrawPlaneNormal)
+	{
+		bHaveParametricFirstLayerCells = false;
+		bHaveAppliedParametricEdit = false;
+	}
+	this->CurrentDrawPlaneNormal = NewDrawPlaneNormal;
 	this->CurrentDrawPlaneAxisIndex = MaxAxisIndex;
 }
 
 void ModelGridEditMachine::SetEnableAutoOrientPlacedBlocksToView(bool bEnable)
 {
+	if (bEnable != bAutoOrientPlacedBlocksToCamera)
+		bHaveAppliedParametricEdit = false;
 	bAutoOrientPlacedBlocksToCamera = bEnable;
 }
 
 void ModelGridEditMachine::SetFillLayerSettings(ERegionFillMode FillMode, ERegionFillOperation FillOp, ERegionFillFilter FillFilter)
 {
+	if (FillMode != FillLayer_FillMode || FillOp != FillLayer_OpMode || FillFilter != FillLayer_Filter)
+	{
+		bHaveParametricFirstLayerCells = false;
+		bHaveAppliedParametricEdit = false;
+	}
 	FillLayer_FillMode = FillMode;
 	FillLayer_OpMode = FillOp;
 	FillLayer_Filter = FillFilter;
@@ -319,6 +377,8 @@ void ModelGridEditMachine::SetFillLayerSettings(ERegionFillMode FillMode, ERegio
 
 void ModelGridEditMachine::SetSymmetryState(const ModelGridAxisMirrorInfo& MirrorX, const ModelGridAxisMirrorInfo& MirrorY)
 {
+	if (MirrorX != MirrorXState || MirrorY != MirrorYState)
+		bHaveAppliedParametricEdit = false;
 	MirrorXState = MirrorX;
 	MirrorYState = MirrorY;
 }
@@ -338,6 +398,8 @@ void ModelGridEditMachine::ClearCurrentCameraFrame()
 void ModelGridEditMachine::SetInitialCellCursor(ModelGrid::CellKey Key, const Vector3d& LocalPosition, const Vector3d& LocalNormal)
 {
 	InitialCursor = CellCursorState{ Key,LocalPosition, LocalNormal };
+	bHaveParametricFirstLayerCells = false;
+	bHaveAppliedParametricEdit = false;
 }
 
 void ModelGridEditMachine::UpdateCellCursor(ModelGrid::CellKey Key)
@@ -348,24 +410,22 @@ void ModelGridEditMachine::UpdateCellCursor(ModelGrid::CellKey Key)
 
 void ModelGridEditMachine::UpdateCellCursor(ModelGrid::CellKey Key, const Vector3d& LocalPosition, const Vector3d& LocalNormal)
 {
+	if (IsInCurrentInteraction())
+		CancelPreviewOfCellEdit(true);
 	CurrentCursor = CellCursorState{ Key,LocalPosition, LocalNormal };
 
 	// in a parametric edit, we want to give the effect of a live-update by reverting the previous change
 	// (todo: is this the right way? what if we just had a fully separate grid, like a delta-grid, and the meshing takes both into account?)
+	// In incremental mode, only the cells that differ from the previous update are reverted, after the new edit cells are computed below
+	bool bIncrementalParametricUpdate = false;
 	if (IsCurrentInteractionParametric())
 	{
-		if (IsTrackingChange()) {
-			GS::AxisBox3i ModifiedRegion = CurrentEditor->RevertInProgressChange();
-			if (ModifiedRegion.VolumeCount() > 0) {
-				//CurrentAccumChange.AppendChange(ModifiedRegion);   // don't need this as we must have already included it to revert it
-				ExternalIncrementalChange.AppendChange(ModifiedRegion);
-				// TODO: this will get called twice most of the time, because ProcessCurrentEditCells functions will do it.
-				// But not *all* of the time because (eg) we might revert something but then not change anything.
-				// Should figure out a better way to do this, eg maybe a different signal based on 
-				// the state of ExternalIncrementalChange...
-				OnGridModifiedCallback();
-			}
-		}
+		bIncrementalParametricUpdate = IsTrackingChange() && bEnableIncrementalParametricEdits 
+			&& bHaveAppliedParametricEdit && CanUpdateParametricEditIncrementally();
+		bHaveAppliedParametricEdit = false;
+
+		if (IsTrackingChange() && bIncrementalParametricUpdate == false)
+			RevertFullParametricEdit();
 	}
 
 
@@ -395,6 +455,17 @@ void ModelGridEditMachine::UpdateCellCursor(ModelGrid::CellKey Key, const Vector
 	if (MirrorXState.bMirror || MirrorYState.bMirror)
 		CurrentEditCellSet.AppendMirroredCells(MirrorXState, MirrorYState, true);
 
+	if (IsCurrentInteractionParametric() && IsTrackingChange() && bEnableIncrementalParametricEdits && bImmediateProcessCells)
+	{
+		if (bIncrementalParametricUpdate == false || RevertStaleParametricEditCells() == false)
+		{
+			if (bIncrementalParametricUpdate)
+				RevertFullParametricEdit();
+			AppliedParametricEditCells = CurrentEditCellSet;
+		}
+		bHaveAppliedParametricEdit = true;
+	}
+
 	if (bImmediateProcessCells)
 	{
 		ProcessCurrentEditCells();
@@ -402,12 +473,121 @@ void ModelGridEditMachine::UpdateCellCursor(ModelGrid::CellKey Key, const Vector
 }
 
 
+void ModelGridEditMachine::RevertFullParametricEdit()
+{
+	std::vector<Vector3i> ModifiedBlocks;
+	GS::AxisBox3i ModifiedRegion = CurrentEditor->RevertInProgressChange(&ModifiedBlocks);
+	if (ModifiedRegion.VolumeCount() > 0) {
+		//CurrentAccumChange.AppendChange(ModifiedRegion);   // don't need this as we must have already included it to revert it
+		ExternalIncrementalChange.AppendChange(ModifiedRegion, ModifiedBlocks);
+		// TODO: this will get called twice most of the time, because ProcessCurrentEditCells functions will do it.
+		// But not *all* of the time because (eg) we might revert something but then not change anything.
+		// Should figure out a better way to do this, eg maybe a different signal based on 
+		// the state of ExternalIncrementalChange...
+		OnGridModifiedCallback();
+	}
+}
+
+
+bool ModelGridEditMachine::CanUpdateParametricEditIncrementally() const
+{
+	// color modifiers may not be deterministic (eg RandomizeColorModifier)
+	if (CurrentColorModifier != nullptr)
+		return false;
+
+	// auto-orientation of placed cells depends on the current cursor normal
+	bool bIsRSTCell = ModelGridCellData_StandardRST::IsSubType(CurrentDrawCellType);
+	if (bIsRSTCell && bHaveViewInformation && bAutoOrientPlacedBlocksToCamera)
+		return false;
+
+	// mirrored cells are cloned from other edited cells, so their result depends on the order cells are edited
+	if (FillLayer_OpMode == ERegionFillOperation::FillByCloningBase && (MirrorXState.bMirror || MirrorYState.bMirror))
+		return false;
+
+	return true;
+}
+
+
+static bool IsSameEditCell(const ModelGridCellEditSet::EditCell& A, const ModelGridCellEditSet::EditCell& B)
+{
+	return A.CellIndex == B.CellIndex && A.SourceCellIndex == B.SourceCellIndex
+		&& A.FaceIndex == B.FaceIndex && A.bFlipX == B.bFlipX && A.bFlipY == B.bFlipY;
+}
+
+bool ModelGridEditMachine::RevertStaleParametricEditCells()
+{
+	// Editing a cell only depends on its state before the change and its EditCell, so an applied cell that is
+	// identical in the new edit set does not need to be touched. Cells that appear more than once in the
+	// applied set are always reverted and re-applied, as the result of repeated edits depends on their order.
+	int NumApplied = (int)AppliedParametricEditCells.Size();
+	CellKeyHashMap<int> AppliedIndex;
+	AppliedIndex.Reserve(NumApplied);
+	for (int k = 0; k < NumApplied; ++k)
+	{
+		const Vector3i& CellIndex = AppliedParametricEditCells.Cells[k].CellIndex;
+		if (AppliedIndex.Insert(CellIndex, k) == false)
+			*AppliedIndex.Find(CellIndex) = -1;
+	}
+
+	std::vector<bool> KeepApplied(NumApplied, false);
+	ModelGridCellEditSet ApplyCells;
+	for (const ModelGridCellEditSet::EditCell& Cell : CurrentEditCellSet.Cells)
+	{
+		const int* FoundIndex = AppliedIndex.Find(Cell.CellIndex);
+		if (FoundIndex != nullptr && *FoundIndex >= 0 && IsSameEditCell(AppliedParametricEditCells.Cells[*FoundIndex], Cell))
+		{
+			// a repeated new cell would be edited again on top of the kept cell, rather than on top of the original cell
+			if (KeepApplied[*FoundIndex])
+				return false;
+			KeepApplied[*FoundIndex] = true;
+		}
+		else
+		{
+			ApplyCells.AppendCell(Cell);
+		}
+	}
+
+	std::vector<Vector3i> RevertCells;
+	for (int k = 0; k < NumApplied; ++k)
+	{
+		if (KeepApplied[k] == false)
+			RevertCells.push_back(AppliedParametricEditCells.Cells[k].CellIndex);
+	}
+	std::vector<Vector3i> RevertedBlocks;
+	GS::AxisBox3i RevertedRegion = CurrentEditor->RevertInProgressCells(RevertCells, &RevertedBlocks);
+	if (RevertedRegion.VolumeCount() > 0) {
+		ExternalIncrementalChange.AppendChange(RevertedRegion, RevertedBlocks);
+		OnGridModifiedCallback();
+	}
+
+	AppliedParametricEditCells = std::move(CurrentEditCellSet);
+	CurrentEditCellSet = std::move(ApplyCells);
+	return true;
+}
+
+
 void ModelGridEditMachine::GetPreviewOfCellEdit(EditState PreviewEditState, 
 	ModelGrid::CellKey Key, const Vector3d& LocalPosition, const Vector3d& LocalNormal,
 	FunctionRef<void(const ModelGridCellEditSet::EditCell&)> EnumerateTargetCellsCallbackFunc)
 {
 	// todo implement push/pop for this state?
 	CellCursorState SavedInitialCursor = InitialCursor, SavedCurrentCursor = CurrentCursor;
+
+	ComputePreviewEditCells(PreviewEditState, Key, LocalPosition, LocalNormal);
+
+	CurrentEditCellSet.EnumerateCells([&](const ModelGridCellEditSet::EditCell& cell) { 
+		EnumerateTargetCellsCallbackFunc(cell); 
+	});
+
+	// restore state
+	CurrentCursor = SavedCurrentCursor;
+	InitialCursor = SavedInitialCursor;
+}
+
+
+void ModelGridEditMachine::ComputePreviewEditCells(EditState PreviewEditState,
+	ModelGrid::CellKey Key, const Vector3d& LocalPosition, const Vector3d& LocalNormal)
+{
 	CurrentCursor = CellCursorState{ Key, LocalPosition, LocalNormal };
 	InitialCursor = CellCursorState{ Key, LocalPosition, LocalNormal };
 
@@ -427,14 +607,138 @@ void ModelGridEditMachine::GetPreviewOfCellEdit(EditState PreviewEditState,
 	case EditState::PaintCells_FillLayer: ComputeEditCellsFromCursor_TopLayer(false); break;
 	case EditState::PaintCells_FillConnected: ComputeEditCellsFromCursor_AllConnected(); break;
 	}
+}
 
-	CurrentEditCellSet.EnumerateCells([&](const ModelGridCellEditSet::EditCell& cell) { 
-		EnumerateTargetCellsCallbackFunc(cell); 
-	});
 
-	// restore state
-	CurrentCursor = SavedCurrentCursor;
-	InitialCursor = SavedInitialCursor;
+std::shared_ptr<ModelGridEditMachine> ModelGridEditMachine::CreatePreviewSnapshot() const
+{
+	std::shared_ptr<ModelGridEditMachine> Snapshot = std::make_shared<ModelGridEditMachine>();
+	Snapshot->TargetGrid = TargetGrid;
+	// no editor, the snapshot only computes edit cells
+
+	Snapshot->CurrentEditState = CurrentEditState;
+	Snapshot->CurrentDrawCellType = CurrentDrawCellType;
+	Snapshot->CurrentMaterialMode = CurrentMaterialMode;
+	Snapshot->bAutoOrientPlacedBlocksToCamera = bAutoOrientPlacedBlocksToCamera;
+	Snapshot->CurrentPrimaryColor = CurrentPrimaryColor;
+	Snapshot->CurrentSecondaryColor = CurrentSecondaryColor;
+	Snapshot->bPaintWithSecondaryColor = bPaintWithSecondaryColor;
+	Snapshot->CurrentMaterialIndex = CurrentMaterialIndex;
+	Snapshot->CurrentBrushExtent = CurrentBrushExtent;
+	Snapshot->CurrentBrushShape = CurrentBrushShape;
+	Snapshot->CurrentDrawPlaneNormal = CurrentDrawPlaneNormal;
+	Snapshot->CurrentDrawPlaneAxisIndex = CurrentDrawPlaneAxisIndex;
+	Snapshot->bHaveViewInformation = bHaveViewInformation;
+	Snapshot->CameraFrame = CameraFrame;
+	Snapshot->CurrentSculptMode = CurrentSculptMode;
+	Snapshot->FillLayer_FillMode = FillLayer_FillMode;
+	Snapshot->FillLayer_OpMode = FillLayer_OpMode;
+	Snapshot->FillLayer_Filter = FillLayer_Filter;
+	Snapshot->MirrorXState = MirrorXState;
+	Snapshot->MirrorYState = MirrorYState;
+	Snapshot->InitialCursor = InitialCursor;
+	Snapshot->CurrentCursor = CurrentCursor;
+	Snapshot->LastCellTypeCache = LastCellTypeCache;
+	return Snapshot;
+}
+
+
+uint64_t ModelGridEditMachine::RequestPreviewOfCellEdit_Async(EditState PreviewEditState,
+	ModelGrid::CellKey CellIndex, const Vector3d& LocalPosition, const Vector3d& LocalNormal)
+{
+	std::shared_ptr<PreviewRequest> Request = std::make_shared<PreviewRequest>();
+	Request->RequestID = ++LastPreviewRequestID;
+	Request->Snapshot = CreatePreviewSnapshot();
+	Request->Snapshot->PreviewCancelFlag = &Request->bCancelled;
+	Request->PreviewEditState = PreviewEditState;
+	Request->CellIndex = CellIndex;
+	Request->LocalPosition = LocalPosition;
+	Request->LocalNormal = LocalNormal;
+
+	{
+		std::scoped_lock Lock(PreviewLock);
+		// the pending and active requests are stale now, the running task will pick up this request next
+		if (ActivePreview)
+			ActivePreview->bCancelled = true;
+		PendingPreview = Request;
+		CompletedPreview.reset();
+		if (bPreviewTaskRunning)
+			return Request->RequestID;
+		bPreviewTaskRunning = true;
+	}
+
+	// the task only touches the requests and the preview members, the machine is not destroyed until the task has exited
+	PreviewTask = GS::Parallel::StartTask([this]()
+	{
+		while (true)
+		{
+			std::shared_ptr<PreviewRequest> NextRequest;
+			{
+				std::scoped_lock Lock(PreviewLock);
+				ActivePreview.reset();
+				if (!PendingPreview)
+				{
+					bPreviewTaskRunning = false;
+					return;
+				}
+				NextRequest = std::move(PendingPreview);
+				ActivePreview = NextRequest;
+			}
+			ComputePreviewRequest(*NextRequest);
+		}
+	}, "EditMachinePreview");
+
+	return Request->RequestID;
+}
+
+
+void ModelGridEditMachine::ComputePreviewRequest(PreviewRequest& Request)
+{
+	if (Request.bCancelled)
+		return;
+	ModelGridEditMachine& Snapshot = *Request.Snapshot;
+	Snapshot.ComputePreviewEditCells(Request.PreviewEditState, Request.CellIndex, Request.LocalPosition, Request.LocalNormal);
+	if (Request.bCancelled)
+		return;
+
+	std::shared_ptr<ModelGridEditPreviewResult> Result = std::make_shared<ModelGridEditPreviewResult>();
+	Result->RequestID = Request.RequestID;
+	Result->CellIndex = Request.CellIndex;
+	for (const ModelGridCellEditSet::EditCell& Cell : Snapshot.CurrentEditCellSet.Cells)
+	{
+		if (Result->Cells.Insert(Cell.CellIndex))
+			Result->CellBounds.Contain(Cell.CellIndex);
+	}
+
+	std::scoped_lock Lock(PreviewLock);
+	if (Request.bCancelled == false)
+		CompletedPreview = Result;
+}
+
+
+std::shared_ptr<const ModelGridEditPreviewResult> ModelGridEditMachine::GetCompletedPreviewOfCellEdit(bool bTakeResult)
+{
+	std::scoped_lock Lock(PreviewLock);
+	std::shared_ptr<const ModelGridEditPreviewResult> Result = CompletedPreview;
+	if (bTakeResult)
+		CompletedPreview.reset();
+	return Result;
+}
+
+
+void ModelGridEditMachine::CancelPreviewOfCellEdit(bool bWaitForTasks)
+{
+	{
+		std::scoped_lock Lock(PreviewLock);
+		PendingPreview.reset();
+		if (ActivePreview)
+			ActivePreview->bCancelled = true;
+		CompletedPreview.reset();
+	}
+
+	// the active request polls its cancel flag, so this only waits for a short time
+	if (bWaitForTasks)
+		GS::Parallel::WaitForTask(PreviewTask);
 }
 
 
@@ -443,8 +747,14 @@ bool ModelGridEditMachine::BeginStandardEditState(EditState NewState)
 	gs_debug_assert(CurrentEditState == EditState::NotEditing);
 	if (!(CurrentEditState == EditState::NotEditing)) return false;
 
+	CancelPreviewOfCellEdit(true);
+
 	CurrentEditState = NewState;
 	CurrentEditCellSet.Reset();
+	AppliedParametricEditCells.Reset();
+	bHaveAppliedParametricEdit = false;
+	ParametricFirstLayerCells.Reset();
+	bHaveParametricFirstLayerCells = false;
 
 	CurrentAccumChange = GridChangeInfo();
 	ExternalIncrementalChange = GridChangeInfo();
@@ -492,6 +802,8 @@ GridChangeInfo ModelGridEditMachine::GetIncrementalChange(bool bReset)
 
 void ModelGridEditMachine::ProcessCurrentEditCells()
 {
+	CancelPreviewOfCellEdit(true);
+
 	if ((int)CurrentEditState < (int)EditState::BEGIN_PAINT_EDITS)
 	{
 		if (CurrentSculptMode == ESculptMode::Erase) {
@@ -552,9 +864,17 @@ void ModelGridEditMachine::FillCurrentEditCells()
 			NewCell.SetToSolidColor(CurrentColorModifier->GetPaintColor(CurrentPrimaryColor, CurrentPrimaryColor, ExistingCell));
 	};
 
-	GridChangeInfo ChangeInfo;
-	for (const ModelGridCellEditSet::EditCell& Cell : CurrentEditCellSet.Cells) {
-		ModelGridCell NewCell = InitCell;
+	// without a color modifier the edit only depends on the cell, so blocks can be edited in parallel
+	// (color modifiers may be stateful, eg RandomizeColorModifier)
+	bool bEditIsThreadSafe = (CurrentColorModifier == nullptr);
+
+	GridChangeInfo ChangeInfo = CurrentEditor->EditCells_Batched(CurrentEditCellSet, 
+		[&](const ModelGridCellEditSet::EditCell& Cell, const ModelGridCell& CurCell, ModelGridCell& NewCell)
+	{
+		if (CellFilterFunc(CurCell) == false)
+			return false;
+
+		NewCell = InitCell;
 
 		// clone source cell if we have it and want to use it
 		if (bCloneIfPossible && Cell.SourceCellIndex != Vector3i::MaxInt()) {
@@ -565,9 +885,11 @@ void ModelGridEditMachine::FillCurrentEditCells()
 			GS::ApplyFlipToCell(NewCell, Cell.bFlipX, Cell.bFlipY, false);
 		}
 
-		if ( CurrentEditor->FillCell(Cell.CellIndex, NewCell, CellFilterFunc, NewCellModifierFunc) )
-			ChangeInfo.AppendChangedCell(Cell.CellIndex);
-	}
+		NewCellModifierFunc(CurCell, NewCell);
+
+		uint32_t FlagsMask = 0xFFFFFFFF;
+		return (NewCell.IsSame(CurCell, FlagsMask) == false);
+	}, nullptr, bEditIsThreadSafe);
 
 	CurrentAccumChange.AppendChange(ChangeInfo);
 	ExternalIncrementalChange.AppendChange(ChangeInfo);
@@ -591,7 +913,7 @@ void ModelGridEditMachine::ReplaceCurrentEditCells()
 		[&](const ModelGridCell& ExistingCell, ModelGridCell& NewCell) {
 			if (CurrentColorModifier != nullptr)
 				NewCell.SetToSolidColor( CurrentColorModifier->GetPaintColor(CurrentPrimaryColor, CurrentPrimaryColor, ExistingCell) );
-		});
+		}, nullptr, (CurrentColorModifier == nullptr) );
 	CurrentAccumChange.AppendChange(ChangeInfo);
 	ExternalIncrementalChange.AppendChange(ChangeInfo);
 	CurrentEditCellSet.Reset();
@@ -743,76 +1065,55 @@ void ModelGridEditMachine::ComputeEditCellsFromCursor_Pencil()
 void ModelGridEditMachine::ComputeEditCellsFromCursor_Brush2D()
 {
 	double DistScale = GS::Max(TargetGrid->CellSize().X, TargetGrid->CellSize().Y);
-	Vector3d CenterPointXY = TargetGrid->GetCellLocalBounds(CurrentCursor.CellIndex).Center();
-	CenterPointXY[CurrentDrawPlaneAxisIndex] = 0;
 
 	CurrentEditCellSet.AppendCell(CurrentCursor.CellIndex);
 	Vector3i BrushCenter = (Vector3i)CurrentCursor.CellIndex;
 	int IntBrushRadius = (int)CurrentBrushExtent;
 	Vector3i BrushBoundsExtent(IntBrushRadius, IntBrushRadius, IntBrushRadius);
 	BrushBoundsExtent[CurrentDrawPlaneAxisIndex] = 0;
+	int BrushWidth = 2 * GS::Max(IntBrushRadius, 0) + 1;
+	CurrentEditCellSet.ReserveAdditional(BrushWidth * BrushWidth);
+
+	auto AppendSpanFunc = [&](int MinX, int MaxX, int Y, int Z) { CurrentEditCellSet.AppendCellSpan(MinX, MaxX, Y, Z); };
 	if (CurrentBrushShape == EBrushShape::Square)
 	{
-		TargetGrid->EnumerateAdjacentCells(BrushCenter, BrushBoundsExtent, false,
-			[&](ModelGrid::CellKey Key, Vector3i Offset, const ModelGridCell& CellInfo) { CurrentEditCellSet.AppendCell(Key); });
+		GS::RasterizeBoxBrushSpans(BrushCenter, BrushBoundsExtent, TargetGrid->GetCellIndexRange(), AppendSpanFunc);
 	}
 	else
 	{
-		// todo just use a DDA circle here? ...
 		double BrushRadiusF = DistScale * CurrentBrushExtent;
-		TargetGrid->EnumerateAdjacentCells(BrushCenter, BrushBoundsExtent, false,
-			[&](ModelGrid::CellKey Key, Vector3i Offset, const ModelGridCell& CellInfo) { 
-
-				AxisBox3d LocalBounds = TargetGrid->GetCellLocalBounds(Key);
-				int NumInside = 0;
-				for (int k = 0; k <= 3; ++k)
-				{
-					Vector3d BoxCornerXY = LocalBounds.BoxCorner(k);
-					BoxCornerXY[CurrentDrawPlaneAxisIndex] = 0;
-					if ( Distance(BoxCornerXY, CenterPointXY) < BrushRadiusF) NumInside++;
-				}
-				if (NumInside >= 2)
-					CurrentEditCellSet.AppendCell(Key);
-			});
+		GS::RasterizeDiscBrushSpans(BrushCenter, CurrentDrawPlaneAxisIndex, BrushBoundsExtent, TargetGrid->CellSize(), 
+			BrushRadiusF, 2, TargetGrid->GetCellIndexRange(), AppendSpanFunc);
 	}
 }
 
 void ModelGridEditMachine::ComputeEditCellsFromCursor_Brush3D()
 {
-	Vector3d CenterPoint = TargetGrid->GetCellLocalBounds(CurrentCursor.CellIndex).Center();
 	double DistScale = ((Vector3d)TargetGrid->CellSize()).AbsMax();
 
 	CurrentEditCellSet.AppendCell(CurrentCursor.CellIndex);
 	Vector3i BrushCenter = (Vector3i)CurrentCursor.CellIndex;
 	int IntBrushRadius = (int)CurrentBrushExtent;
+	Vector3i BrushBoundsExtent(IntBrushRadius, IntBrushRadius, IntBrushRadius);
+	int BrushWidth = 2 * GS::Max(IntBrushRadius, 0) + 1;
+	CurrentEditCellSet.ReserveAdditional(BrushWidth * BrushWidth * BrushWidth);
+
+	auto AppendSpanFunc = [&](int MinX, int MaxX, int Y, int Z) { CurrentEditCellSet.AppendCellSpan(MinX, MaxX, Y, Z); };
 	if (CurrentBrushShape == EBrushShape::Square)
 	{
-		TargetGrid->EnumerateAdjacentCells(BrushCenter, Vector3i(IntBrushRadius, IntBrushRadius, IntBrushRadius), false,
-			[&](ModelGrid::CellKey Key, Vector3i Offset, const ModelGridCell& CellInfo) { CurrentEditCellSet.AppendCell(Key); });
+		GS::RasterizeBoxBrushSpans(BrushCenter, BrushBoundsExtent, TargetGrid->GetCellIndexRange(), AppendSpanFunc);
 	}
 	else
 	{
+		// 4 corners also kinda good...
 		double BrushRadiusF = DistScale * CurrentBrushExtent;
-		TargetGrid->EnumerateAdjacentCells(BrushCenter, Vector3i(IntBrushRadius, IntBrushRadius, IntBrushRadius), false,
-			[&](ModelGrid::CellKey Key, Vector3i Offset, const ModelGridCell& CellInfo) {
-				
-				AxisBox3d LocalBounds = TargetGrid->GetCellLocalBounds(Key);
-				int NumInside = 0;
-				for (int k = 0; k <= 7; ++k)
-				{
-					if (Distance(LocalBounds.BoxCorner(k), CenterPoint)  < BrushRadiusF) NumInside++;
-				}
-				// 4 also kinda good...
-				if (NumInside >= 3)
-					CurrentEditCellSet.AppendCell(Key);
-			});
+		GS::RasterizeSphereBrushSpans(BrushCenter, BrushBoundsExtent, TargetGrid->CellSize(), 
+			BrushRadiusF, 3, TargetGrid->GetCellIndexRange(), AppendSpanFunc);
 	}
 }
 
-void ModelGridEditMachine::ComputeEditCellsFromCursor_TopLayer(bool bParametric)
+void ModelGridEditMachine::ComputeFirstLayerEditCells(Vector3i FirstLayerCellIndex)
 {
-	Vector3i FirstLayerCellIndex = (bParametric) ? InitialCursor.CellIndex : CurrentCursor.CellIndex;
-
 	bool bApplyFilter = (FillLayer_Filter != ERegionFillFilter::NoFilter);
 	auto CellFilterFunc = [this](Vector3i CellIndex) {
 		ModelGridCell Cell; TargetGrid->GetCellInfoIfValid(CellIndex, Cell);
@@ -821,23 +1122,25 @@ void ModelGridEditMachine::ComputeEditCellsFromCursor_TopLayer(bool bParametric)
 		return true;
 	};
 
+	// connected solid cells in the draw plane, where the cell above is empty (or outside the grid)
+	ModelGrid::ScanlineFillParams TopLayerFillParams;
+	TopLayerFillParams.PlaneAxis = CurrentDrawPlaneAxisIndex;
+	TopLayerFillParams.bFillSolidCells = true;
+	TopLayerFillParams.bRequireEmptyAtOffset = true;
+	TopLayerFillParams.EmptyOffset = CurrentDrawPlaneNormal;
+
 	bool bCurrentIsEmpty = TargetGrid->IsCellEmpty(FirstLayerCellIndex);
 	if (bCurrentIsEmpty == false)
 	{
 		CurrentEditCellSet.AppendCell(FirstLayerCellIndex);
 
 		// erasing path?
-		TargetGrid->EnumerateConnectedPlanarCells(FirstLayerCellIndex, CurrentDrawPlaneAxisIndex,
-			[&](ModelGrid::CellKey KeyFrom, ModelGrid::CellKey KeyTo) 
-			{ 
-				ModelGrid::CellKey AboveKey(KeyTo + CurrentDrawPlaneNormal);
-				return TargetGrid->IsCellEmpty(AboveKey) || TargetGrid->IsValidCell(AboveKey) == false;
-			},
+		TargetGrid->EnumerateConnectedCells_Scanline(FirstLayerCellIndex, TopLayerFillParams,
 			[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo) 
 			{ 
 				if ( bApplyFilter == false || CellFilterFunc(Key) )
 					CurrentEditCellSet.AppendCell(Key);
-			}, true);
+			}, PreviewCancelFlag);
 	}
 	else
 	{
@@ -849,31 +1152,49 @@ void ModelGridEditMachine::ComputeEditCellsFromCursor_TopLayer(bool bParametric)
 		{
 			CurrentEditCellSet.AppendCell(FirstLayerCellIndex, BelowKey);
 
-			TargetGrid->EnumerateConnectedPlanarCells(BelowKey, CurrentDrawPlaneAxisIndex,
-				[&](ModelGrid::CellKey KeyFrom, ModelGrid::CellKey KeyTo) 
-				{ 
-					ModelGrid::CellKey AboveKey(KeyTo + CurrentDrawPlaneNormal);
-					return TargetGrid->IsCellEmpty(AboveKey) || TargetGrid->IsValidCell(AboveKey) == false;
-				},
+			TargetGrid->EnumerateConnectedCells_Scanline(BelowKey, TopLayerFillParams,
 				[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo) 
 				{
 					ModelGrid::CellKey AboveKey(Key + CurrentDrawPlaneNormal);
 					if (bApplyFilter == false || CellFilterFunc(Key))
 						CurrentEditCellSet.AppendCell(AboveKey, Key);
-				}, true);
+				}, PreviewCancelFlag);
 		}
 		else
 			CurrentEditCellSet.AppendCell(FirstLayerCellIndex);		// we will just fill this one cell...
 	}
 
+	if (IsPreviewCancelled())
+		return;
 	ApplyRegionFillModeTo2DSelection(CurrentEditCellSet, FillLayer_FillMode, CurrentDrawPlaneAxisIndex);
+}
+
+void ModelGridEditMachine::ComputeEditCellsFromCursor_TopLayer(bool bParametric)
+{
+	Vector3i FirstLayerCellIndex = (bParametric) ? InitialCursor.CellIndex : CurrentCursor.CellIndex;
+
+	// in a parametric fill the first layer only depends on the initial cursor, so it is computed once per interaction 
+	// (ie from the grid state before any cells were modified) and then re-used
+	if (bParametric && bHaveParametricFirstLayerCells)
+	{
+		CurrentEditCellSet = ParametricFirstLayerCells;
+	}
+	else
+	{
+		ComputeFirstLayerEditCells(FirstLayerCellIndex);
+		if (bParametric)
+		{
+			ParametricFirstLayerCells = CurrentEditCellSet;
+			bHaveParametricFirstLayerCells = true;
+		}
+	}
 
 	// yikes this is a big hack right here...
 
 	// repeat-fill   (todo improve handling of going back to start position...)
 	if (bParametric)
 	{
-		ModelGridCellEditSet FirstLayerCells = CurrentEditCellSet;
+		const ModelGridCellEditSet& FirstLayerCells = ParametricFirstLayerCells;
 		int N = (int)FirstLayerCells.Size();
 		ModelGridCellEditSet& AccumCells = CurrentEditCellSet;
 		bool bSkipStartCellLayer = true;
@@ -922,7 +1243,7 @@ void ModelGridEditMachine::ComputeEditCellsFromCursor_TopLayer(bool bParametric)
 			
 		int MinIdx = GS::Min(StartCell[idx], EndCell[idx]);
 		int MaxIdx = GS::Max(StartCell[idx], EndCell[idx]);
-		for (int j = MinIdx; j <= MaxIdx; ++j)
+		for (int j = MinIdx; j <= MaxIdx && IsPreviewCancelled() == false; ++j)
 		{
 			int LayerIdx = j;
 			if (bSkipStartCellLayer && LayerIdx == StartCell[idx])
@@ -943,32 +1264,15 @@ void ModelGridEditMachine::ComputeEditCellsFromCursor_FloodFillPlanar()
 {
 	CurrentEditCellSet.AppendCell(CurrentCursor.CellIndex);
 
-	bool bCurrentIsEmpty = TargetGrid->IsCellEmpty(CurrentCursor.CellIndex);
-	if (bCurrentIsEmpty)
-	{
-		TargetGrid->EnumerateConnectedPlanarCells(CurrentCursor.CellIndex, CurrentDrawPlaneAxisIndex,
-			[&](ModelGrid::CellKey KeyFrom, ModelGrid::CellKey KeyTo)
-			{
-				return TargetGrid->IsCellEmpty(KeyTo);
-			},
-			[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo) 
-			{ 
+	// flood-fill the empty or solid region containing the cursor cell, in the draw plane
+	ModelGrid::ScanlineFillParams FillParams;
+	FillParams.PlaneAxis = CurrentDrawPlaneAxisIndex;
+	FillParams.bFillSolidCells = ! TargetGrid->IsCellEmpty(CurrentCursor.CellIndex);
+	TargetGrid->EnumerateConnectedCells_Scanline(CurrentCursor.CellIndex, FillParams,
+		[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo) 
+		{ 
 			CurrentEditCellSet.AppendCell(Key);
-			}, false);
-	}
-	else
-	{
-		TargetGrid->EnumerateConnectedPlanarCells(CurrentCursor.CellIndex, CurrentDrawPlaneAxisIndex,
-			[&](ModelGrid::CellKey KeyFrom, ModelGrid::CellKey KeyTo)
-			{
-				return ! TargetGrid->IsCellEmpty(KeyTo);
-			},
-			[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo) 
-			{ 
-			CurrentEditCellSet.AppendCell(Key);
-			}, true);
-	}
-
+		}, PreviewCancelFlag);
 }
 
 
@@ -993,8 +1297,8 @@ void ModelGridEditMachine::ComputeEditCellsFromCursor_Rect2D()
 void ModelGridEditMachine::ComputeEditCellsFromCursor_AllConnected()
 {
 	CurrentEditCellSet.AppendCell(CurrentCursor.CellIndex);
-	TargetGrid->EnumerateConnectedCells(CurrentCursor.CellIndex,
-		[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo) { CurrentEditCellSet.AppendCell(Key); });
+	TargetGrid->EnumerateConnectedCells_Scanline(CurrentCursor.CellIndex, ModelGrid::ScanlineFillParams(),
+		[&](ModelGrid::CellKey Key, const ModelGridCell& CellInfo) { CurrentEditCellSet.AppendCell(Key); }, PreviewCancelFlag);
 }
 
 
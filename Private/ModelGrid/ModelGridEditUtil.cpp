@@ -38,18 +38,42 @@ void ModelGridCellEditSet::AppendCell(const EditCell& NewCell)
 	Cells.push_back(NewCell);
 }
 
+void ModelGridCellEditSet::AppendCellSpan(int MinX, int MaxX, int Y, int Z)
+{
+	if (MaxX < MinX) return;
+	size_t StartIndex = Cells.size();
+	Cells.resize(StartIndex + (size_t)(MaxX - MinX + 1));
+	for (int x = MinX; x <= MaxX; ++x)
+		Cells[StartIndex + (size_t)(x - MinX)].CellIndex = Vector3i(x, Y, Z);
+}
+
 
 void ModelGridCellEditSet::RemoveDuplicates()
 {
-	std::sort(Cells.begin(), Cells.end(), [](const EditCell& a, const EditCell& b)
-	{
-		return a.CellIndex < b.CellIndex;
-	});
-	auto new_last = std::unique(Cells.begin(), Cells.end(), [](const EditCell& a, const EditCell& b)
-	{
-		return a.CellIndex == b.CellIndex;
-	});
-	Cells.erase(new_last, Cells.end());
+	ModelGridCellBitSet CellBits;
+	RemoveDuplicates(CellBits);
+}
+
+void ModelGridCellEditSet::RemoveDuplicates(ModelGridCellBitSet& CellBitsOut)
+{
+	CellBitsOut.Clear();
+	size_t N = Cells.size(), NumUnique = 0;
+	for (size_t k = 0; k < N; ++k) {
+		if (CellBitsOut.Insert(Cells[k].CellIndex)) {
+			if (NumUnique != k)
+				Cells[NumUnique] = Cells[k];
+			NumUnique++;
+		}
+	}
+	Cells.resize(NumUnique);
+}
+
+bool ModelGridCellEditSet::AppendUniqueCell(const EditCell& NewCell, ModelGridCellBitSet& CellBits)
+{
+	if (CellBits.Insert(NewCell.CellIndex) == false)
+		return false;
+	Cells.push_back(NewCell);
+	return true;
 }
 
 
@@ -63,6 +87,12 @@ bool ModelGridCellEditSet::ContainsCell(Vector3i CellIndex) const
 	return false;
 }
 
+void ModelGridCellEditSet::AddToCellBitSet(ModelGridCellBitSet& CellBits) const
+{
+	for (const EditCell& Cell : Cells)
+		CellBits.Insert(Cell.CellIndex);
+}
+
 
 
 void ModelGridCellEditSet::AppendMirroredCells(
@@ -79,6 +109,18 @@ void ModelGridCellEditSet::AppendMirroredCells(
 
 	if (bMirrorX == false && bMirrorY == false) return;
 	bool bMirrorXY = (bMirrorX && bMirrorY);
+
+	// mirrored cells are only appended if their CellIndex is not already in the set
+	ModelGridCellBitSet CellBits;
+	if (bRemoveDuplicates)
+		RemoveDuplicates(CellBits);
+	auto AppendMirrorCell = [&](const EditCell& NewCell) {
+		if (bRemoveDuplicates)
+			AppendUniqueCell(NewCell, CellBits);
+		else
+			Cells.push_back(NewCell);
+	};
+
 	int N = (int)Cells.size();
 	Cells.reserve(bMirrorXY ? (4 * N) : (2*N));
 	for (int k = 0; k < N; ++k) {
@@ -92,21 +134,124 @@ void ModelGridCellEditSet::AppendMirroredCells(
 			// 0 or -1, depending on if we want to allow a shared "middle" row or not
 			Tmp.CellIndex.X = -((Tmp.CellIndex.X-MirrorOriginX)+CenterX) + MirrorOriginX;
 			Tmp.bFlipX = true; 
-			Cells.push_back(Tmp);
+			AppendMirrorCell(Tmp);
 			if (bMirrorXY) {
 				Tmp.bFlipY = true;
 				Tmp.CellIndex.Y = -((Tmp.CellIndex.Y-MirrorOriginY)+CenterY) + MirrorOriginY;
-				Cells.push_back(Tmp);
+				AppendMirrorCell(Tmp);
 			}
 		}
 		if (bMirrorY || bMirrorXY) {
 			EditCell Tmp = MirrorCell; 
 			Tmp.CellIndex.Y = -((Tmp.CellIndex.Y-MirrorOriginY)+CenterY) + MirrorOriginY;
 			Tmp.bFlipY = true; 
-			Cells.push_back(Tmp);
+			AppendMirrorCell(Tmp);
 		}
 	}
+}
 
-	if (bRemoveDuplicates)
-		RemoveDuplicates();
-}
\ No newline at end of file
+
+
+
+void GS::RasterizeBoxBrushSpans(
+	Vector3i CenterCell, Vector3i HalfExtents, const AxisBox3i& ClipBounds,
+	FunctionRef<void(int MinX, int MaxX, int Y, int Z)> SpanFunc)
+{
+	int MinX = GS::Max(CenterCell.X - HalfExtents.X, ClipBounds.Min.X);
+	int MaxX = GS::Min(CenterCell.X + HalfExtents.X, ClipBounds.Max.X);
+	if (MinX > MaxX) return;
+	int MinY = GS::Max(CenterCell.Y - HalfExtents.Y, ClipBounds.Min.Y);
+	int MaxY = GS::Min(CenterCell.Y + HalfExtents.Y, ClipBounds.Max.Y);
+	int MinZ = GS::Max(CenterCell.Z - HalfExtents.Z, ClipBounds.Min.Z);
+	int MaxZ = GS::Min(CenterCell.Z + HalfExtents.Z, ClipBounds.Max.Z);
+	for (int z = MinZ; z <= MaxZ; ++z)
+	{
+		for (int y = MinY; y <= MaxY; ++y)
+			SpanFunc(MinX, MaxX, y, z);
+	}
+}
+
+
+// Count corners of the cell at Offset from the center cell that are strictly within sqrt(RadiusSqr) of the center cell's
+// center point. Axes where AxisActive is false are ignored (ie for 2D brushes), so the cell has 2^(#active) corners.
+static int CountCellCornersInside(const Vector3i& Offset, const bool AxisActive[3], const Vector3d& CellDimensions, double RadiusSqr)
+{
+	double CornerSqr[3][2] = { {0,0}, {0,0}, {0,0} };
+	int NumCorners[3] = { 1, 1, 1 };
+	for (int j = 0; j < 3; ++j)
+	{
+		if (AxisActive[j])
+		{
+			double A = ((double)Offset[j] - 0.5) * CellDimensions[j];
+			double B = ((double)Offset[j] + 0.5) * CellDimensions[j];
+			CornerSqr[j][0] = A * A;
+			CornerSqr[j][1] = B * B;
+			NumCorners[j] = 2;
+		}
+	}
+	int NumInside = 0;
+	for (int i = 0; i < NumCorners[0]; ++i)
+		for (int j = 0; j < NumCorners[1]; ++j)
+			for (int k = 0; k < NumCorners[2]; ++k)
+				NumInside += (CornerSqr[0][i] + CornerSqr[1][j] + CornerSqr[2][k] < RadiusSqr) ? 1 : 0;
+	return NumInside;
+}
+
+// PlaneAxis is -1 for sphere brush, otherwise disc brush in plane perpendicular to PlaneAxis
+static void RasterizeRoundBrushSpans(
+	Vector3i CenterCell, int PlaneAxis, Vector3i HalfExtents, const Vector3d& CellDimensions, double Radius, int MinCornersInside,
+	const AxisBox3i& ClipBounds,
+	FunctionRef<void(int MinX, int MaxX, int Y, int Z)> SpanFunc)
+{
+	if (Radius <= 0) return;
+	double RadiusSqr = Radius * Radius;
+	bool AxisActive[3] = { PlaneAxis != 0, PlaneAxis != 1, PlaneAxis != 2 };
+	if (PlaneAxis >= 0 && PlaneAxis <= 2)
+		HalfExtents[PlaneAxis] = 0;
+
+	for (int dz = -HalfExtents.Z; dz <= HalfExtents.Z; ++dz)
+	{
+		int z = CenterCell.Z + dz;
+		if (z < ClipBounds.Min.Z || z > ClipBounds.Max.Z) continue;
+		for (int dy = -HalfExtents.Y; dy <= HalfExtents.Y; ++dy)
+		{
+			int y = CenterCell.Y + dy;
+			if (y < ClipBounds.Min.Y || y > ClipBounds.Max.Y) continue;
+
+			// the number of inside corners is symmetric in dx and does not increase with |dx|, so
+			// each row is a single span [-HalfWidth,HalfWidth], and HalfWidth can be found by bisection
+			if (CountCellCornersInside(Vector3i(0, dy, dz), AxisActive, CellDimensions, RadiusSqr) < MinCornersInside)
+				continue;
+			int HalfWidth = 0, MaxHalfWidth = HalfExtents.X;
+			while (HalfWidth < MaxHalfWidth)
+			{
+				int Mid = (HalfWidth + MaxHalfWidth + 1) / 2;
+				if (CountCellCornersInside(Vector3i(Mid, dy, dz), AxisActive, CellDimensions, RadiusSqr) >= MinCornersInside)
+					HalfWidth = Mid;
+				else
+					MaxHalfWidth = Mid - 1;
+			}
+
+			int MinX = GS::Max(CenterCell.X - HalfWidth, ClipBounds.Min.X);
+			int MaxX = GS::Min(CenterCell.X + HalfWidth, ClipBounds.Max.X);
+			if (MinX <= MaxX)
+				SpanFunc(MinX, MaxX, y, z);
+		}
+	}
+}
+
+void GS::RasterizeSphereBrushSpans(
+	Vector3i CenterCell, Vector3i HalfExtents, const Vector3d& CellDimensions, double Radius, int MinCornersInside,
+	const AxisBox3i& ClipBounds,
+	FunctionRef<void(int MinX, int MaxX, int Y, int Z)> SpanFunc)
+{
+	RasterizeRoundBrushSpans(CenterCell, -1, HalfExtents, CellDimensions, Radius, MinCornersInside, ClipBounds, SpanFunc);
+}
+
+void GS::RasterizeDiscBrushSpans(
+	Vector3i CenterCell, int PlaneAxis, Vector3i HalfExtents, const Vector3d& CellDimensions, double Radius, int MinCornersInside,
+	const AxisBox3i& ClipBounds,
+	FunctionRef<void(int MinX, int MaxX, int Y, int Z)> SpanFunc)
+{
+	RasterizeRoundBrushSpans(CenterCell, PlaneAxis, HalfExtents, CellDimensions, Radius, MinCornersInside, ClipBounds, SpanFunc);
+}
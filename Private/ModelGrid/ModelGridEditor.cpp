@@ -2,6 +2,9 @@
 #include "ModelGrid/ModelGridEditor.h"
 #include "Core/gs_debug.h"
 #include "GenericGrid/BoxIndexing.h"
+#include "ModelGrid/ModelGridConstants.h"
+
+#include <algorithm>
 
 using namespace GS;
 
@@ -59,14 +62,49 @@ void ModelGridEditor::ReapplyChange(const ModelGridDeltaChange& Change, bool bRe
 	}
 }
 
+UniquePtr<ModelGridCompactDeltaChange> ModelGridEditor::EndCompactChange()
+{
+	UniquePtr<ModelGridDeltaChange> Change = EndChange();
+	if (!Change)
+		return UniquePtr<ModelGridCompactDeltaChange>();
+
+	UniquePtr<ModelGridCompactDeltaChange> CompactChange = GSMakeUniquePtr<ModelGridCompactDeltaChange>();
+	CompactChange->InitializeFromChange(*Change, ModelGridConstants(*Grid));
+	return CompactChange;
+}
+
+void ModelGridEditor::ReapplyChange(const ModelGridCompactDeltaChange& Change, bool bRevert)
+{
+	std::vector<Vector3i> BlockIndices;
+	std::vector<int> BlockKeyOffsets;
+	std::vector<Vector3i> CellKeys;
+	std::vector<uint32_t> PaletteCells;
+	Change.ExpandCells(ModelGridConstants(*Grid), bRevert, BlockIndices, BlockKeyOffsets, CellKeys, PaletteCells);
+
+	// unpack each unique cell once
+	std::vector<ModelGridCell> Palette;
+	Palette.reserve(Change.CellPalette.size());
+	for (uint32_t k = 0; k < (uint32_t)Change.CellPalette.size(); ++k)
+		Palette.push_back(Change.GetPaletteCell(k));
+
+	Grid->EditMultipleBlockCells_Parallel(BlockIndices, BlockKeyOffsets, CellKeys.data(),
+		[&](int KeyIndex, const ModelGridCell& CurCell, ModelGridCell& NewCell)
+	{
+		NewCell = Palette[PaletteCells[KeyIndex]];
+		return true;
+	});
+}
+
 
-GS::AxisBox3i ModelGridEditor::RevertInProgressChange()
+GS::AxisBox3i ModelGridEditor::RevertInProgressChange(std::vector<Vector3i>* ModifiedBlocksOut)
 {
 	AxisBox3i ModifiedRegion = ActiveChangeTracker->GetCurrentChangeBounds();
 	gs_debug_assert(IsTrackingChange());
 
 	// TODO do we need to do it this way? could just access change to revert and then Reset arrays...
 	GS::UniquePtr<GS::ModelGridDeltaChange> ActiveChange = ActiveChangeTracker->ExtractChange();
+	if (ModifiedBlocksOut != nullptr)
+		GridChangeInfo::AppendAffectedBlocks(*Grid, ActiveChange->CellKeys, *ModifiedBlocksOut);
 	ReapplyChange(*ActiveChange, true);
 	ActiveChangeTracker->AllocateNewChange();
 	ActiveChange.reset();
@@ -74,6 +112,30 @@ GS::AxisBox3i ModelGridEditor::RevertInProgressChange()
 	return ModifiedRegion;
 }
 
+GS::AxisBox3i ModelGridEditor::RevertInProgressCells(const std::vector<Vector3i>& CellKeys, std::vector<Vector3i>* ModifiedBlocksOut)
+{
+	AxisBox3i RevertedRegion = AxisBox3i::Empty();
+	gs_debug_assert(IsTrackingChange());
+	if (!IsTrackingChange())
+		return RevertedRegion;
+
+	ModelGridCell PrevCell;
+	std::vector<Vector3i> RevertedCells;
+	for (const Vector3i& CellKey : CellKeys)
+	{
+		if (ActiveChangeTracker->RemoveModifiedCell(CellKey, PrevCell))
+		{
+			Grid->ReinitializeCell(CellKey, PrevCell);
+			RevertedRegion.Contain(CellKey);
+			if (ModifiedBlocksOut != nullptr)
+				RevertedCells.push_back(CellKey);
+		}
+	}
+	if (ModifiedBlocksOut != nullptr)
+		GridChangeInfo::AppendAffectedBlocks(*Grid, RevertedCells, *ModifiedBlocksOut);
+	return RevertedRegion;
+}
+
 
 bool ModelGridEditor::UpdateCell(ModelGrid::CellKey CellKey, const ModelGridCell& NewCell)
 {
@@ -88,106 +150,84 @@ bool ModelGridEditor::UpdateCell(ModelGrid::CellKey CellKey, const ModelGridCell
 }
 
 
-bool ModelGridEditor::EraseCell(const Vector3i& CellIndex)
+// Functions below compute the new state of a cell for each edit type, and return false if the cell should not be modified.
+// They are shared by the single-cell and batched edit paths.
+
+static bool ComputeErasedCell(const ModelGridCell& CurCell, ModelGridCell& NewCell)
 {
-	bool bIsInGrid = false;
-	ModelGridCell Existing = Grid->GetCellInfo(CellIndex, bIsInGrid);
-	if (bIsInGrid == false || Existing.CellType == EModelGridCellType::Empty)
+	if (CurCell.CellType == EModelGridCellType::Empty)
 		return false;
-	UpdateCell(CellIndex, ModelGridCell::EmptyCell());
+	NewCell = ModelGridCell::EmptyCell();
 	return true;
 }
 
-
-bool ModelGridEditor::FillCell(const Vector3i& CellIndex, 
-	const ModelGridCell& NewCell,
+static bool ComputeFilledCell(const ModelGridCell& CurCell, ModelGridCell& NewCell,
+	const ModelGridCell& FillCell,
 	FunctionRef<bool(const ModelGridCell&)> CellFilterFunc,
 	FunctionRef<void(const ModelGridCell& CurCell, ModelGridCell& NewCell)> NewCellModifierFunc)
 {
 	// todo: this may be cell-type-dependent
 	uint32_t FlagsMask = 0xFFFFFFFF;
 
-	bool bIsInGrid = false;
-	ModelGridCell Existing = Grid->GetCellInfo(CellIndex, bIsInGrid);
-	if (bIsInGrid == false || CellFilterFunc(Existing) == false)
+	if (CellFilterFunc(CurCell) == false)
 		return false;
 
-	ModelGridCell ApplyNewCell = NewCell;
-	NewCellModifierFunc(Existing, ApplyNewCell);
-
-	if (ApplyNewCell.IsSame(Existing, FlagsMask))
-		return false;
+	NewCell = FillCell;
+	NewCellModifierFunc(CurCell, NewCell);
 
-	UpdateCell(CellIndex, ApplyNewCell);
-	return true;
+	return (NewCell.IsSame(CurCell, FlagsMask) == false);
 }
 
-
-bool ModelGridEditor::PaintCell(const Vector3i& CellIndex, const Color3b& NewColor)
+static bool ComputePaintedCell(const ModelGridCell& CurCell, ModelGridCell& NewCell, const Color3b& NewColor)
 {
-	bool bIsInGrid = false;
-	ModelGridCell CurCell = Grid->GetCellInfo(CellIndex, bIsInGrid);
-	if (bIsInGrid == false || CurCell.CellType == EModelGridCellType::Empty)
+	if (CurCell.CellType == EModelGridCellType::Empty)
 		return false;
 
 	if (CurCell.MaterialType != EGridCellMaterialType::SolidColor || CurCell.CellMaterial.AsColor3b() != NewColor)
 	{
-		ModelGridCell NewCell = CurCell;
+		NewCell = CurCell;
 		NewCell.SetToSolidColor(NewColor);
-		UpdateCell(CellIndex, NewCell);
 		return true;
 	}
 	return false;
 }
 
-
-
-bool ModelGridEditor::PaintCell(const Vector3i& CellIndex, uint8_t NewMaterialIndex)
+static bool ComputePaintedCell(const ModelGridCell& CurCell, ModelGridCell& NewCell, uint8_t NewMaterialIndex)
 {
-	bool bIsInGrid = false;
-	ModelGridCell CurCell = Grid->GetCellInfo(CellIndex, bIsInGrid);
-	if (bIsInGrid == false || CurCell.CellType == EModelGridCellType::Empty) 
+	if (CurCell.CellType == EModelGridCellType::Empty)
 		return false;
 
 	if (CurCell.MaterialType != EGridCellMaterialType::SolidRGBIndex || CurCell.CellMaterial.GetIndex8() != NewMaterialIndex)
 	{
-		ModelGridCell NewCell = CurCell;
+		NewCell = CurCell;
 		if (CurCell.MaterialType == EGridCellMaterialType::SolidColor)
 			NewCell.SetToSolidRGBIndex(CurCell.CellMaterial.AsColor3b(), NewMaterialIndex);
 		else if (CurCell.MaterialType == EGridCellMaterialType::SolidRGBIndex)
 			NewCell.SetToSolidRGBIndex(CurCell.CellMaterial.AsColor3b(), NewMaterialIndex);
 		else
 			NewCell.SetToSolidRGBIndex(Color3b::Black(), NewMaterialIndex);
-
-		UpdateCell(CellIndex, NewCell);
 		return true;
 	}
 	return false;
 }
 
-
-
-bool ModelGridEditor::PaintCell_Complex(const Vector3i& CellIndex,
+static bool ComputePaintedCell_Complex(const ModelGridCell& CurCell, ModelGridCell& NewCell,
 	FunctionRef<Color3b(const ModelGridCell& Cell)> GenerateColorFunc)
 {
-	bool bIsInGrid = false;
-	ModelGridCell CurCell = Grid->GetCellInfo(CellIndex, bIsInGrid);
-	if (bIsInGrid == false || CurCell.CellType == EModelGridCellType::Empty)
+	if (CurCell.CellType == EModelGridCellType::Empty)
 		return false;
 
 	Color3b NewColor = GenerateColorFunc(CurCell);
 	if (CurCell.MaterialType != EGridCellMaterialType::SolidColor || NewColor != CurCell.CellMaterial.AsColor3b() )
 	{
-		ModelGridCell NewCell = CurCell;
+		NewCell = CurCell;
 		NewCell.SetToSolidColor(NewColor);
-		UpdateCell(CellIndex, NewCell);
 		return true;
 	}
 	return false;
 }
 
-
-bool ModelGridEditor::PaintCellFace(const Vector3i& CellIndex, uint8_t CellFaceIndex, const Color4b& NewColor)
+static bool ComputePaintedCellFace(const ModelGridCell& CurCell, ModelGridCell& NewCell, uint8_t CellFaceIndex, const Color4b& NewColor)
 {
 	// these values correspond to BoxIndexing.h indexing
 	const int GroupID_PlusX = 0;
@@ -197,9 +237,7 @@ bool ModelGridEditor::PaintCellFace(const Vector3i& CellIndex, uint8_t CellFaceI
 	const int GroupID_PlusZ = 4;
 	const int GroupID_MinusZ = 5;
 
-	bool bIsInGrid = false;
-	ModelGridCell CurCell = Grid->GetCellInfo(CellIndex, bIsInGrid);
-	if (bIsInGrid == false || CurCell.CellType == EModelGridCellType::Empty) 
+	if (CurCell.CellType == EModelGridCellType::Empty) 
 		return false;
 
 	int UseFaceIndex = GS::Min((int)CellFaceIndex, CellFaceMaterials::MaxFaces);
@@ -232,7 +270,7 @@ bool ModelGridEditor::PaintCellFace(const Vector3i& CellIndex, uint8_t CellFaceI
 		&& CurCell.FaceMaterials[UseFaceIndex].AsColor4b() == NewColor)
 		return false;
 
-	ModelGridCell NewCell = CurCell;
+	NewCell = CurCell;
 
 	// if cell was solid, copy solid color to faces
 	if (NewCell.MaterialType == EGridCellMaterialType::SolidColor) {
@@ -242,12 +280,281 @@ bool ModelGridEditor::PaintCellFace(const Vector3i& CellIndex, uint8_t CellFaceI
 
 	NewCell.MaterialType = EGridCellMaterialType::FaceColors;
 	NewCell.FaceMaterials[UseFaceIndex] = GridMaterial(NewColor);
+	return true;
+}
+
 
+
+bool ModelGridEditor::EraseCell(const Vector3i& CellIndex)
+{
+	bool bIsInGrid = false;
+	ModelGridCell Existing = Grid->GetCellInfo(CellIndex, bIsInGrid);
+	ModelGridCell NewCell;
+	if (bIsInGrid == false || ComputeErasedCell(Existing, NewCell) == false)
+		return false;
 	UpdateCell(CellIndex, NewCell);
 	return true;
 }
 
 
+bool ModelGridEditor::FillCell(const Vector3i& CellIndex, 
+	const ModelGridCell& NewCell,
+	FunctionRef<bool(const ModelGridCell&)> CellFilterFunc,
+	FunctionRef<void(const ModelGridCell& CurCell, ModelGridCell& NewCell)> NewCellModifierFunc)
+{
+	bool bIsInGrid = false;
+	ModelGridCell Existing = Grid->GetCellInfo(CellIndex, bIsInGrid);
+	ModelGridCell ApplyNewCell;
+	if (bIsInGrid == false || ComputeFilledCell(Existing, ApplyNewCell, NewCell, CellFilterFunc, NewCellModifierFunc) == false)
+		return false;
+
+	UpdateCell(CellIndex, ApplyNewCell);
+	return true;
+}
+
+
+bool ModelGridEditor::PaintCell(const Vector3i& CellIndex, const Color3b& NewColor)
+{
+	bool bIsInGrid = false;
+	ModelGridCell CurCell = Grid->GetCellInfo(CellIndex, bIsInGrid);
+	ModelGridCell NewCell;
+	if (bIsInGrid == false || ComputePaintedCell(CurCell, NewCell, NewColor) == false)
+		return false;
+	UpdateCell(CellIndex, NewCell);
+	return true;
+}
+
+
+bool ModelGridEditor::PaintCell(const Vector3i& CellIndex, uint8_t NewMaterialIndex)
+{
+	bool bIsInGrid = false;
+	ModelGridCell CurCell = Grid->GetCellInfo(CellIndex, bIsInGrid);
+	ModelGridCell NewCell;
+	if (bIsInGrid == false || ComputePaintedCell(CurCell, NewCell, NewMaterialIndex) == false)
+		return false;
+	UpdateCell(CellIndex, NewCell);
+	return true;
+}
+
+
+bool ModelGridEditor::PaintCell_Complex(const Vector3i& CellIndex,
+	FunctionRef<Color3b(const ModelGridCell& Cell)> GenerateColorFunc)
+{
+	bool bIsInGrid = false;
+	ModelGridCell CurCell = Grid->GetCellInfo(CellIndex, bIsInGrid);
+	ModelGridCell NewCell;
+	if (bIsInGrid == false || ComputePaintedCell_Complex(CurCell, NewCell, GenerateColorFunc) == false)
+		return false;
+	UpdateCell(CellIndex, NewCell);
+	return true;
+}
+
+
+bool ModelGridEditor::PaintCellFace(const Vector3i& CellIndex, uint8_t CellFaceIndex, const Color4b& NewColor)
+{
+	bool bIsInGrid = false;
+	ModelGridCell CurCell = Grid->GetCellInfo(CellIndex, bIsInGrid);
+	ModelGridCell NewCell;
+	if (bIsInGrid == false || ComputePaintedCellFace(CurCell, NewCell, CellFaceIndex, NewColor) == false)
+		return false;
+	UpdateCell(CellIndex, NewCell);
+	return true;
+}
+
+
+
+GridChangeInfo ModelGridEditor::EditCells_Batched(
+	const ModelGridCellEditSet& CellEditSet,
+	FunctionRef<bool(const ModelGridCellEditSet::EditCell& EditCell, const ModelGridCell& CurCell, ModelGridCell& NewCell)> EditFunc,
+	std::vector<Vector3i>* ModifiedBlocksOut,
+	bool bEditFuncIsThreadSafe)
+{
+	GridChangeInfo Result;
+	size_t NumCells = CellEditSet.Cells.size();
+	if (NumCells == 0) 
+		return Result;
+
+	// Sort edits by block and then by Z/Y/X index inside the block. Stable sort so that repeated cells are applied in order.
+	struct SortedEdit
+	{
+		uint64_t SortKey;
+		uint32_t EditIndex;
+	};
+	std::vector<SortedEdit> SortedEdits;
+	SortedEdits.reserve(NumCells);
+	AxisBox3i CellIndexRange = Grid->GetCellIndexRange();
+	for (size_t k = 0; k < NumCells; ++k)
+	{
+		Vector3i CellIndex = CellEditSet.Cells[k].CellIndex;
+		if (CellIndexRange.Contains(CellIndex) == false)
+			continue;
+		Vector3i BlockIndex = Grid->GetChunkIndexForKey(CellIndex);
+		Vector3i LocalIndex = CellIndex - Grid->GetKeyRangeForChunk(BlockIndex).Min;
+		uint64_t BlockBits = ((uint64_t)BlockIndex.Z << 32) | ((uint64_t)BlockIndex.Y << 16) | (uint64_t)BlockIndex.X;
+		uint64_t LocalBits = (uint64_t)(LocalIndex.X + ModelGrid::BlockSize_XY * (LocalIndex.Y + ModelGrid::BlockSize_XY * LocalIndex.Z));
+		SortedEdits.push_back(SortedEdit{ (BlockBits << 16) | LocalBits, (uint32_t)k });
+	}
+	std::stable_sort(SortedEdits.begin(), SortedEdits.end(), [](const SortedEdit& A, const SortedEdit& B) { return A.SortKey < B.SortKey; });
+	size_t NumSorted = SortedEdits.size();
+	if (NumSorted == 0)
+		return Result;
+
+	// find the range of sorted edits for each block
+	std::vector<ModelGrid::CellKey> SortedKeys;
+	SortedKeys.reserve(NumSorted);
+	std::vector<Vector3i> BlockIndices;
+	std::vector<int> BlockKeyOffsets;
+	for (size_t k = 0; k < NumSorted; ++k)
+	{
+		SortedKeys.push_back(CellEditSet.Cells[SortedEdits[k].EditIndex].CellIndex);
+		if (k == 0 || (SortedEdits[k].SortKey >> 16) != (SortedEdits[k-1].SortKey >> 16))
+		{
+			BlockIndices.push_back(Grid->GetChunkIndexForKey(SortedKeys.back()));
+			BlockKeyOffsets.push_back((int)k);
+		}
+	}
+	BlockKeyOffsets.push_back((int)NumSorted);
+	int NumBlocks = (int)BlockIndices.size();
+
+	if (ActiveChangeTracker)
+		ActiveChangeTracker->ReserveAdditional(NumSorted);
+
+	// blocks affected by the modified cells, see GridChangeInfo::ModifiedBlocks
+	std::vector<Vector3i> AffectedBlocks;
+
+	// Disjoint blocks can be edited in parallel. The EditFunc results are stored per sorted edit, and then
+	// appended to the change in sorted order below, so the change is identical to the one from the serial path.
+	bool bParallel = bEnableParallelEdits && bEditFuncIsThreadSafe
+		&& NumBlocks > 1 && NumSorted >= MinParallelEditCells;
+	if (bParallel)
+	{
+		std::vector<ModelGridCell> CellsBefore, CellsAfter;
+		CellsBefore.resize(NumSorted);
+		CellsAfter.resize(NumSorted);
+		std::vector<uint8_t> CellWritten;
+		CellWritten.resize(NumSorted, 0);
+
+		std::vector<int> NumWritten;
+		Grid->EditMultipleBlockCells_Parallel(BlockIndices, BlockKeyOffsets, SortedKeys.data(),
+			[&](int KeyIndex, const ModelGridCell& CurCell, ModelGridCell& NewCell)
+		{
+			if (EditFunc(CellEditSet.Cells[SortedEdits[KeyIndex].EditIndex], CurCell, NewCell) == false)
+				return false;
+			CellsBefore[KeyIndex] = CurCell;
+			CellsAfter[KeyIndex] = NewCell;
+			CellWritten[KeyIndex] = 1;
+			return true;
+		}, &NumWritten);
+
+		for (int BlockListIndex = 0; BlockListIndex < NumBlocks; ++BlockListIndex)
+		{
+			if (NumWritten[BlockListIndex] == 0)
+				continue;
+			AxisBox3i BlockKeys = Grid->GetKeyRangeForChunk(BlockIndices[BlockListIndex]);
+			int BorderFaces = 0;
+			for (int k = BlockKeyOffsets[BlockListIndex]; k < BlockKeyOffsets[BlockListIndex+1]; ++k)
+			{
+				if (CellWritten[k] == 0)
+					continue;
+				Result.AppendChangedCell(SortedKeys[k]);
+				BorderFaces |= GridChangeInfo::GetBlockBorderFaces(BlockKeys, SortedKeys[k]);
+				if (ActiveChangeTracker && CellsAfter[k] != CellsBefore[k])
+					ActiveChangeTracker->AppendModifiedCell(SortedKeys[k], CellsBefore[k], CellsAfter[k]);
+			}
+			GridChangeInfo::AppendAffectedBlocks(*Grid, BlockIndices[BlockListIndex], BorderFaces, AffectedBlocks);
+		}
+	}
+	else
+	{
+		// apply the edits for each block together
+		for (int BlockListIndex = 0; BlockListIndex < NumBlocks; ++BlockListIndex)
+		{
+			int BlockStart = BlockKeyOffsets[BlockListIndex];
+			int NumBlockKeys = BlockKeyOffsets[BlockListIndex+1] - BlockStart;
+			AxisBox3i BlockKeys = Grid->GetKeyRangeForChunk(BlockIndices[BlockListIndex]);
+			int BorderFaces = 0;
+			int NumModified = Grid->EditBlockCells(BlockIndices[BlockListIndex], &SortedKeys[BlockStart], NumBlockKeys,
+				[&](int KeyIndex, const ModelGridCell& CurCell, ModelGridCell& NewCell)
+			{
+				const ModelGridCellEditSet::EditCell& EditCell = CellEditSet.Cells[SortedEdits[BlockStart + KeyIndex].EditIndex];
+				if (EditFunc(EditCell, CurCell, NewCell) == false)
+					return false;
+
+				Result.AppendChangedCell(EditCell.CellIndex);
+				BorderFaces |= GridChangeInfo::GetBlockBorderFaces(BlockKeys, EditCell.CellIndex);
+				if (ActiveChangeTracker && NewCell != CurCell)
+					ActiveChangeTracker->AppendModifiedCell(EditCell.CellIndex, CurCell, NewCell);
+				return true;
+			});
+			if (NumModified > 0)
+				GridChangeInfo::AppendAffectedBlocks(*Grid, BlockIndices[BlockListIndex], BorderFaces, AffectedBlocks);
+		}
+	}
+
+	std::sort(AffectedBlocks.begin(), AffectedBlocks.end());
+	AffectedBlocks.erase(std::unique(AffectedBlocks.begin(), AffectedBlocks.end()), AffectedBlocks.end());
+	if (ModifiedBlocksOut != nullptr)
+		ModifiedBlocksOut->insert(ModifiedBlocksOut->end(), AffectedBlocks.begin(), AffectedBlocks.end());
+	if (Result.bModified)
+	{
+		// all the affected blocks are known, so they can be included in the result
+		Result.ModifiedBlocks = std::move(AffectedBlocks);
+		Result.bHaveModifiedBlocks = true;
+	}
+	return Result;
+}
+
+
+GridChangeInfo ModelGridEditor::EraseCells(const ModelGridCellEditSet& CellEditSet, std::vector<Vector3i>* ModifiedBlocksOut)
+{
+	return EditCells_Batched(CellEditSet, [&](const ModelGridCellEditSet::EditCell& EditCell, const ModelGridCell& CurCell, ModelGridCell& NewCell) {
+		return ComputeErasedCell(CurCell, NewCell);
+	}, ModifiedBlocksOut, true);
+}
+
+GridChangeInfo ModelGridEditor::FillCells(
+	const ModelGridCellEditSet& CellEditSet,
+	const ModelGridCell& FillCell,
+	FunctionRef<bool(const ModelGridCell&)> CellFilterFunc,
+	FunctionRef<void(const ModelGridCell& CurCell, ModelGridCell& NewCell)> NewCellModifierFunc,
+	std::vector<Vector3i>* ModifiedBlocksOut,
+	bool bFuncsAreThreadSafe)
+{
+	return EditCells_Batched(CellEditSet, [&](const ModelGridCellEditSet::EditCell& EditCell, const ModelGridCell& CurCell, ModelGridCell& NewCell) {
+		return ComputeFilledCell(CurCell, NewCell, FillCell, CellFilterFunc, NewCellModifierFunc);
+	}, ModifiedBlocksOut, bFuncsAreThreadSafe);
+}
+
+GridChangeInfo ModelGridEditor::PaintCells(const ModelGridCellEditSet& CellEditSet, const Color3b& NewColor, std::vector<Vector3i>* ModifiedBlocksOut)
+{
+	return EditCells_Batched(CellEditSet, [&](const ModelGridCellEditSet::EditCell& EditCell, const ModelGridCell& CurCell, ModelGridCell& NewCell) {
+		return ComputePaintedCell(CurCell, NewCell, NewColor);
+	}, ModifiedBlocksOut, true);
+}
+
+GridChangeInfo ModelGridEditor::PaintCells_Complex(const ModelGridCellEditSet& CellEditSet, 
+	FunctionRef<Color3b(const ModelGridCell& Cell)> GenerateColorFunc, std::vector<Vector3i>* ModifiedBlocksOut, bool bFuncsAreThreadSafe)
+{
+	return EditCells_Batched(CellEditSet, [&](const ModelGridCellEditSet::EditCell& EditCell, const ModelGridCell& CurCell, ModelGridCell& NewCell) {
+		return ComputePaintedCell_Complex(CurCell, NewCell, GenerateColorFunc);
+	}, ModifiedBlocksOut, bFuncsAreThreadSafe);
+}
+
+GridChangeInfo ModelGridEditor::PaintCells(const ModelGridCellEditSet& CellEditSet, uint8_t NewMaterialIndex, std::vector<Vector3i>* ModifiedBlocksOut)
+{
+	return EditCells_Batched(CellEditSet, [&](const ModelGridCellEditSet::EditCell& EditCell, const ModelGridCell& CurCell, ModelGridCell& NewCell) {
+		return ComputePaintedCell(CurCell, NewCell, NewMaterialIndex);
+	}, ModifiedBlocksOut, true);
+}
+
+GridChangeInfo ModelGridEditor::PaintCellFaces(const ModelGridCellEditSet& CellEditSet, const Color4b& NewColor, std::vector<Vector3i>* ModifiedBlocksOut)
+{
+	return EditCells_Batched(CellEditSet, [&](const ModelGridCellEditSet::EditCell& EditCell, const ModelGridCell& CurCell, ModelGridCell& NewCell) {
+		return ComputePaintedCellFace(CurCell, NewCell, (uint8_t)EditCell.FaceIndex, NewColor);
+	}, ModifiedBlocksOut, true);
+}
+
+
 
 
 void ModelGridEditor::FlipX()
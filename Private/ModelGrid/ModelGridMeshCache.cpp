@@ -5,9 +5,197 @@
 #include "Core/gs_debug.h"
 #include "GenericGrid/BoxIndexing.h"
 
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <bit>
+
 using namespace GS;
 
 
+static uint64_t GetTimestampNS()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void MeshCacheLatencyHistogram::AddSample(uint64_t Nanoseconds)
+{
+	int Bucket = 0;
+	uint64_t Value = Nanoseconds;
+	while (Value > 1 && Bucket < NumBuckets - 1) {
+		Value >>= 1;
+		Bucket++;
+	}
+	Buckets[Bucket]++;
+	Count++;
+	TotalNS += Nanoseconds;
+	uint64_t CurMax = MaxNS.load();
+	while (Nanoseconds > CurMax && MaxNS.compare_exchange_weak(CurMax, Nanoseconds) == false)
+		;
+}
+
+void MeshCacheLatencyHistogram::Reset()
+{
+	Count = 0;
+	TotalNS = 0;
+	MaxNS = 0;
+	for (int k = 0; k < NumBuckets; ++k)
+		Buckets[k] = 0;
+}
+
+double MeshCacheLatencyHistogram::GetMeanMicroseconds() const
+{
+	uint64_t N = Count.load();
+	return (N == 0) ? 0.0 : ((double)TotalNS.load() / (double)N) / 1000.0;
+}
+
+double MeshCacheLatencyHistogram::GetPercentileMicroseconds(double Percentile) const
+{
+	uint64_t N = Count.load();
+	if (N == 0) return 0.0;
+	uint64_t Target = (uint64_t)GS::Clamp(Percentile * (double)N, 1.0, (double)N);
+	uint64_t Accum = 0;
+	for (int k = 0; k < NumBuckets; ++k)
+	{
+		Accum += Buckets[k].load();
+		if (Accum >= Target)
+			return (double)((uint64_t)1 << (k+1)) / 1000.0;
+	}
+	return (double)MaxNS.load() / 1000.0;
+}
+
+
+void ModelGridMeshCacheStats::Reset()
+{
+	BlockBuilds = 0;
+	BlockBuildsWithUnchangedTriangleCount = 0;
+	RequireBlockHits = 0;
+	RequireBlockMisses = 0;
+	CellsMeshed = 0;
+	BoxFacesMeshed = 0;
+	TrianglesMeshed = 0;
+	ColumnExtracts = 0;
+	MergedColumnBuilds = 0;
+	ColumnsEvicted = 0;
+	BlockBuildTime.Reset();
+	MergedColumnBuildTime.Reset();
+	ColumnExtractTime.Reset();
+	MeshesLockWaitTime.Reset();
+	ColumnLockWaitTime.Reset();
+}
+
+static void AppendHistogramJSON(std::string& Out, const char* Name, const MeshCacheLatencyHistogram& Histogram, bool bLast)
+{
+	char Buffer[512];
+	snprintf(Buffer, sizeof(Buffer), "  \"%s\": { \"count\": %llu, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, \"buckets_ns_log2\": [",
+		Name, (unsigned long long)Histogram.Count.load(), Histogram.GetMeanMicroseconds(),
+		Histogram.GetPercentileMicroseconds(0.5), Histogram.GetPercentileMicroseconds(0.99), (double)Histogram.MaxNS.load() / 1000.0);
+	Out += Buffer;
+	for (int k = 0; k < MeshCacheLatencyHistogram::NumBuckets; ++k)
+	{
+		snprintf(Buffer, sizeof(Buffer), (k == 0) ? "%llu" : ",%llu", (unsigned long long)Histogram.Buckets[k].load());
+		Out += Buffer;
+	}
+	Out += (bLast) ? "] }\n" : "] },\n";
+}
+
+std::string ModelGridMeshCacheStats::ToJSON() const
+{
+	std::string Out = "{\n";
+	char Buffer[128];
+	auto AppendCounter = [&](const char* Name, const std::atomic<uint64_t>& Value) {
+		snprintf(Buffer, sizeof(Buffer), "  \"%s\": %llu,\n", Name, (unsigned long long)Value.load());
+		Out += Buffer;
+	};
+	AppendCounter("block_builds", BlockBuilds);
+	AppendCounter("block_builds_unchanged_tricount", BlockBuildsWithUnchangedTriangleCount);
+	AppendCounter("require_block_hits", RequireBlockHits);
+	AppendCounter("require_block_misses", RequireBlockMisses);
+	AppendCounter("cells_meshed", CellsMeshed);
+	AppendCounter("box_faces_meshed", BoxFacesMeshed);
+	AppendCounter("triangles_meshed", TrianglesMeshed);
+	AppendCounter("column_extracts", ColumnExtracts);
+	AppendCounter("merged_column_builds", MergedColumnBuilds);
+	AppendCounter("columns_evicted", ColumnsEvicted);
+	AppendHistogramJSON(Out, "block_build_time", BlockBuildTime, false);
+	AppendHistogramJSON(Out, "merged_column_build_time", MergedColumnBuildTime, false);
+	AppendHistogramJSON(Out, "column_extract_time", ColumnExtractTime, false);
+	AppendHistogramJSON(Out, "meshes_lock_wait", MeshesLockWaitTime, false);
+	AppendHistogramJSON(Out, "column_lock_wait", ColumnLockWaitTime, true);
+	Out += "}\n";
+	return Out;
+}
+
+
+void ModelGridMeshCache::LockMeshes()
+{
+	if (bEnableStats == false) {
+		MeshesLock.lock();
+		return;
+	}
+	if (MeshesLock.try_lock()) {
+		Stats.MeshesLockWaitTime.AddSample(0);
+		return;
+	}
+	uint64_t StartNS = GetTimestampNS();
+	MeshesLock.lock();
+	Stats.MeshesLockWaitTime.AddSample(GetTimestampNS() - StartNS);
+}
+
+void ModelGridMeshCache::LockColumns()
+{
+	if (bEnableStats == false) {
+		ColumnLock.lock();
+		return;
+	}
+	if (ColumnLock.try_lock()) {
+		Stats.ColumnLockWaitTime.AddSample(0);
+		return;
+	}
+	uint64_t StartNS = GetTimestampNS();
+	ColumnLock.lock();
+	Stats.ColumnLockWaitTime.AddSample(GetTimestampNS() - StartNS);
+}
+
+
+ModelGridMeshCache::BlockMeshSlot::~BlockMeshSlot()
+{
+	for (int k = 0; k < 2; ++k)
+	{
+		gs_debug_assert(ReaderCount[k] == 0);
+		if (Meshes[k] != nullptr)
+			delete Meshes[k];
+	}
+}
+
+const IMeshBuilder* ModelGridMeshCache::AcquireFrontMesh(BlockMeshSlot& Slot, int& FrontIndexOut)
+{
+	while (true)
+	{
+		int FrontIndex = Slot.FrontIndex.load();
+		if (FrontIndex < 0)
+			return nullptr;
+		Slot.ReaderCount[FrontIndex]++;
+		// if a new mesh was published in the interim, the builder may already be resetting this one, so try again
+		if (Slot.FrontIndex.load() == FrontIndex)
+		{
+			FrontIndexOut = FrontIndex;
+			return Slot.Meshes[FrontIndex];
+		}
+		Slot.ReaderCount[FrontIndex]--;
+	}
+}
+
+void ModelGridMeshCache::ReleaseFrontMesh(BlockMeshSlot& Slot, int FrontIndex)
+{
+	gs_debug_assert(Slot.ReaderCount[FrontIndex] > 0);
+	Slot.ReaderCount[FrontIndex]--;
+}
+
+
 ModelGridMeshCache::ModelGridMeshCache()
 {
 }
@@ -70,47 +258,54 @@ void ModelGridMeshCache::UpdateChunkRange(const ModelGrid& TargetGrid, const Axi
 	if (ChunkIdxRange.IsValid() == false) return;
 	Vector3i Dims = (Vector3i)ChunkIdxRange.AxisCounts();
 
-	unsafe_vector<Vector3i> UpdateChunks;
-	UpdateChunks.reserve( (Dims.X+1) * (Dims.Y+1) * (Dims.Z+1) );
-
-	unsafe_vector<Vector2i> UpdateColumns;
-
+	std::vector<Vector3i> RangeChunks;
+	RangeChunks.reserve( (Dims.X+1) * (Dims.Y+1) * (Dims.Z+1) );
 	for (int zi = ChunkIdxRange.Min.Z; zi <= ChunkIdxRange.Max.Z; zi++)
 	{
 		for (int yi = ChunkIdxRange.Min.Y; yi <= ChunkIdxRange.Max.Y; yi++)
 		{
 			for (int xi = ChunkIdxRange.Min.X; xi <= ChunkIdxRange.Max.X; xi++)
-			{
-				Vector3i ChunkIndex(xi, yi, zi);
-				if (TargetGrid.IsChunkIndexAllocated(ChunkIndex))
-				{
-					UpdateChunks.add(ChunkIndex);
-					UpdateColumns.add_unique(Vector2i(ChunkIndex.X, ChunkIndex.Y));
+				RangeChunks.push_back(Vector3i(xi, yi, zi));
+		}
+	}
+	UpdateBlocks(TargetGrid, RangeChunks, OnColumnUpdatedFunc);
+}
 
-					if (ChunkMeshes.contains(ChunkIndex) == false)
-					{
-						IMeshBuilder* ChunkMesh = MeshBuilderFactory->Allocate();
-						ChunkMeshes.insert({ ChunkIndex, ChunkMesh });
 
-						AddNewMeshToColumn( ChunkIndex, ChunkMesh );
-					}
-				}
+void ModelGridMeshCache::UpdateBlocks(const ModelGrid& TargetGrid, const std::vector<Vector3i>& BlockIndices, 
+	FunctionRef<void(Vector2i)> OnColumnUpdatedFunc)
+{
+	unsafe_vector<BlockMeshSlot*> UpdateSlots;
+	UpdateSlots.reserve(BlockIndices.size());
+
+	unsafe_vector<Vector2i> UpdateColumns;
+
+	// find or allocate the slots, and pin their columns so that they are not evicted while we are building the meshes
+	LockMeshes();
+	for (Vector3i ChunkIndex : BlockIndices)
+	{
+		if (TargetGrid.IsChunkIndexAllocated(ChunkIndex))
+		{
+			auto found_itr = ChunkMeshes.find(ChunkIndex);
+			BlockMeshSlot* Slot = (found_itr != ChunkMeshes.end()) ? found_itr->second : AllocateBlockSlot(ChunkIndex);
+			UpdateSlots.add(Slot);
+			Vector2i ColumnIndex(ChunkIndex.X, ChunkIndex.Y);
+			if (UpdateColumns.contains(ColumnIndex) == false)
+			{
+				UpdateColumns.add(ColumnIndex);
+				PinColumn(ColumnIndex);
 			}
 		}
 	}
+	MeshesLock.unlock();
 
-	GS::ParallelFor((uint32_t)UpdateChunks.size(), [&](int Index)
+	GS::ParallelFor((uint32_t)UpdateSlots.size(), [&](int Index)
 	{
-		Vector3i ChunkIndex = UpdateChunks[Index];
-		auto found_itr = ChunkMeshes.find(ChunkIndex);
-		if (found_itr != ChunkMeshes.end())
-		{
-			IMeshBuilder* FoundMesh = found_itr->second;
-			FoundMesh->ResetMesh();
-			BuildChunkMeshGeometry(TargetGrid, ChunkIndex, *FoundMesh);
-		}
+		RebuildBlockSlot(TargetGrid, *UpdateSlots[Index]);
 	});
 
+	for (Vector2i v : UpdateColumns)
+		UnpinColumn(v);
 	for (Vector2i v : UpdateColumns)
 		OnColumnUpdatedFunc(v);
 }
@@ -122,43 +317,166 @@ void ModelGridMeshCache::UpdateBlockIndex_Async(const ModelGrid& TargetGrid, Vec
 	// TODO need to somehow make sure we are not processing this block in another thread....
 	// maybe keep a grid of per-block atomics? 
 
-	IMeshBuilder* UseChunkMesh = nullptr;
+	BlockMeshSlot* UseSlot = nullptr;
 
-	MeshesLock.lock();
+	LockMeshes();
 	auto found_itr = ChunkMeshes.find(BlockIndex);
 	if (found_itr == ChunkMeshes.end())
-	{
-		UseChunkMesh = MeshBuilderFactory->Allocate();
-		ChunkMeshes.insert({ BlockIndex, UseChunkMesh });
-		AddNewMeshToColumn(BlockIndex, UseChunkMesh);
-	}
+		UseSlot = AllocateBlockSlot(BlockIndex);
 	else
-	{
-		UseChunkMesh = found_itr->second;
-	}
+		UseSlot = found_itr->second;
+	// pin column so that it is not evicted while we are building the mesh
+	PinColumn(Vector2i(BlockIndex.X, BlockIndex.Y));
 	MeshesLock.unlock();
 
 	UpdatedColumnIndexOut = Vector2i(BlockIndex.X, BlockIndex.Y);
 
-	UseChunkMesh->ResetMesh();
-
 	//ProcessModelGrid([&](const ModelGrid& TargetGrid) {
 	//	BuildChunkMeshGeometry(TargetGrid, BlockIndex, *UseChunkMesh);
 	//});
-	BuildChunkMeshGeometry(TargetGrid, BlockIndex, *UseChunkMesh);
+	RebuildBlockSlot(TargetGrid, *UseSlot);
+
+	UnpinColumn(UpdatedColumnIndexOut);
 }
 
 
+ModelGridMeshCache::BlockMeshSlot* ModelGridMeshCache::AllocateBlockSlot(Vector3i BlockIndex)
+{
+	BlockMeshSlot* NewSlot = new BlockMeshSlot();
+	NewSlot->BlockIndex = BlockIndex;
+	NewSlot->Meshes[0] = MeshBuilderFactory->Allocate();
+	ChunkMeshes.insert({ BlockIndex, NewSlot });
+	AddNewMeshToColumn(BlockIndex, NewSlot);
+	return NewSlot;
+}
+
+
+void ModelGridMeshCache::RebuildBlockSlot(const ModelGrid& TargetGrid, BlockMeshSlot& Slot)
+{
+	uint64_t StartNS = (bEnableStats) ? GetTimestampNS() : 0;
+	int PrevTriCount = -1, NewTriCount = 0;
+
+	size_t TriCount = RebuildSlot(Slot, [&](IMeshBuilder& BackMesh) {
+		BuildChunkMeshGeometry(TargetGrid, Slot.BlockIndex, BackMesh);
+		if (bEnableStats) {
+			int FrontIndex = Slot.FrontIndex.load();		// BuildLock is held so this is still the previous mesh
+			PrevTriCount = (FrontIndex >= 0) ? Slot.Meshes[FrontIndex]->GetTriangleCount() : -1;
+			NewTriCount = BackMesh.GetTriangleCount();
+		}
+	});
+	UpdateColumnMeshSize(Slot.BlockIndex, TriCount * EstimatedBytesPerTriangle);
+
+	if (bEnableStats)
+	{
+		Stats.BlockBuilds++;
+		Stats.TrianglesMeshed += (uint64_t)NewTriCount;
+		if (PrevTriCount == NewTriCount)
+			Stats.BlockBuildsWithUnchangedTriangleCount++;
+		Stats.BlockBuildTime.AddSample(GetTimestampNS() - StartNS);
+	}
+}
+
+
+size_t ModelGridMeshCache::RebuildSlot(BlockMeshSlot& Slot, FunctionRef<void(IMeshBuilder&)> BuildFunc)
+{
+	std::scoped_lock BuildLock(Slot.BuildLock);
+
+	int FrontIndex = Slot.FrontIndex.load();
+	int BackIndex = (FrontIndex == 0) ? 1 : 0;
+	if (Slot.Meshes[BackIndex] == nullptr)
+	{
+		LockMeshes();		// not clear that MeshBuilderFactory is thread-safe
+		Slot.Meshes[BackIndex] = MeshBuilderFactory->Allocate();
+		MeshesLock.unlock();
+	}
+	IMeshBuilder* BackMesh = Slot.Meshes[BackIndex];
+
+	// back mesh was the front mesh before the previous publish, a slow reader may still be using it
+	while (Slot.ReaderCount[BackIndex] > 0)
+		std::this_thread::yield();
+
+	// if the builder supports it, keep its storage and reserve space for the size of the previous build
+	IReusableMeshBuilder* ReusableMesh = dynamic_cast<IReusableMeshBuilder*>(BackMesh);
+	if (ReusableMesh != nullptr)
+		ReusableMesh->ResetMeshAndReserve( (FrontIndex >= 0) ? Slot.Meshes[FrontIndex]->GetTriangleCount() : 0 );
+	else
+		BackMesh->ResetMesh();
+	BuildFunc(*BackMesh);
+
+	// publish
+	Slot.FrontIndex.store(BackIndex);
+
+	// previous front mesh is kept as the next back mesh, so it is included in the size
+	size_t TriCount = (size_t)BackMesh->GetTriangleCount();
+	if (FrontIndex >= 0)
+		TriCount += (size_t)Slot.Meshes[FrontIndex]->GetTriangleCount();
+	return TriCount;
+}
+
+
+void ModelGridMeshCache::UpdateMergedColumnMesh_Async(const ModelGrid& TargetGrid, Vector2i ColumnIndex)
+{
+	uint64_t StartNS = (bEnableStats) ? GetTimestampNS() : 0;
+
+	LockColumns();
+	ColumnCache* Column = nullptr;
+	auto found_itr = ZColumns.find(ColumnIndex);
+	if (found_itr == ZColumns.end())
+	{
+		Column = new ColumnCache();
+		Column->ColumnIndex = ColumnIndex;
+		Column->ColumnCenter = Vector3d::Zero();
+		ZColumns.insert({ ColumnIndex, Column });
+	}
+	else
+		Column = found_itr->second;
+	Column->PinCount++;
+	Column->LastUsedTimestamp = UsageCounter++;
+	ColumnLock.unlock();
+
+	BlockMeshSlot& Slot = Column->MergedMeshSlot;
+
+	// IMeshBuilder is append-only, so we cannot patch a single block range in-place, the entire column is re-meshed
+	int NewTriCount = 0;
+	size_t TriCount = RebuildSlot(Slot, [&](IMeshBuilder& BackMesh) {
+		TargetGrid.EnumerateOccupiedColumnBlocks(ColumnIndex, [&](Vector3i BlockIndex) {
+			BuildChunkMeshGeometry(TargetGrid, BlockIndex, BackMesh);
+		});
+		NewTriCount = BackMesh.GetTriangleCount();
+	});
+
+	LockColumns();
+	size_t NewMergedBytes = TriCount * EstimatedBytesPerTriangle;
+	Column->ColumnMeshBytes = Column->ColumnMeshBytes - Column->MergedMeshBytes + NewMergedBytes;
+	CachedMeshBytes -= Column->MergedMeshBytes;
+	CachedMeshBytes += NewMergedBytes;
+	Column->MergedMeshBytes = NewMergedBytes;
+	gs_debug_assert(Column->PinCount > 0);
+	Column->PinCount--;
+	ColumnLock.unlock();
+
+	if (bEnableStats)
+	{
+		Stats.MergedColumnBuilds++;
+		Stats.TrianglesMeshed += (uint64_t)NewTriCount;
+		Stats.MergedColumnBuildTime.AddSample(GetTimestampNS() - StartNS);
+	}
+}
+
 
 bool ModelGridMeshCache::RequireBlockIndex_Async(const ModelGrid& TargetGrid, Vector3i BlockIndex, Vector2i& ColumnIndexOut)
 {
 	bool bMeshExists = false;
-	MeshesLock.lock();
+	LockMeshes();
 	auto found_itr = ChunkMeshes.find(BlockIndex);
-	if (found_itr != ChunkMeshes.end() && found_itr->second->GetTriangleCount() > 0)
+	if (found_itr != ChunkMeshes.end() && found_itr->second->HasPublishedMesh())
 		bMeshExists = true;
 	MeshesLock.unlock();
 
+	if (bEnableStats) {
+		if (bMeshExists) Stats.RequireBlockHits++; else Stats.RequireBlockMisses++;
+	}
+
 	ColumnIndexOut = Vector2i(BlockIndex.X, BlockIndex.Y);
 	if (bMeshExists == false)
 		UpdateBlockIndex_Async(TargetGrid, BlockIndex, ColumnIndexOut);
@@ -168,9 +486,9 @@ bool ModelGridMeshCache::RequireBlockIndex_Async(const ModelGrid& TargetGrid, Ve
 
 
 
-void ModelGridMeshCache::AddNewMeshToColumn(Vector3i ChunkIndex, const IMeshBuilder* MeshBuilderIn)
+void ModelGridMeshCache::AddNewMeshToColumn(Vector3i ChunkIndex, BlockMeshSlot* Slot)
 {
-	ColumnLock.lock();
+	LockColumns();
 
 	Vector2i ColumnIndex(ChunkIndex.X, ChunkIndex.Y);
 	auto found_itr = ZColumns.find(ColumnIndex);
@@ -181,7 +499,9 @@ void ModelGridMeshCache::AddNewMeshToColumn(Vector3i ChunkIndex, const IMeshBuil
 
 		Cache->ColumnCenter = Vector3d::Zero();
 		Cache->ColumnChunks.add(ChunkIndex);
-		Cache->ColumnChunkMeshes.add(MeshBuilderIn);
+		Cache->ColumnChunkSlots.add(Slot);
+		Cache->ColumnChunkMeshBytes.add(0);
+		Cache->LastUsedTimestamp = UsageCounter++;
 		
 		ZColumns.insert({ ColumnIndex, Cache });
 	}
@@ -190,60 +510,144 @@ void ModelGridMeshCache::AddNewMeshToColumn(Vector3i ChunkIndex, const IMeshBuil
 		ColumnCache* Found = found_itr->second;
 		gs_debug_assert(Found->ColumnChunks.contains(ChunkIndex) == false);
 		Found->ColumnChunks.add(ChunkIndex);
-		Found->ColumnChunkMeshes.add(MeshBuilderIn);
+		Found->ColumnChunkSlots.add(Slot);
+		Found->ColumnChunkMeshBytes.add(0);
 	}
 
 	ColumnLock.unlock();
 }
 
 
+void ModelGridMeshCache::PinColumn(Vector2i ColumnIndex)
+{
+	LockColumns();
+	auto found_itr = ZColumns.find(ColumnIndex);
+	if (found_itr != ZColumns.end())
+	{
+		found_itr->second->PinCount++;
+		found_itr->second->LastUsedTimestamp = UsageCounter++;
+	}
+	ColumnLock.unlock();
+}
+
+void ModelGridMeshCache::UnpinColumn(Vector2i ColumnIndex)
+{
+	LockColumns();
+	auto found_itr = ZColumns.find(ColumnIndex);
+	if (found_itr != ZColumns.end())
+	{
+		gs_debug_assert(found_itr->second->PinCount > 0);
+		found_itr->second->PinCount--;
+	}
+	ColumnLock.unlock();
+}
+
+void ModelGridMeshCache::UpdateColumnMeshSize(Vector3i ChunkIndex, size_t NewMeshBytes)
+{
+	LockColumns();
+	auto found_itr = ZColumns.find(Vector2i(ChunkIndex.X, ChunkIndex.Y));
+	if (found_itr != ZColumns.end())
+	{
+		ColumnCache* Found = found_itr->second;
+		int64_t ChunkIdx = Found->ColumnChunks.index_of(ChunkIndex);
+		if (ChunkIdx >= 0)
+		{
+			size_t PrevMeshBytes = Found->ColumnChunkMeshBytes[ChunkIdx];
+			Found->ColumnChunkMeshBytes[ChunkIdx] = NewMeshBytes;
+			Found->ColumnMeshBytes = Found->ColumnMeshBytes - PrevMeshBytes + NewMeshBytes;
+			CachedMeshBytes -= PrevMeshBytes;
+			CachedMeshBytes += NewMeshBytes;
+		}
+	}
+	ColumnLock.unlock();
+}
+
+
 
 void ModelGridMeshCache::ExtractFullMesh(IMeshCollector& Collector)
 {
 	for (const auto& ChunkMeshPair : ChunkMeshes)
-		Collector.AppendMesh(ChunkMeshPair.second);
+	{
+		int FrontIndex = -1;
+		const IMeshBuilder* Mesh = AcquireFrontMesh(*ChunkMeshPair.second, FrontIndex);
+		if (Mesh != nullptr)
+		{
+			Collector.AppendMesh(Mesh);
+			ReleaseFrontMesh(*ChunkMeshPair.second, FrontIndex);
+		}
+	}
 }
 
 
 void ModelGridMeshCache::ExtractColumnMesh_Async(Vector2i ColumnIndex, IMeshCollector& Collector, bool bReleaseAllMeshes)
 {
-	// TODO this function is not really thread-safe because the meshes in TempColumnChunkMeshes could
-	// be deleted or modified. We should be storing shared pointers to something that has the mesh and
-	// a lock, so that even if other places discard this mesh, we can still keep using it here
+	// column is pinned while we read, so the slots cannot be deleted (except via bReleaseAllMeshes), and
+	// acquiring the front mesh of each slot means a concurrent rebuild will not modify it
 
-	unsafe_vector<const IMeshBuilder*> TempColumnChunkMeshes;
-	ColumnLock.lock();
+	uint64_t StartNS = (bEnableStats) ? GetTimestampNS() : 0;
+
+	unsafe_vector<BlockMeshSlot*> TempColumnChunkSlots;
+	LockColumns();
 	//ColumnCache** Found = ZColumns.Find(ColumnIndex);
 	auto found_itr = ZColumns.find(ColumnIndex);
 	ColumnCache* Found = nullptr;
 	if (found_itr != ZColumns.end()) {
 		Found = found_itr->second;
-		TempColumnChunkMeshes = Found->ColumnChunkMeshes;
+		TempColumnChunkSlots = Found->ColumnChunkSlots;
+		// pin column so that the meshes are not evicted while we are reading them
+		Found->PinCount++;
+		Found->LastUsedTimestamp = UsageCounter++;
 	}
 	ColumnLock.unlock();
 
 	if (Found == nullptr) return;
 
-	// TODO: really do need some locking here but for current testing once mesh is generated it is never modified...
-	//MeshesLock.lock();
-	for (const IMeshBuilder* Mesh : TempColumnChunkMeshes)
-		Collector.AppendMesh(Mesh);
-	//MeshesLock.unlock();
+	// if there is a merged column mesh we can pass it as a single mesh. Column is pinned so Found is still valid.
+	int MergedFrontIndex = -1;
+	const IMeshBuilder* MergedMesh = AcquireFrontMesh(Found->MergedMeshSlot, MergedFrontIndex);
+	if (MergedMesh != nullptr)
+	{
+		Collector.AppendMesh(MergedMesh);
+		ReleaseFrontMesh(Found->MergedMeshSlot, MergedFrontIndex);
+		TempColumnChunkSlots.clear();
+	}
+
+	for (BlockMeshSlot* Slot : TempColumnChunkSlots)
+	{
+		int FrontIndex = -1;
+		const IMeshBuilder* Mesh = AcquireFrontMesh(*Slot, FrontIndex);
+		if (Mesh != nullptr)
+		{
+			Collector.AppendMesh(Mesh);
+			ReleaseFrontMesh(*Slot, FrontIndex);
+		}
+	}
+
+	UnpinColumn(ColumnIndex);
+
+	if (bEnableStats)
+	{
+		Stats.ColumnExtracts++;
+		Stats.ColumnExtractTime.AddSample(GetTimestampNS() - StartNS);
+	}
 	
 	if (bReleaseAllMeshes)
 	{
-		MeshesLock.lock();
-		ColumnLock.lock();
+		LockMeshes();
+		LockColumns();
 		// Found above is a pointer into ZColumns, so we have to find it again in case ZColumns was modified in the interim
 		found_itr = ZColumns.find(ColumnIndex);
 		//Found = ZColumns.Find(ColumnIndex);
-		if (found_itr != ZColumns.end())
+		// if another thread has pinned the column in the interim, it is building or extracting meshes and we cannot release them
+		if (found_itr != ZColumns.end() && found_itr->second->PinCount == 0)
 		{
 			Found = found_itr->second;
 			for (Vector3i Block : Found->ColumnChunks) {
 				delete ChunkMeshes[Block];
 				ChunkMeshes.erase(Block);
 			}
+			CachedMeshBytes -= Found->ColumnMeshBytes;
+			delete Found;
 			ZColumns.erase(ColumnIndex);
 		}
 		ColumnLock.unlock();
@@ -252,14 +656,65 @@ void ModelGridMeshCache::ExtractColumnMesh_Async(Vector2i ColumnIndex, IMeshColl
 }
 
 
+
+int ModelGridMeshCache::EnforceMeshMemoryBudget()
+{
+	if (MeshMemoryBudgetBytes == 0 || CachedMeshBytes <= MeshMemoryBudgetBytes) 
+		return 0;
+
+	int NumEvicted = 0;
+	LockMeshes();
+	LockColumns();
+
+	// sort evictable columns from least- to most-recently used
+	unsafe_vector<ColumnCache*> SortedColumns;
+	SortedColumns.reserve(ZColumns.size());
+	for (auto pair : ZColumns)
+	{
+		if (pair.second->PinCount == 0)
+			SortedColumns.add(pair.second);
+	}
+	std::sort(SortedColumns.begin(), SortedColumns.end(), [](const ColumnCache* A, const ColumnCache* B) {
+		return A->LastUsedTimestamp < B->LastUsedTimestamp;
+	});
+
+	for (ColumnCache* Column : SortedColumns)
+	{
+		if (CachedMeshBytes <= MeshMemoryBudgetBytes)
+			break;
+
+		for (Vector3i Block : Column->ColumnChunks) {
+			delete ChunkMeshes[Block];
+			ChunkMeshes.erase(Block);
+		}
+		CachedMeshBytes -= Column->ColumnMeshBytes;
+		ZColumns.erase(Column->ColumnIndex);
+		delete Column;
+		NumEvicted++;
+	}
+
+	ColumnLock.unlock();
+	MeshesLock.unlock();
+	if (bEnableStats)
+		Stats.ColumnsEvicted += (uint64_t)NumEvicted;
+	return NumEvicted;
+}
+
+
 void ModelGridMeshCache::BuildChunkMeshGeometry(const ModelGrid& TargetGrid, Vector3i ChunkIndex, IMeshBuilder& Mesh)
 {
-	ModelGridMesher::AppendCache Cache;
+	// AppendCache is scratch space, reuse it across calls on the same thread to avoid re-allocating it for each block.
+	// (InitAppendCache() does not allocate if the cache has already been initialized)
+	static thread_local ModelGridMesher::AppendCache Cache;
 	MeshBuilder.InitAppendCache(Cache);
 
+	uint64_t NumCells = 0, NumBoxFaces = 0;
+
 	TargetGrid.EnumerateFilledChunkCells(ChunkIndex,
 		[&](ModelGrid::CellKey CellKey, const ModelGridCell& CellInfo, const AxisBox3d& LocalBounds)
 	{
+		NumCells++;
+
 		// determine cell color...maybe UseMaterials.FaceMaterials can be a pointer?
 		ModelGridMesher::CellMaterials UseMaterials;
 		UseMaterials.CellType = CellInfo.MaterialType;
@@ -289,6 +744,7 @@ void ModelGridMeshCache::BuildChunkMeshGeometry(const ModelGrid& TargetGrid, Vec
 			}
 			if (VisibleFaces > 0)
 			{
+				NumBoxFaces += (uint64_t)std::popcount((uint32_t)VisibleFaces);
 				MeshBuilder.AppendBoxFaces(LocalBounds, UseMaterials, VisibleFaces, Mesh, Cache);
 			}
 		}
@@ -342,4 +798,10 @@ void ModelGridMeshCache::BuildChunkMeshGeometry(const ModelGrid& TargetGrid, Vec
 
 		}
 	});
+
+	if (bEnableStats)
+	{
+		Stats.CellsMeshed += NumCells;
+		Stats.BoxFacesMeshed += NumBoxFaces;
+	}
 }
@@ -0,0 +1,366 @@
+// Copyright Gradientspace Corp. All Rights Reserved.
+#include "WorldGrid/WorldGridCollisionManager.h"
+#include "WorldGrid/WorldGridSystem.h"
+#include "WorldGrid/WorldGridDB.h"
+#include "Intersection/GSRayBoxIntersection.h"
+#include "Core/ParallelFor.h"
+#include "Core/gs_debug.h"
+
+#include <algorithm>
+
+using namespace GS;
+
+
+WorldGridCollisionManager::~WorldGridCollisionManager()
+{
+	Shutdown();
+}
+
+void WorldGridCollisionManager::Initialize(WorldGridSystem* TargetSystemIn)
+{
+	gs_debug_assert(TargetSystem == nullptr);
+	TargetSystem = TargetSystemIn;
+	GridDB = &TargetSystem->DebugAccessDB();
+
+	// regions that were loaded before we were registered as a client
+	unsafe_vector<WorldGridRegionIndex> LoadedRegions;
+	GridDB->EnumerateLoadedRegions_Blocking([&](WorldGridRegionIndex RegionIndex, const AxisBox3d& RegionBounds) {
+		LoadedRegions.add(RegionIndex);
+	});
+
+	TargetSystem->RegisterClient(this);
+
+	for (WorldGridRegionIndex RegionIndex : LoadedRegions)
+	{
+		AddRegion(RegionIndex);
+		PendingLock.lock();
+		PendingRegionUpdates.add_unique(RegionIndex);
+		PendingLock.unlock();
+	}
+}
+
+void WorldGridCollisionManager::Shutdown()
+{
+	if (TargetSystem != nullptr)
+	{
+		TargetSystem->UnregisterClient(this);
+		TargetSystem = nullptr;
+		GridDB = nullptr;
+	}
+
+	RegionsLock.lock();
+	Regions.clear();
+	RegionsLock.unlock();
+
+	PendingLock.lock();
+	PendingColumnUpdates.clear();
+	PendingRegionUpdates.clear();
+	PendingCellUpdates.clear();
+	PendingLock.unlock();
+}
+
+
+void WorldGridCollisionManager::AddRegion(WorldGridRegionIndex RegionIndex)
+{
+	std::shared_ptr<RegionCollider> NewRegion = std::make_shared<RegionCollider>();
+	NewRegion->RegionIndex = RegionIndex;
+	NewRegion->WorldBounds = GridDB->GetRegionWorldBounds(RegionIndex);
+	// see WorldGridDB::CellIndexToRegionAndBlockCellIndex(), region ModelGrid cell keys are signed
+	NewRegion->LocalToWorldCell = (Vector3i)GridDB->GetRegionIndexRange(RegionIndex).Min + ModelGrid::ModelGridDimensions() / 2;
+
+	RegionsLock.lock();
+	if (Regions.find(RegionIndex) == Regions.end())
+		Regions[RegionIndex] = NewRegion;
+	RegionsLock.unlock();
+}
+
+
+void WorldGridCollisionManager::OnGridRegionLoaded_Async(WorldGridRegionHandle Handle)
+{
+	// region is empty at this point, collider will be built by column updates as blocks are generated or loaded
+	AddRegion(Handle.BlockIndex);
+}
+
+void WorldGridCollisionManager::OnGridRegionUnloaded_Async(WorldGridRegionHandle Handle)
+{
+	// in-progress queries hold their own reference to the region
+	RegionsLock.lock();
+	Regions.erase(Handle.BlockIndex);
+	RegionsLock.unlock();
+
+	PendingLock.lock();
+	PendingColumnUpdates.erase(Handle.BlockIndex);
+	PendingCellUpdates.erase(Handle.BlockIndex);
+	int64_t PendingIndex = PendingRegionUpdates.index_of(Handle.BlockIndex);
+	if (PendingIndex >= 0)
+		PendingRegionUpdates.remove_at(PendingIndex);
+	PendingLock.unlock();
+}
+
+void WorldGridCollisionManager::OnGridRegionMeshUpdated_Async(WorldGridMeshUpdate MeshUpdate)
+{
+	if (MeshUpdate.WorldHandle.MeshType != EWorldGridMeshType::RegionColumn)
+		return;
+	if (bIgnoreEditMeshUpdates && MeshUpdate.Identifier != WorldGridSystem::Identifier_InitialSpawn())
+		return;
+
+	PendingLock.lock();
+	PendingColumnUpdates[MeshUpdate.WorldHandle.RegionHandle.BlockIndex].add_unique(MeshUpdate.WorldHandle.RegionColumnIndex);
+	PendingLock.unlock();
+}
+
+void WorldGridCollisionManager::MarkRegionBlocksModified(WorldGridRegionIndex RegionIndex, const unsafe_vector<Vector3i>& ModelGridBlocks)
+{
+	PendingLock.lock();
+	unsafe_vector<Vector2i>& Columns = PendingColumnUpdates[RegionIndex];
+	for (Vector3i BlockIndex : ModelGridBlocks)
+		Columns.add_unique(Vector2i(BlockIndex.X, BlockIndex.Y));
+	PendingLock.unlock();
+}
+
+void WorldGridCollisionManager::MarkCellsModified(const unsafe_vector<WorldGridCellIndex>& ModifiedCells)
+{
+	if (GridDB == nullptr) return;
+
+	PendingLock.lock();
+	for (WorldGridCellIndex CellIndex : ModifiedCells)
+		PendingCellUpdates[GridDB->CellIndexToRegionIndex(CellIndex)].push_back((Vector3i)CellIndex);
+	PendingLock.unlock();
+}
+
+
+void WorldGridCollisionManager::UpdatePendingColliders()
+{
+	if (GridDB == nullptr) return;
+
+	std::unordered_map<WorldGridRegionIndex, unsafe_vector<Vector2i>> ColumnUpdates;
+	unsafe_vector<WorldGridRegionIndex> RegionUpdates;
+	std::unordered_map<WorldGridRegionIndex, std::vector<Vector3i>> CellUpdates;
+	PendingLock.lock();
+	std::swap(ColumnUpdates, PendingColumnUpdates);
+	std::swap(RegionUpdates, PendingRegionUpdates);
+	std::swap(CellUpdates, PendingCellUpdates);
+	PendingLock.unlock();
+
+	struct RegionUpdate
+	{
+		std::shared_ptr<RegionCollider> Region;
+		bool bFullUpdate;
+		const unsafe_vector<Vector2i>* Columns;
+		const std::vector<Vector3i>* Cells;
+	};
+	std::vector<RegionUpdate> Updates;
+	unsafe_vector<Vector2i> NoColumns;
+	std::vector<Vector3i> NoCells;
+
+	RegionsLock.lock();
+	for (WorldGridRegionIndex RegionIndex : RegionUpdates)
+	{
+		auto found_itr = Regions.find(RegionIndex);
+		if (found_itr != Regions.end())
+			Updates.push_back(RegionUpdate{ found_itr->second, true, &NoColumns, &NoCells });
+	}
+	for (const auto& Pair : ColumnUpdates)
+	{
+		if (RegionUpdates.contains(Pair.first)) continue;
+		auto found_itr = Regions.find(Pair.first);
+		if (found_itr == Regions.end()) continue;
+		auto found_cells_itr = CellUpdates.find(Pair.first);
+		const std::vector<Vector3i>* Cells = (found_cells_itr != CellUpdates.end()) ? &found_cells_itr->second : &NoCells;
+		Updates.push_back(RegionUpdate{ found_itr->second, false, &Pair.second, Cells });
+	}
+	for (const auto& Pair : CellUpdates)
+	{
+		if (RegionUpdates.contains(Pair.first) || ColumnUpdates.contains(Pair.first)) continue;
+		auto found_itr = Regions.find(Pair.first);
+		if (found_itr != Regions.end())
+			Updates.push_back(RegionUpdate{ found_itr->second, false, &NoColumns, &Pair.second });
+	}
+	RegionsLock.unlock();
+
+	GS::ParallelFor((uint32_t)Updates.size(), [&](int i)
+	{
+		UpdateRegionCollider(*Updates[i].Region, Updates[i].bFullUpdate, *Updates[i].Columns, *Updates[i].Cells);
+	});
+}
+
+
+void WorldGridCollisionManager::UpdateRegionCollider(RegionCollider& Region, bool bFullUpdate, const unsafe_vector<Vector2i>& Columns, const std::vector<Vector3i>& WorldCells)
+{
+	GridDB->ProcessRegion_Blocking(Region.RegionIndex, [&](const ModelGrid& RegionGrid, const WorldRegionModelGridInfo& ExtendedInfo)
+	{
+		std::scoped_lock region_collider_lock(Region.ColliderLock);
+
+		if (Region.bColliderInitialized == false)
+		{
+			Region.Collider.Initialize(RegionGrid);
+			Region.LocalToWorld = Region.WorldBounds.Min - RegionGrid.GetChunkBounds(Vector3i::Zero()).Min;
+			Region.bColliderInitialized = true;
+			bFullUpdate = true;
+		}
+
+		if (bFullUpdate)
+		{
+			Region.Collider.UpdateInBounds(RegionGrid, Region.WorldBounds.Translated(-Region.LocalToWorld));
+			return;
+		}
+
+		// Update each modified column, and a 1-cell border around it. Changes to cells on the column boundary
+		// can change which cells are on the surface in the neighbouring blocks.
+		constexpr int NumBlocksZ = ModelGrid::ModelGridDimensions().Z / ModelGrid::BlockSize_Z;
+		Vector3d BorderXY(RegionGrid.CellSize().X * 0.5, RegionGrid.CellSize().Y * 0.5, 0);
+		for (Vector2i ColumnIndex : Columns)
+		{
+			AxisBox3d ColumnBounds = RegionGrid.GetChunkBounds(Vector3i(ColumnIndex.X, ColumnIndex.Y, 0));
+			ColumnBounds.Contain(RegionGrid.GetChunkBounds(Vector3i(ColumnIndex.X, ColumnIndex.Y, NumBlocksZ - 1)));
+			ColumnBounds = AxisBox3d(ColumnBounds.Min - BorderXY, ColumnBounds.Max + BorderXY);
+			Region.Collider.UpdateInBounds(RegionGrid, ColumnBounds);
+		}
+
+		// incremental update for individual modified cells
+		if (WorldCells.size() > 0)
+		{
+			std::vector<Vector3i> LocalCellKeys;
+			LocalCellKeys.reserve(WorldCells.size());
+			for (Vector3i WorldCell : WorldCells)
+				LocalCellKeys.push_back(WorldCell - Region.LocalToWorldCell);
+			Region.Collider.UpdateModifiedCells(RegionGrid, LocalCellKeys);
+		}
+	});
+}
+
+
+void WorldGridCollisionManager::CollectRegionsInBounds(const AxisBox3d& WorldBounds, std::vector<std::shared_ptr<RegionCollider>>& RegionsOut) const
+{
+	RegionsLock.lock();
+	for (const auto& Pair : Regions)
+	{
+		const AxisBox3d& RegionBounds = Pair.second->WorldBounds;
+		bool bOverlaps = true;
+		for (int k = 0; k < 3; ++k)
+			bOverlaps = bOverlaps && (RegionBounds.Min[k] <= WorldBounds.Max[k]) && (RegionBounds.Max[k] >= WorldBounds.Min[k]);
+		if (bOverlaps)
+			RegionsOut.push_back(Pair.second);
+	}
+	RegionsLock.unlock();
+}
+
+
+bool WorldGridCollisionManager::FindNearestHitCell(const Ray3d& WorldRay, double& RayParameterOut, Vector3d& HitNormalOut, WorldGridCellIndex& CellIndexOut) const
+{
+	// find regions that the ray passes through, and sort them by ray entry time. Regions do not overlap, so
+	// the first region that has a hit contains the nearest hit.
+	struct RegionHit
+	{
+		double RayT;
+		std::shared_ptr<RegionCollider> Region;
+	};
+	std::vector<RegionHit> HitRegions;
+	RegionsLock.lock();
+	for (const auto& Pair : Regions)
+	{
+		double RayT = GS::TestRayBoxIntersection(WorldRay, Pair.second->WorldBounds);
+		if (RayT < Mathd::SafeMaxValue())
+			HitRegions.push_back(RegionHit{ RayT, Pair.second });
+	}
+	RegionsLock.unlock();
+	std::sort(HitRegions.begin(), HitRegions.end(), [](const RegionHit& A, const RegionHit& B) { return A.RayT < B.RayT; });
+
+	for (const RegionHit& Hit : HitRegions)
+	{
+		const RegionCollider& Region = *Hit.Region;
+		if (Region.bColliderInitialized == false)
+			continue;
+
+		// region transform is a translation, so ray parameter is the same in local coordinates
+		Ray3d LocalRay(WorldRay.Origin - Region.LocalToWorld, WorldRay.Direction);
+		Vector3i LocalCellKey;
+		if (Region.Collider.FindNearestHitCell(LocalRay, RayParameterOut, HitNormalOut, LocalCellKey))
+		{
+			CellIndexOut = WorldGridCellIndex(LocalCellKey + Region.LocalToWorldCell);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+bool WorldGridCollisionManager::SweepBox(const AxisBox3d& WorldBox, const Vector3d& Delta, double& TimeOfImpactOut, Vector3d& ContactNormalOut, WorldGridCellIndex& CellIndexOut) const
+{
+	AxisBox3d SweptBounds = WorldBox;
+	SweptBounds.Contain(WorldBox.Min + Delta);
+	SweptBounds.Contain(WorldBox.Max + Delta);
+	std::vector<std::shared_ptr<RegionCollider>> SweptRegions;
+	CollectRegionsInBounds(SweptBounds, SweptRegions);
+
+	// cells in different regions may be hit at the same time, so all regions must be tested
+	bool bHit = false;
+	TimeOfImpactOut = Mathd::SafeMaxValue();
+	for (const std::shared_ptr<RegionCollider>& RegionPtr : SweptRegions)
+	{
+		const RegionCollider& Region = *RegionPtr;
+		if (Region.bColliderInitialized == false)
+			continue;
+
+		double TimeOfImpact = 0; Vector3d Normal; Vector3i LocalCellKey;
+		if (Region.Collider.SweepBox(WorldBox.Translated(-Region.LocalToWorld), Delta, TimeOfImpact, Normal, LocalCellKey) && TimeOfImpact < TimeOfImpactOut)
+		{
+			bHit = true;
+			TimeOfImpactOut = TimeOfImpact;
+			ContactNormalOut = Normal;
+			CellIndexOut = WorldGridCellIndex(LocalCellKey + Region.LocalToWorldCell);
+		}
+	}
+	return bHit;
+}
+
+
+bool WorldGridCollisionManager::SweepCapsule(const Vector3d& WorldCenter, double HalfHeight, double Radius, const Vector3d& Delta,
+	double& TimeOfImpactOut, Vector3d& ContactNormalOut, WorldGridCellIndex& CellIndexOut) const
+{
+	Vector3d Extents(Radius, Radius, HalfHeight + Radius);
+	AxisBox3d SweptBounds(WorldCenter - Extents, WorldCenter + Extents);
+	SweptBounds.Contain(WorldCenter + Delta - Extents);
+	SweptBounds.Contain(WorldCenter + Delta + Extents);
+	std::vector<std::shared_ptr<RegionCollider>> SweptRegions;
+	CollectRegionsInBounds(SweptBounds, SweptRegions);
+
+	bool bHit = false;
+	TimeOfImpactOut = Mathd::SafeMaxValue();
+	for (const std::shared_ptr<RegionCollider>& RegionPtr : SweptRegions)
+	{
+		const RegionCollider& Region = *RegionPtr;
+		if (Region.bColliderInitialized == false)
+			continue;
+
+		double TimeOfImpact = 0; Vector3d Normal; Vector3i LocalCellKey;
+		if (Region.Collider.SweepCapsule(WorldCenter - Region.LocalToWorld, HalfHeight, Radius, Delta, TimeOfImpact, Normal, LocalCellKey) && TimeOfImpact < TimeOfImpactOut)
+		{
+			bHit = true;
+			TimeOfImpactOut = TimeOfImpact;
+			ContactNormalOut = Normal;
+			CellIndexOut = WorldGridCellIndex(LocalCellKey + Region.LocalToWorldCell);
+		}
+	}
+	return bHit;
+}
+
+
+void WorldGridCollisionManager::FindOverlappingCells(const AxisBox3d& WorldBox, unsafe_vector<WorldGridCellIndex>& CellsOut) const
+{
+	CellsOut.clear(false);
+	std::vector<std::shared_ptr<RegionCollider>> OverlapRegions;
+	CollectRegionsInBounds(WorldBox, OverlapRegions);
+
+	unsafe_vector<Vector3i> LocalCellKeys;
+	for (const std::shared_ptr<RegionCollider>& RegionPtr : OverlapRegions)
+	{
+		const RegionCollider& Region = *RegionPtr;
+		if (Region.bColliderInitialized == false)
+			continue;
+
+		Region.Collider.FindOverlappingCells(WorldBox.Translated(-Region.LocalToWorld), LocalCellKeys);
+		for (const Vector3i& LocalCellKey : LocalCellKeys)
+			CellsOut.add(WorldGridCellIndex(LocalCellKey + Region.LocalToWorldCell));
+	}
+}
@@ -59,6 +59,9 @@ void WorldGridSystem::OnNewWorldRegionCreated_Async(WorldGridRegionIndex RegionI
 	NewRegion->MeshFactory = MeshSystemAPI->GetOrCreateMeshBuilderForRegionFunc(RegionIndex);
 	NewRegion->MeshCache = std::make_unique<ModelGridMeshCache>();
 	NewRegion->MeshCache->Initialize(WorldParamters.CellDimensions, NewRegion->MeshFactory.get());
+	if (WorldParamters.CachingPolicy == EWorldGridMeshCachingPolicy::BudgetedCache)
+		NewRegion->MeshCache->SetMeshMemoryBudget(WorldParamters.MeshCacheBudgetBytes);
+	NewRegion->MeshCache->bEnableStats = WorldParamters.bEnableMeshCacheStats;
 
 	// avoids occlusion issues but way too expensive to do for the entire grid...maybe could
 	// dynamically do for immediate grid?
@@ -77,6 +80,28 @@ void WorldGridSystem::OnNewWorldRegionCreated_Async(WorldGridRegionIndex RegionI
 }
 
 
+std::string WorldGridSystem::GetMeshCacheStatsJSON()
+{
+	if (WorldParamters.bEnableMeshCacheStats == false)
+		return "{}\n";
+
+	std::string Result = "{\n";
+	LiveRegionsLock.lock();
+	bool bFirst = true;
+	for (auto& pair : LiveRegions)
+	{
+		char RegionName[128];
+		snprintf(RegionName, sizeof(RegionName), "%s\"region_%d_%d_%d\": ", (bFirst) ? "" : ",\n", pair.first.X, pair.first.Y, pair.first.Z);
+		Result += RegionName;
+		Result += pair.second->MeshCache->Stats.ToJSON();
+		bFirst = false;
+	}
+	LiveRegionsLock.unlock();
+	Result += "}\n";
+	return Result;
+}
+
+
 void WorldGridSystem::OnWorldRegionDestroyed_Async(WorldGridRegionIndex RegionIndex)
 {
 	GS_LOG("WorldGrid region destroyed! %d %d %d", RegionIndex.X, RegionIndex.Y, RegionIndex.Z);
@@ -633,14 +658,23 @@ GS::TaskContainer WorldGridSystem::SpawnUpdateMeshesJob_Async(
 		// updated modified blocks
 		std::vector<Vector2i> BlockColumnIndices;
 		BlockColumnIndices.resize(ModelGridBlocks.size());
-		GridDB.ProcessRegion_Blocking(RegionIndex, [&](const ModelGrid& RegionGrid, const WorldRegionModelGridInfo& ExtendedInfo) {
-			GS::ParallelFor((uint32_t)ModelGridBlocks.size(), [&](int i)
-			{
-				Vector2i ColumnIndex;
-				Region->MeshCache->UpdateBlockIndex_Async(RegionGrid, ModelGridBlocks[i], ColumnIndex);
-				BlockColumnIndices[i] = ColumnIndex;
+		if (WorldParamters.bMergeColumnMeshes)
+		{
+			// block meshes are not used, merged column mesh is rebuilt below
+			for (size_t i = 0; i < ModelGridBlocks.size(); ++i)
+				BlockColumnIndices[i] = Vector2i(ModelGridBlocks[i].X, ModelGridBlocks[i].Y);
+		}
+		else
+		{
+			GridDB.ProcessRegion_Blocking(RegionIndex, [&](const ModelGrid& RegionGrid, const WorldRegionModelGridInfo& ExtendedInfo) {
+				GS::ParallelFor((uint32_t)ModelGridBlocks.size(), [&](int i)
+				{
+					Vector2i ColumnIndex;
+					Region->MeshCache->UpdateBlockIndex_Async(RegionGrid, ModelGridBlocks[i], ColumnIndex);
+					BlockColumnIndices[i] = ColumnIndex;
+				});
 			});
-		});
+		}
 
 		// collect up unique modified columns
 		unsafe_vector<Vector2i> ColumnsToUpdate;
@@ -659,6 +693,12 @@ GS::TaskContainer WorldGridSystem::SpawnUpdateMeshesJob_Async(
 			SubRegionCells.reserve(32);
 			GridDB.ProcessRegion_Blocking(RegionIndex, [&](const ModelGrid& RegionGrid, const WorldRegionModelGridInfo& ExtendedInfo) {
 
+				if (WorldParamters.bMergeColumnMeshes)
+				{
+					Region->MeshCache->UpdateMergedColumnMesh_Async(RegionGrid, ColumnIndex);
+					return;
+				}
+
 				RegionGrid.EnumerateOccupiedColumnBlocks(ColumnIndex, [&](Vector3i ModelGridBlockIndex) {
 					SubRegionCells.push_back(ModelGridBlockIndex);
 				});
@@ -700,6 +740,11 @@ GS::TaskContainer WorldGridSystem::SpawnUpdateMeshesJob_Async(
 				Client->OnGridRegionMeshUpdated_Async( MeshUpdate );
 			ClientsLock.unlock();
 		});
+
+		// discard least-recently-used column meshes if we are over budget. They will be rebuilt
+		// by RequireBlockIndex_Async() above the next time the column is updated.
+		if (WorldParamters.CachingPolicy == EWorldGridMeshCachingPolicy::BudgetedCache)
+			Region->MeshCache->EnforceMeshMemoryBudget();
 	}, "SpawnUpdateMeshesJob_Async");
 
 	return BlockTask;
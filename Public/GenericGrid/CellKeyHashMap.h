@@ -0,0 +1,195 @@
+// Copyright Gradientspace Corp. All Rights Reserved.
+#pragma once
+
+#include "GradientspaceGridPlatform.h"
+#include "Math/GSIntVector3.h"
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+namespace GS
+{
+
+/**
+ * Open-addressing (linear probing) hash table of Vector3i cell keys, stored in flat arrays.
+ * This avoids the per-element node allocations of std::unordered_map/set, which dominate
+ * region-growing and change-tracking code that inserts large numbers of cell keys.
+ *
+ * Elements cannot be removed, only cleared. Clear() keeps the allocated memory.
+ * The key (INT_MIN, INT_MIN, INT_MIN) is reserved to mark empty slots and cannot be inserted.
+ */
+class CellKeyHashTableBase
+{
+public:
+	size_t Size() const { return NumElements; }
+	bool IsEmpty() const { return NumElements == 0; }
+
+	bool Contains(const Vector3i& Key) const
+	{
+		return NumElements > 0 && Keys[FindSlot(Key)] != EmptyKey();
+	}
+
+protected:
+	std::vector<Vector3i> Keys;
+	size_t NumElements = 0;
+	size_t SlotMask = 0;
+
+	static constexpr size_t MinCapacity = 64;
+
+	static Vector3i EmptyKey()
+	{
+		return Vector3i(std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+	}
+
+	static size_t HashKey(const Vector3i& Key)
+	{
+		uint64_t Hash = (uint64_t)(uint32_t)Key.X * 0x9E3779B97F4A7C15ull;
+		Hash ^= (uint64_t)(uint32_t)Key.Y * 0xC2B2AE3D27D4EB4Full;
+		Hash ^= (uint64_t)(uint32_t)Key.Z * 0x165667B19E3779F9ull;
+		Hash ^= (Hash >> 29);
+		return (size_t)Hash;
+	}
+
+	// returns slot containing Key, or the empty slot where Key would be inserted. Assumes table is allocated.
+	size_t FindSlot(const Vector3i& Key) const
+	{
+		size_t Slot = HashKey(Key) & SlotMask;
+		while (Keys[Slot] != Key && Keys[Slot] != EmptyKey())
+			Slot = (Slot + 1) & SlotMask;
+		return Slot;
+	}
+
+	// returns new capacity if table needs to grow to hold NumRequired elements at <= 50% load, otherwise 0
+	size_t GetRequiredCapacity(size_t NumRequired) const
+	{
+		if (NumRequired * 2 <= Keys.size())
+			return 0;
+		size_t NewCapacity = (Keys.size() > 0) ? Keys.size() : MinCapacity;
+		while (NumRequired * 2 > NewCapacity)
+			NewCapacity *= 2;
+		return NewCapacity;
+	}
+};
+
+
+/**
+ * Flat hash set of Vector3i cell keys, see CellKeyHashTableBase
+ */
+class CellKeyHashSet : public CellKeyHashTableBase
+{
+public:
+	void Reserve(size_t NumElementsIn)
+	{
+		size_t NewCapacity = GetRequiredCapacity(NumElementsIn);
+		if (NewCapacity > 0)
+			Rehash(NewCapacity);
+	}
+
+	void Clear()
+	{
+		if (NumElements > 0)
+			std::fill(Keys.begin(), Keys.end(), EmptyKey());
+		NumElements = 0;
+	}
+
+	//! returns false if Key was already in the set
+	bool Insert(const Vector3i& Key)
+	{
+		Reserve(NumElements + 1);
+		size_t Slot = FindSlot(Key);
+		if (Keys[Slot] == Key)
+			return false;
+		Keys[Slot] = Key;
+		NumElements++;
+		return true;
+	}
+
+protected:
+	void Rehash(size_t NewCapacity)
+	{
+		std::vector<Vector3i> OldKeys = std::move(Keys);
+		Keys.assign(NewCapacity, EmptyKey());
+		SlotMask = NewCapacity - 1;
+		for (const Vector3i& Key : OldKeys)
+		{
+			if (Key != EmptyKey())
+				Keys[FindSlot(Key)] = Key;
+		}
+	}
+};
+
+
+/**
+ * Flat hash map from Vector3i cell keys to ValueType, see CellKeyHashTableBase.
+ * ValueType should be a small, trivially-copyable type (eg an index into a separate array)
+ */
+template<typename ValueType>
+class CellKeyHashMap : public CellKeyHashTableBase
+{
+public:
+	void Reserve(size_t NumElementsIn)
+	{
+		size_t NewCapacity = GetRequiredCapacity(NumElementsIn);
+		if (NewCapacity > 0)
+			Rehash(NewCapacity);
+	}
+
+	void Clear()
+	{
+		if (NumElements > 0)
+			std::fill(Keys.begin(), Keys.end(), EmptyKey());
+		NumElements = 0;
+	}
+
+	//! returns null if Key is not in the map
+	const ValueType* Find(const Vector3i& Key) const
+	{
+		if (NumElements == 0) return nullptr;
+		size_t Slot = FindSlot(Key);
+		return (Keys[Slot] == Key) ? &Values[Slot] : nullptr;
+	}
+	ValueType* Find(const Vector3i& Key)
+	{
+		if (NumElements == 0) return nullptr;
+		size_t Slot = FindSlot(Key);
+		return (Keys[Slot] == Key) ? &Values[Slot] : nullptr;
+	}
+
+	//! returns false (and does not modify the existing value) if Key was already in the map
+	bool Insert(const Vector3i& Key, const ValueType& Value)
+	{
+		Reserve(NumElements + 1);
+		size_t Slot = FindSlot(Key);
+		if (Keys[Slot] == Key)
+			return false;
+		Keys[Slot] = Key;
+		Values[Slot] = Value;
+		NumElements++;
+		return true;
+	}
+
+protected:
+	std::vector<ValueType> Values;
+
+	void Rehash(size_t NewCapacity)
+	{
+		std::vector<Vector3i> OldKeys = std::move(Keys);
+		std::vector<ValueType> OldValues = std::move(Values);
+		Keys.assign(NewCapacity, EmptyKey());
+		Values.resize(NewCapacity);
+		SlotMask = NewCapacity - 1;
+		for (size_t k = 0; k < OldKeys.size(); ++k)
+		{
+			if (OldKeys[k] != EmptyKey())
+			{
+				size_t Slot = FindSlot(OldKeys[k]);
+				Keys[Slot] = OldKeys[k];
+				Values[Slot] = OldValues[k];
+			}
+		}
+	}
+};
+
+
+} // end namespace GS
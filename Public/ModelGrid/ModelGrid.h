@@ -15,7 +15,9 @@
 #include "Grid/GSFixedGrid3.h"
 #include "Core/unsafe_vector.h"
 #include "Core/FunctionRef.h"
+#include "GenericGrid/CellKeyHashMap.h"
 
+#include <atomic>
 #include <mutex>
 #include <vector>
 #include <unordered_set>
@@ -246,6 +248,27 @@ public:
 
 	bool ReinitializeCell(CellKey Key, const ModelGridCell& CopyFromCell, ModelGridCell* PrevCell = nullptr);
 
+	/**
+	 * Batched edit of a set of cells in a single block. The block is only looked up once, and is only allocated if a cell is written.
+	 * For each key, EditFunc is called with the index of the key in Keys, the current cell, and a copy of the current cell
+	 * to modify, and returns true if NewCell should be written to the grid. Keys must be valid cells inside the block.
+	 * Keys may be repeated, in which case later edits see the result of earlier edits.
+	 * @return number of cells that were written
+	 */
+	int EditBlockCells(const Vector3i& BlockIndex, const CellKey* Keys, int NumKeys,
+		FunctionRef<bool(int KeyIndex, const ModelGridCell& CurCell, ModelGridCell& NewCell)> EditFunc);
+
+	/**
+	 * Parallel version of EditBlockCells() for a set of distinct blocks. The keys for block i are Keys[BlockKeyOffsets[i]] to
+	 * Keys[BlockKeyOffsets[i+1]-1], and KeyIndex passed to EditFunc is the index into Keys. Repeated keys in a block must be adjacent.
+	 * New cells are computed concurrently for different blocks (so EditFunc must be thread-safe), the blocks that are
+	 * written to are then allocated serially, and the writes are applied concurrently per block.
+	 * @param NumWrittenOut if non-null, set to the number of cells written in each block
+	 */
+	void EditMultipleBlockCells_Parallel(const std::vector<Vector3i>& BlockIndices, const std::vector<int>& BlockKeyOffsets, const CellKey* Keys,
+		FunctionRef<bool(int KeyIndex, const ModelGridCell& CurCell, ModelGridCell& NewCell)> EditFunc,
+		std::vector<int>* NumWrittenOut = nullptr);
+
 
 	bool AreCellsInSameBlock(CellKey A, CellKey B) const
 	{
@@ -296,12 +319,10 @@ public:
 	struct EnumerateCellsCache
 	{
 		std::vector<CellKey> Stack;
-		GS::unsafe_vector<CellKey> ProcessedArray;
-		std::unordered_set<CellKey> ProcessedMap;
-		bool bUsingMap = false;
-		void Reset() { Stack.clear(); Stack.reserve(64); ProcessedArray.clear(); ProcessedArray.reserve(64); ProcessedMap.clear(); bUsingMap = false; }
+		CellKeyHashSet ProcessedMap;
+		void Reset() { Stack.clear(); Stack.reserve(64); ProcessedMap.Clear(); }
 		bool ItemsRemaining() const { return Stack.size() > 0; }
-		bool HasBeenProcessed(CellKey Key) const { return (bUsingMap) ? ProcessedMap.contains(Key) : ProcessedArray.contains(Key); }
+		bool HasBeenProcessed(CellKey Key) const { return ProcessedMap.Contains(Key); }
 		void AddProcessed(CellKey Key);
 		void AddToQueue(CellKey Key);
 		CellKey RemoveNextFromQueue();
@@ -321,6 +342,35 @@ public:
 		bool bSkipEmpty,
 		EnumerateCellsCache* Cache = nullptr);
 
+	/**
+	 * Traversal rules for EnumerateConnectedCells_Scanline(). A cell is traversable if its occupancy
+	 * matches bFillSolidCells and, if bRequireEmptyAtOffset is set, the cell at (Key + EmptyOffset) is
+	 * empty or outside the grid (eg to find the top layer of a region).
+	 */
+	struct ScanlineFillParams
+	{
+		//! if 0/1/2, traversal is restricted to the plane through the initial cell perpendicular to this axis. If -1, traversal is 3D.
+		int PlaneAxis = -1;
+		//! if true, traverse non-empty cells, otherwise traverse empty cells
+		bool bFillSolidCells = true;
+		bool bRequireEmptyAtOffset = false;
+		Vector3i EmptyOffset = Vector3i::Zero();
+	};
+
+	/**
+	 * Flood-fill of traversable cells (see ScanlineFillParams) 6-connected (or 4-connected in-plane) to InitialCellKey.
+	 * Like EnumerateConnectedCells() and EnumerateConnectedPlanarCells(), the initial cell is always treated as
+	 * connected to its neighbours, and ApplyFunc is not called for it.
+	 * Traversal works on spans of cells along X, using per-block occupancy and visited bitmasks, so cells
+	 * are only unpacked when they are passed to ApplyFunc. Cells are not enumerated in any particular order.
+	 * @param CancelFlag if non-null, polled once per span, and the traversal stops early if it becomes true
+	 */
+	void EnumerateConnectedCells_Scanline(
+		CellKey InitialCellKey,
+		const ScanlineFillParams& Params,
+		FunctionRef<void(CellKey Key, const ModelGridCell& CellInfo)> ApplyFunc,
+		const std::atomic<bool>* CancelFlag = nullptr) const;
+
 	void EnumerateAdjacentCells(
 		CellKey InitialCellKey,
 		Vector3i HalfExtents, 
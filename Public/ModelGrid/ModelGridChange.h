@@ -6,6 +6,7 @@
 
 #include "Core/UniquePointer.h"
 #include "Math/GSIntAxisBox3.h"
+#include "GenericGrid/CellKeyHashMap.h"
 
 #include <vector>
 #include <unordered_map>
@@ -13,32 +14,64 @@
 namespace GS
 {
 
+class ModelGridConstants;
+
 struct GRADIENTSPACEGRID_API GridChangeInfo
 {
 	bool bModified = false;
 	AxisBox3i ModifiedRegion = AxisBox3i::Empty();
 
-	void AppendChange(const GridChangeInfo& Change)
-	{
-		bModified = bModified || Change.bModified;
-		if (Change.bModified)
-		{
-			ModifiedRegion.Contain(Change.ModifiedRegion.Min);
-			ModifiedRegion.Contain(Change.ModifiedRegion.Max);
-		}
-	}
+	//! sorted list of the indices of the blocks that may need to be updated for the change (see ModelGrid::GetChunkIndexForKey),
+	//! ie the blocks that contain modified cells, and the face-adjacent blocks of modified cells that lie on a block border,
+	//! as meshing and collision of a block depend on the cells across its faces.
+	//! This is only valid if bHaveModifiedBlocks is true, ie if all the appended changes included their modified blocks.
+	//! Otherwise only ModifiedRegion is known.
+	std::vector<Vector3i> ModifiedBlocks;
+	bool bHaveModifiedBlocks = true;
 
+	void AppendChange(const GridChangeInfo& Change);
+
+	//! append a change where only the modified region is known
 	void AppendChange(const AxisBox3i& ModifiedRegionIn)
 	{
 		GridChangeInfo Tmp{ true, ModifiedRegionIn };
+		Tmp.bHaveModifiedBlocks = false;
 		AppendChange(Tmp);
 	}
 
+	//! append a change to ModifiedRegionIn where ModifiedBlocksIn (in any order, may contain duplicates) are all the affected blocks, see ModifiedBlocks
+	void AppendChange(const AxisBox3i& ModifiedRegionIn, const std::vector<Vector3i>& ModifiedBlocksIn);
+
+	//! append a modified cell without block information, this clears bHaveModifiedBlocks
 	void AppendChangedCell(const Vector3i& ModifiedCell) {
 		bModified = true;
 		ModifiedRegion.Contain(ModifiedCell);
+		bHaveModifiedBlocks = false;
+		ModifiedBlocks.clear();
 	}
 
+	//! append the modified cells CellKeys, and the blocks of Grid that they affect
+	void AppendChangedCells(const ModelGrid& Grid, const std::vector<Vector3i>& CellKeys);
+
+	//! returns bit mask of the faces of the block with cell key range BlockKeyRange that CellKey lies on.
+	//! Bit 2*k is set for the min side of axis k, and bit 2*k+1 for the max side.
+	static int GetBlockBorderFaces(const AxisBox3i& BlockKeyRange, const Vector3i& CellKey)
+	{
+		int Faces = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			Faces |= (CellKey[k] == BlockKeyRange.Min[k]) ? (1 << (2*k)) : 0;
+			Faces |= (CellKey[k] == BlockKeyRange.Max[k]) ? (1 << (2*k+1)) : 0;
+		}
+		return Faces;
+	}
+
+	//! append BlockIndex, and the blocks of Grid across the faces in BorderFaces (see GetBlockBorderFaces), to BlocksOut
+	static void AppendAffectedBlocks(const ModelGrid& Grid, const Vector3i& BlockIndex, int BorderFaces, std::vector<Vector3i>& BlocksOut);
+
+	//! append the blocks of Grid affected by modifying the cells CellKeys to BlocksOut. May add duplicates, which are fewer if CellKeys are ordered by block.
+	static void AppendAffectedBlocks(const ModelGrid& Grid, const std::vector<Vector3i>& CellKeys, std::vector<Vector3i>& BlocksOut);
+
 };
 
 
@@ -59,6 +92,83 @@ public:
 };
 
 
+/**
+ * ModelGridCompactDeltaChange is a compact version of ModelGridDeltaChange, intended for storing in undo/redo history.
+ * 
+ * Modified cells are grouped by ModelGrid block, and stored as runs of consecutive 12-bit block-local cell indices that
+ * have the same before/after cells. The before/after cells are stored once in a palette of packed cells, so (eg)
+ * a uniform fill of an entire block is a single run. Per-face materials are only stored for per-face-material cells.
+ * 
+ * Only the cell fields that are stored in the ModelGrid are preserved, eg the CellMaterial of per-face-material cells,
+ * and the alpha of SolidColor cells, are not. So reapplying the change gives the same grid as the source ModelGridDeltaChange.
+ */
+class GRADIENTSPACEGRID_API ModelGridCompactDeltaChange
+{
+public:
+	~ModelGridCompactDeltaChange();
+
+	struct PackedCell
+	{
+		uint64_t CellData;
+		uint32_t CellMaterial;				// GridMaterial packed value, if MaterialType is not a per-face type
+		uint32_t FaceMaterialsIndex;		// index into FaceMaterialSets, if MaterialType is a per-face type
+		uint16_t CellType;					// EModelGridCellType
+		uint8_t MaterialType;				// EGridCellMaterialType
+		uint8_t Reserved;
+	};
+
+	struct CellRun
+	{
+		uint16_t LocalIndex;		// block-local linear index X + SizeXY*(Y + SizeXY*Z) of the first cell in the run (12 bits)
+		uint16_t NumCells;			// run covers LocalIndex to LocalIndex+NumCells-1
+		uint32_t BeforeCell;		// index into CellPalette
+		uint32_t AfterCell;			// index into CellPalette
+	};
+
+	struct BlockRuns
+	{
+		Vector3i BlockIndex;
+		uint32_t FirstRun;
+		uint32_t NumRuns;
+	};
+
+	std::vector<BlockRuns> Blocks;
+	std::vector<CellRun> Runs;
+	std::vector<PackedCell> CellPalette;
+	std::vector<CellFaceMaterials> FaceMaterialSets;
+	AxisBox3i ChangeBounds = AxisBox3i::Empty();
+	int64_t NumCells = 0;
+
+	bool IsEmpty() const { return NumCells == 0; }
+
+	//! build compact change from Change. GridConstants are used to find the block of each modified cell.
+	void InitializeFromChange(const ModelGridDeltaChange& Change, const ModelGridConstants& GridConstants);
+
+	//! expand the compact change to a ModelGridDeltaChange. Cells are ordered by block.
+	void ExtractToChange(ModelGridDeltaChange& ChangeOut, const ModelGridConstants& GridConstants) const;
+
+	/**
+	 * Expand the runs to per-cell lists. The keys of block k are CellKeysOut[BlockKeyOffsetsOut[k]] to CellKeysOut[BlockKeyOffsetsOut[k+1]-1].
+	 * @param PaletteCellsOut CellPalette index of the before (if bBefore) or after state of each cell
+	 */
+	void ExpandCells(const ModelGridConstants& GridConstants, bool bBefore,
+		std::vector<Vector3i>& BlockIndicesOut, std::vector<int>& BlockKeyOffsetsOut,
+		std::vector<Vector3i>& CellKeysOut, std::vector<uint32_t>& PaletteCellsOut) const;
+
+	//! unpack an element of CellPalette
+	ModelGridCell GetPaletteCell(uint32_t PaletteIndex) const;
+
+	//! append the blocks of Grid affected by the change to BlocksOut, see GridChangeInfo::ModifiedBlocks
+	void AppendAffectedBlocks(const ModelGrid& Grid, std::vector<Vector3i>& BlocksOut) const;
+
+	//! approximate size of the change in memory, in bytes
+	size_t GetMemorySize() const;
+
+	//! see ModelGridDeltaChange::DeleteChangeFromExternalDLL
+	static void DeleteChangeFromExternalDLL(ModelGridCompactDeltaChange* Change);
+};
+
+
 class GRADIENTSPACEGRID_API ModelGridDeltaChangeTracker
 {
 public:
@@ -70,9 +180,14 @@ public:
 	GS::AxisBox3i GetCurrentChangeBounds() const;
 
 	void AppendModifiedCell(const Vector3i& CellKey, const ModelGridCell& PreviousState, const ModelGridCell& NewState);
+	//! reserve space for NumCells additional modified cells, to avoid repeated reallocation/rehashing for large edits
+	void ReserveAdditional(size_t NumCells);
+	//! if CellKey was modified in the current change, return its state before the change and remove it from the change (ChangeBounds is not shrunk)
+	bool RemoveModifiedCell(const Vector3i& CellKey, ModelGridCell& PreviousStateOut);
 
 protected:
-	std::unordered_map<Vector3i, int> KeyIndex;
+	// index of each cell in Change arrays, or -1 if the cell was removed
+	CellKeyHashMap<int> KeyIndex;
 	UniquePtr<ModelGridDeltaChange> Change;
 };
 
@@ -5,40 +5,236 @@
 #include "ModelGrid/ModelGridConstants.h"
 #include "Math/GSAxisBox3.h"
 #include "Math/GSRay3.h"
+#include "Math/GSIntAxisBox3.h"
+#include "Core/FunctionRef.h"
 
-#include <unordered_map>
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace GS
 {
 
+class ModelGridDeltaChange;
+
 class GRADIENTSPACEGRID_API ModelGridCollider
 {
 protected:
 	ModelGridConstants GridConstants;
 
 public:
+	//! if true, the type and parameters of non-box (ie parametric) surface cells are stored in each chunk
+	bool bStoreNonBoxCells = true;
+	//! if true, rays that hit the box of a non-box cell are tested against the actual cell shape. Requires bStoreNonBoxCells.
+	bool bExactParametricHitTests = true;
+
 	~ModelGridCollider();
 
 	void Initialize(const ModelGrid& TargetGrid);
 
+	/**
+	 * Rebuild the collider for all allocated chunks in LocalBounds.
+	 * Updates can run concurrently with queries from other threads. Each modified chunk is rebuilt into a new
+	 * chunk collider that is atomically swapped into the chunk table, so queries see either the old or new chunk.
+	 * Concurrent updates are serialized.
+	 */
 	void UpdateInBounds(const ModelGrid& TargetGrid, const AxisBox3d& LocalBounds);
+	//! rebuild the collider for the allocated chunks in BlockIndices, eg the GridChangeInfo::ModifiedBlocks of an edit. See UpdateInBounds().
+	void UpdateBlocks(const ModelGrid& TargetGrid, const std::vector<Vector3i>& BlockIndices);
+
+	/**
+	 * Incrementally update the collider after the given cells have been modified in TargetGrid. Only the 
+	 * state of the modified cells and their 6-neighbours is recomputed, so this is much cheaper than 
+	 * UpdateInBounds() for small edits. Chunks that are not in the collider yet are fully built.
+	 */
+	void UpdateModifiedCells(const ModelGrid& TargetGrid, const std::vector<Vector3i>& ModifiedCellKeys);
+	//! calls UpdateModifiedCells() with the cells of the change
+	void UpdateFromChange(const ModelGrid& TargetGrid, const ModelGridDeltaChange& Change);
 
+	//! free replaced chunk colliders that can no longer be referenced by any in-progress query. This is also done at the end of each update.
+	void ReclaimRetiredChunks();
+
+	/**
+	 * Find the first surface cell hit by the Ray. Walks the blocks along the ray front-to-back (3D-DDA), and then
+	 * the cells inside each non-empty block, so cost is proportional to the number of cells along the ray.
+	 * If bExactParametricHitTests is enabled, non-box cells are hit-tested against their exact shape, and rays
+	 * that pass through the empty part of the cell continue on to the next cell.
+	 * @param CellFaceNormal normal of the cell face that the ray entered through (or the normal of the hit face of a non-box cell)
+	 */
 	bool FindNearestHitCell(const Ray3d& Ray, double& RayParameterOut, Vector3d& CellFaceNormal, Vector3i& CellKey) const;
 
+	struct RayHitResult
+	{
+		bool bHit = false;
+		double RayParameter = 0;
+		Vector3d CellFaceNormal = Vector3d::UnitZ();
+		Vector3i CellKey = Vector3i::Zero();
+	};
+
+	/**
+	 * Run FindNearestHitCell() for each of the Rays. Rays are sorted by origin block and direction octant, so that
+	 * rays that will walk the same blocks are processed together, and then processed in parallel in packets.
+	 * HitsOut[i] is the result for Rays[i].
+	 */
+	void FindNearestHitCells(const std::vector<Ray3d>& Rays, std::vector<RayHitResult>& HitsOut) const;
+
+
+	/**
+	 * Sweep the axis-aligned Box along Delta and find the first non-empty cell it hits. All cells are treated as boxes.
+	 * Touching a cell is not a hit, so a box resting on (or sliding along) the grid can move freely.
+	 * If the Box already overlaps a cell at the start of the sweep, TimeOfImpactOut is 0.
+	 * @param TimeOfImpactOut fraction of Delta in range [0,1] at which contact occurs
+	 * @param ContactNormalOut unit normal at the contact point, pointing from the cell towards the Box
+	 */
+	bool SweepBox(const AxisBox3d& Box, const Vector3d& Delta, double& TimeOfImpactOut, Vector3d& ContactNormalOut, Vector3i& CellKeyOut) const;
+
+	/**
+	 * Sweep a capsule along Delta and find the first non-empty cell it hits, with same semantics as SweepBox().
+	 * The capsule axis is aligned with Z (ie the grid up-axis), its segment is Center +/- (0,0,HalfHeight).
+	 */
+	bool SweepCapsule(const Vector3d& Center, double HalfHeight, double Radius, const Vector3d& Delta, 
+		double& TimeOfImpactOut, Vector3d& ContactNormalOut, Vector3i& CellKeyOut) const;
+
+	/**
+	 * Find all non-empty cells that overlap the Box. Cells that only touch the Box are not included.
+	 */
+	void FindOverlappingCells(const AxisBox3d& Box, unsafe_vector<Vector3i>& CellKeysOut) const;
+
 protected:
+	static constexpr int BlockCellCount = ModelGrid::BlockSize_XY * ModelGrid::BlockSize_XY * ModelGrid::BlockSize_Z;
+
+	// bit index of a cell in GridChunkCollider::SurfaceCellBits, X is the fastest axis so that rows of X cells are contiguous
+	static inline int ToCellBitIndex(const Vector3i& LocalIndex) {
+		return LocalIndex.X + ModelGrid::BlockSize_XY * (LocalIndex.Y + ModelGrid::BlockSize_XY * LocalIndex.Z);
+	}
+	static inline Vector3i FromCellBitIndex(int BitIndex) {
+		return Vector3i(BitIndex % ModelGrid::BlockSize_XY, (BitIndex / ModelGrid::BlockSize_XY) % ModelGrid::BlockSize_XY, BitIndex / (ModelGrid::BlockSize_XY * ModelGrid::BlockSize_XY));
+	}
+
+	struct NonBoxCell
+	{
+		uint16_t BitIndex;
+		EModelGridCellType CellType;
+		uint64_t CellData;
+	};
+
 	struct GridChunkCollider
 	{
 		Vector3i ChunkIndex;
 		AxisBox3d ChunkBounds;
 
-		// todo dumb, we do not need to store actual boxes, only the Vec3i's! boxes can be constructed!
-		unsafe_vector<AxisBox3d> CellBounds;
+		// one bit per cell in the block, set if the cell is non-empty and any 6-neighbour is not a Filled cell. Indexed by ToCellBitIndex().
+		// Box bounds of the cells are reconstructed from the cell index as needed.
+		uint64_t SurfaceCellBits[BlockCellCount / 64];
+		int NumSurfaceCells = 0;
+
+		// one bit per non-empty cell in the block, same indexing as SurfaceCellBits
+		uint64_t OccupiedCellBits[BlockCellCount / 64];
+		int NumOccupiedCells = 0;
+
+		// surface cells that are not Filled boxes, sorted by BitIndex. Only populated if bStoreNonBoxCells is true.
+		unsafe_vector<NonBoxCell> NonBoxCells;
+
+		inline bool IsSurfaceCell(int BitIndex) const { 
+			return (SurfaceCellBits[BitIndex >> 6] & ((uint64_t)1 << (BitIndex & 63))) != 0; 
+		}
+		// returns nullptr if the cell is not in NonBoxCells
+		const NonBoxCell* FindNonBoxCell(int BitIndex) const;
 	};
 
-	// todo could probably use a grid that mirrors model chunkgrid here?
-	std::unordered_map<Vector3i, GridChunkCollider*> ActiveChunks;
+	// Fixed table of chunk colliders that mirrors the ModelGrid block grid, indexed by ToChunkTableIndex(). Chunk colliders
+	// are immutable once they are published in the table, updates build a new collider and swap it in (see PublishChunk()).
+	static constexpr Vector3i ChunkTableDims = Vector3i(ModelGrid::ModelGridDimensions().X / ModelGrid::BlockSize_XY,
+		ModelGrid::ModelGridDimensions().Y / ModelGrid::BlockSize_XY, ModelGrid::ModelGridDimensions().Z / ModelGrid::BlockSize_Z);
+	static constexpr int ChunkTableSize = ChunkTableDims.X * ChunkTableDims.Y * ChunkTableDims.Z;
+	static inline int ToChunkTableIndex(const Vector3i& ChunkIndex) {
+		return ChunkIndex.X + ChunkTableDims.X * (ChunkIndex.Y + ChunkTableDims.Y * ChunkIndex.Z);
+	}
+	std::unique_ptr<std::atomic<GridChunkCollider*>[]> ChunkTable;
+	std::atomic<int> NumActiveChunks = 0;
+	// Index range of all chunks in the table. The range only grows, and each component is only ever
+	// expanded, so a query that races with an update always loads a valid range.
+	std::atomic<int> ActiveChunksRangeMin[3] = { INT_MAX, INT_MAX, INT_MAX };
+	std::atomic<int> ActiveChunksRangeMax[3] = { INT_MIN, INT_MIN, INT_MIN };
+
+	// returns nullptr if there is no collider for the chunk. Only valid inside a ReadScope.
+	inline const GridChunkCollider* GetChunk(const Vector3i& ChunkIndex) const
+	{
+		if (ChunkIndex.X < 0 || ChunkIndex.Y < 0 || ChunkIndex.Z < 0 || ChunkIndex.X >= ChunkTableDims.X 
+			|| ChunkIndex.Y >= ChunkTableDims.Y || ChunkIndex.Z >= ChunkTableDims.Z || !ChunkTable)
+			return nullptr;
+		return ChunkTable[ToChunkTableIndex(ChunkIndex)].load();
+	}
+	AxisBox3i GetActiveChunksRange() const;
+
+	// held by UpdateInBounds/UpdateModifiedCells/ReclaimRetiredChunks
+	std::mutex UpdateLock;
+
+	// Epoch-based reclamation of replaced chunk colliders. Queries register in the reader count of the current epoch
+	// for their duration (see ReadScope), and only proceed once the epoch is unchanged after registering. Replaced chunks are retired, and on the next epoch flip they move to the
+	// waiting list, which is deleted once the readers of the previous epoch have finished.
+	std::atomic<uint32_t> ReadEpoch = 0;
+	mutable std::atomic<int> EpochReaderCounts[2] = { 0, 0 };
+	std::vector<GridChunkCollider*> RetiredChunks;
+	std::vector<GridChunkCollider*> WaitingChunks;
+	int WaitingEpochSlot = 0;
+
+	struct ReadScope
+	{
+		const ModelGridCollider& Collider;
+		int EpochSlot;
+		ReadScope(const ModelGridCollider& ColliderIn) : Collider(ColliderIn) {
+			// If the epoch flips between loading it and registering, the reader would be counted in a slot
+			// that the update no longer waits on, so re-check the epoch after registering and retry if it changed.
+			while (true)
+			{
+				uint32_t Epoch = Collider.ReadEpoch.load();
+				EpochSlot = (int)(Epoch & 1);
+				Collider.EpochReaderCounts[EpochSlot].fetch_add(1);
+				if (Collider.ReadEpoch.load() == Epoch)
+					break;
+				Collider.EpochReaderCounts[EpochSlot].fetch_sub(1);
+			}
+		}
+		~ReadScope() {
+			Collider.EpochReaderCounts[EpochSlot].fetch_sub(1);
+		}
+	};
+
+	// allocate a new (unpublished) chunk collider
+	GridChunkCollider* CreateChunk(const Vector3i& ChunkIndex) const;
+	// swap the chunk collider into the table, and retire the chunk it replaces. Requires UpdateLock.
+	void PublishChunk(GridChunkCollider* NewChunk);
+	// requires UpdateLock
+	void ReclaimRetiredChunks_Locked();
+
+	// walk the cells of the chunk along the ray, in range [RayTStart, RayTEnd]. EntryAxis is the axis of the face the ray crossed at RayTStart.
+	bool FindNearestHitCellInChunk(const GridChunkCollider& Chunk, const Ray3d& Ray, double RayTStart, double RayTEnd, int EntryAxis,
+		double& RayParameterOut, Vector3d& CellFaceNormal, Vector3i& CellKey) const;
 
 	void UpdateChunkCells(const ModelGrid& TargetGrid, GridChunkCollider& Chunk);
+
+	// recompute occupancy, surface and non-box state of a single cell in the chunk from the grid
+	void UpdateSingleCell(const ModelGrid& TargetGrid, GridChunkCollider& Chunk, const Vector3i& CellKey);
+
+	// call CellFunc for each non-empty cell in the (inclusive) KeyRange, using the chunk occupancy bits. Safe to call concurrently with updates.
+	void EnumerateOccupiedCells(const AxisBox3i& KeyRange, FunctionRef<void(const Vector3i&)> CellFunc) const;
+
+	// sweep the shape made by expanding the point Center by HalfExtents and then rounding by Radius (ie a box, capsule or sphere) along Delta
+	bool SweepRoundedBox(const Vector3d& Center, const Vector3d& HalfExtents, double Radius, const Vector3d& Delta,
+		double& TimeOfImpactOut, Vector3d& ContactNormalOut, Vector3i& CellKeyOut) const;
+
+	// All parametric cell shapes are convex, so the exact hit test clips the ray against the face planes of the shape.
+	// For the fixed shapes the planes are taken from the unit cell meshes of ModelGridMesher, 3 points per face, in unit-cell space.
+	static constexpr int MaxUnitShapeTypes = 16;
+	unsafe_vector<Vector3d> UnitShapeFacePoints[MaxUnitShapeTypes];
+
+	// test ray against the exact shape of a non-box cell, in range [RayTStart, RayTEnd] (the span of the ray inside the cell box).
+	// EntryNormal is the normal of the cell box face at RayTStart.
+	bool FindExactHitInCell(const NonBoxCell& Cell, const Vector3i& CellKey, const Ray3d& Ray, double RayTStart, double RayTEnd, const Vector3d& EntryNormal,
+		double& RayParameterOut, Vector3d& HitNormalOut) const;
 };
 
 
@@ -0,0 +1,94 @@
+// Copyright Gradientspace Corp. All Rights Reserved.
+#pragma once
+
+#include "ModelGrid/ModelGrid.h"
+#include "ModelGrid/ModelGridConstants.h"
+#include "Math/GSAxisBox3.h"
+#include "Core/unsafe_vector.h"
+#include "Core/FunctionRef.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace GS
+{
+
+class ModelGridDeltaChange;
+
+/**
+ * ModelGridCollisionShapeBuilder converts a ModelGrid into a compact set of collision primitives for a physics engine.
+ *
+ * Filled cells in each block are merged into axis-aligned boxes with a greedy 3D decomposition (runs of cells along X
+ * are grown along Y and then Z), which is generally orders of magnitude fewer primitives than one box per cell.
+ * Non-box (parametric) cells are emitted as a point set for a convex hull, in grid-local coordinates.
+ * Parametric cells that are fully enclosed by Filled cells are skipped.
+ *
+ * Shapes are stored per block, so that edits only need to re-decompose the modified blocks.
+ * Use MarkCellsModified()/MarkBlocksModified() and then UpdateModifiedBlocks() to do incremental updates.
+ */
+class GRADIENTSPACEGRID_API ModelGridCollisionShapeBuilder
+{
+public:
+	struct ConvexHullShape
+	{
+		Vector3i CellKey;
+		EModelGridCellType CellType;
+		unsafe_vector<Vector3d> Vertices;		// hull is the convex hull of these points
+	};
+
+	struct BlockShapes
+	{
+		Vector3i BlockIndex;
+		AxisBox3d BlockBounds;
+		unsafe_vector<AxisBox3d> Boxes;
+		unsafe_vector<ConvexHullShape> Hulls;
+		//! incremented each time the shapes of this block are rebuilt
+		uint32_t ShapesVersion = 0;
+	};
+
+	void Initialize(const ModelGrid& TargetGrid);
+
+	//! rebuild shapes for all allocated blocks overlapping the LocalBounds
+	void UpdateInBounds(const ModelGrid& TargetGrid, const AxisBox3d& LocalBounds);
+
+	//! mark the blocks containing the cells (and any neighbour blocks the cells are adjacent to) as needing an update
+	void MarkCellsModified(const std::vector<Vector3i>& ModifiedCellKeys);
+	//! calls MarkCellsModified() with the cells of the change
+	void MarkChangeModified(const ModelGridDeltaChange& Change);
+	void MarkBlocksModified(const std::vector<Vector3i>& BlockIndices);
+
+	/**
+	 * Rebuild the shapes of the modified blocks. Blocks that no longer contain any shapes are removed.
+	 * @param UpdatedBlocksOut if non-null, indices of the blocks that were rebuilt or removed are added here
+	 */
+	void UpdateModifiedBlocks(const ModelGrid& TargetGrid, std::vector<Vector3i>* UpdatedBlocksOut = nullptr);
+
+	bool HasModifiedBlocks() const { return ModifiedBlocks.size() > 0; }
+
+	//! returns null if the block has no shapes
+	const BlockShapes* GetBlockShapes(const Vector3i& BlockIndex) const;
+
+	void EnumerateBlockShapes(FunctionRef<void(const BlockShapes&)> BlockFunc) const;
+
+	int64_t GetTotalBoxCount() const;
+	int64_t GetTotalHullCount() const;
+
+protected:
+	ModelGridConstants GridConstants;
+
+	std::unordered_map<Vector3i, std::unique_ptr<BlockShapes>> Blocks;
+	std::unordered_set<Vector3i> ModifiedBlocks;
+
+	// hull vertices of the unit-cell shapes, indexed by EModelGridCellType
+	static constexpr int MaxUnitShapeTypes = 16;
+	unsafe_vector<Vector3d> UnitShapeVertices[MaxUnitShapeTypes];
+
+	void UpdateBlocks(const ModelGrid& TargetGrid, const std::vector<Vector3i>& BlockIndices, std::vector<Vector3i>* UpdatedBlocksOut);
+	void BuildBlockShapes(const ModelGrid& TargetGrid, BlockShapes& Shapes) const;
+	bool GetCellHullVertices(const ModelGridCell& CellInfo, const Vector3i& CellKey, unsafe_vector<Vector3d>& VerticesOut) const;
+};
+
+
+} // end namespace GS
@@ -0,0 +1,85 @@
+// Copyright Gradientspace Corp. All Rights Reserved.
+#pragma once
+
+#include "ModelGrid/ModelGrid.h"
+#include "ModelGrid/ModelGridConstants.h"
+#include "Math/GSAxisBox3.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace GS
+{
+
+class ModelGridDeltaChange;
+
+/**
+ * ModelGridDistanceField computes a narrow-band signed distance field for a ModelGrid, stored per ModelGrid block.
+ *
+ * Distances are sampled at cell centers. Each block is computed independently, with an exact separable Euclidean
+ * distance transform (Felzenszwalb & Huttenlocher) over the block cells plus an apron of MaxDistanceCells cells around
+ * the block. Distances are therefore exact up to MaxDistanceCells cells, and clamped to +/- GetMaxDistance() beyond that.
+ *
+ * All non-empty cells are treated as solid boxes. Distances are measured between cell centers and shifted by half a cell,
+ * so that the zero level set lies approximately on the boundary faces of the solid cells. Values are negative inside.
+ *
+ * Blocks are only stored if they are within MaxDistanceCells of a solid cell; other locations return GetMaxDistance().
+ * After an edit, MarkCellsModified() invalidates the blocks whose apron contains the modified cells, and
+ * UpdateModifiedBlocks() recomputes only those blocks.
+ */
+class GRADIENTSPACEGRID_API ModelGridDistanceField
+{
+public:
+	//! width of the narrow band (and the block apron), in cells. Must be set before Initialize(). Limited to the block size.
+	int MaxDistanceCells = 4;
+
+	void Initialize(const ModelGrid& TargetGrid);
+
+	//! compute the distance field for all blocks in LocalBounds
+	void UpdateInBounds(const ModelGrid& TargetGrid, const AxisBox3d& LocalBounds);
+
+	void MarkCellsModified(const std::vector<Vector3i>& ModifiedCellKeys);
+	//! calls MarkCellsModified() with the cells of the change
+	void MarkChangeModified(const ModelGridDeltaChange& Change);
+	//! recompute blocks invalidated by MarkCellsModified()
+	void UpdateModifiedBlocks(const ModelGrid& TargetGrid);
+
+	bool HasModifiedBlocks() const { return ModifiedBlocks.size() > 0; }
+
+	//! distance beyond which values are clamped
+	double GetMaxDistance() const { return MaxDistance; }
+
+	//! signed distance at the center of the cell
+	double GetCellDistance(const Vector3i& CellKey) const;
+
+	//! trilinear interpolation of the cell-center distances at a position in grid-local coordinates
+	double SampleDistance(const Vector3d& LocalPosition) const;
+
+	//! gradient of SampleDistance() at the position, by central differences. Not normalized.
+	Vector3d SampleGradient(const Vector3d& LocalPosition) const;
+
+protected:
+	ModelGridConstants GridConstants;
+	int ApronCells = 4;
+	double MaxDistance = 1.0;
+
+	static constexpr int BlockCellCount = ModelGrid::BlockSize_XY * ModelGrid::BlockSize_XY * ModelGrid::BlockSize_Z;
+
+	struct BlockDistances
+	{
+		Vector3i BlockIndex;
+		// indexed by X + SizeXY*(Y + SizeXY*Z) of the cell within the block
+		float Distances[BlockCellCount];
+	};
+	std::unordered_map<Vector3i, std::unique_ptr<BlockDistances>> Blocks;
+	std::unordered_set<Vector3i> ModifiedBlocks;
+
+	void UpdateBlocks(const ModelGrid& TargetGrid, const std::vector<Vector3i>& BlockIndices);
+	// returns false if there are no solid cells within the block apron, ie the block is entirely at MaxDistance
+	bool ComputeBlockDistances(const ModelGrid& TargetGrid, BlockDistances& Block) const;
+};
+
+
+} // end namespace GS
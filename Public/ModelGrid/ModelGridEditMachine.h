@@ -7,9 +7,12 @@
 #include "ModelGrid/ModelGridEditUtil.h"
 #include "GenericGrid/GridAdapter.h"
 #include "Math/GSRandom.h"
+#include "Core/GSAsync.h"
 
 #include <memory>
 #include <vector>
+#include <atomic>
+#include <mutex>
 
 namespace GS
 {
@@ -29,6 +32,19 @@ public:
 
 
 
+/**
+ * Result of ModelGridEditMachine::RequestPreviewOfCellEdit_Async(). 
+ * Cells are stored per ModelGrid block, so they can be drawn directly per-block, see ModelGridCellBitSet::EnumerateBlocks()
+ */
+struct GRADIENTSPACEGRID_API ModelGridEditPreviewResult
+{
+	uint64_t RequestID = 0;
+	ModelGrid::CellKey CellIndex = Vector3i::Zero();
+	ModelGridCellBitSet Cells;
+	AxisBox3i CellBounds = AxisBox3i::Empty();
+};
+
+
 //
 // TODO: 
 //  - move hover support here, just updating current cursor, then be able to preview hover
@@ -192,6 +208,21 @@ public:
 		ModelGrid::CellKey CellIndex, const Vector3d& LocalPosition, const Vector3d& LocalNormal,
 		FunctionRef<void(const ModelGridCellEditSet::EditCell&)> EnumerateTargetCellsCallbackFunc);
 
+	/**
+	 * Start computing the cells that GetPreviewOfCellEdit() would return, in a background task, using a snapshot of the
+	 * current settings. Any pending preview request is cancelled. Returns the RequestID of the new request.
+	 * At most one preview task runs at a time, it stops computing a cancelled request early and then picks up the most recent request.
+	 * The preview task reads the grid, so the grid must not be modified while a request is pending. 
+	 * Functions of this class that modify the grid call CancelPreviewOfCellEdit(true) first.
+	 */
+	virtual uint64_t RequestPreviewOfCellEdit_Async(EditState PreviewEditState,
+		ModelGrid::CellKey CellIndex, const Vector3d& LocalPosition, const Vector3d& LocalNormal);
+	//! returns the result of the most recent completed preview request (if it has not been cancelled), or null. 
+	//! If bTakeResult, the result is only returned once.
+	virtual std::shared_ptr<const ModelGridEditPreviewResult> GetCompletedPreviewOfCellEdit(bool bTakeResult = true);
+	//! cancel any pending preview requests. If bWaitForTasks, blocks until all preview tasks have exited.
+	virtual void CancelPreviewOfCellEdit(bool bWaitForTasks);
+
 
 	virtual bool IsInCurrentInteraction() const;
 	virtual bool EndCurrentInteraction();
@@ -204,14 +235,26 @@ public:
 	virtual std::unique_ptr<ModelGridDeltaChange> EndTrackedChange();
 	bool IsTrackingChange() const;
 	virtual void ReapplyChange(const ModelGridDeltaChange& Change, bool bRevert);
-
+	//! compact version of EndTrackedChange(), see ModelGridCompactDeltaChange
+	virtual std::unique_ptr<ModelGridCompactDeltaChange> EndTrackedCompactChange();
+	virtual void ReapplyChange(const ModelGridCompactDeltaChange& Change, bool bRevert);
+
+	//! returns the grid modifications since the last reset. If the result has bHaveModifiedBlocks set, ModifiedBlocks
+	//! contains the blocks with modified cells and the neighbour blocks across block borders that modified cells lie on, ie all
+	//! the blocks whose mesh or collision may have changed, so (eg) mesh and collision updates can be limited to those blocks
+	//! instead of every block in ModifiedRegion (see ModelGridMeshCache::UpdateBlocks)
 	virtual GridChangeInfo GetIncrementalChange(bool bReset);
 
 	void InitializeUniformGridAdapter(UniformGridAdapter& Adapter);
 
 	// todo replace w/ something else...
+	//! called after the grid is modified. GetIncrementalChange() returns the modified region and blocks.
 	std::function<void()> OnGridModifiedCallback = []() {};
 
+	//! if true, parametric interactions only revert/apply the cells that differ between the previous and new edit cells on 
+	//! each cursor update, instead of reverting and re-applying the entire in-progress change
+	bool bEnableIncrementalParametricEdits = true;
+
 protected:
 	ModelGrid* TargetGrid;
 	std::unique_ptr<ModelGridEditor> CurrentEditor;
@@ -260,6 +303,24 @@ protected:
 
 	ModelGridCellEditSet CurrentEditCellSet;
 
+	// edit cells applied in the last update of a parametric interaction. Setters that change how cells are 
+	// edited clear bHaveAppliedParametricEdit if the value changes, so that the next update reverts and re-applies the full change.
+	// The camera frame only affects auto-oriented cells, which are never updated incrementally (see CanUpdateParametricEditIncrementally)
+	ModelGridCellEditSet AppliedParametricEditCells;
+	bool bHaveAppliedParametricEdit = false;
+	//! returns false if the result of editing a cell may change between cursor updates (eg auto-orienting to the camera)
+	virtual bool CanUpdateParametricEditIncrementally() const;
+	//! revert previously-applied parametric edit cells that are not in CurrentEditCellSet (or are different there),
+	//! and remove the cells that are already applied from CurrentEditCellSet. Returns false (without modifying
+	//! anything) if the edit cannot be updated incrementally, in which case RevertFullParametricEdit() must be used.
+	virtual bool RevertStaleParametricEditCells();
+	//! revert the entire in-progress change of a parametric interaction
+	virtual void RevertFullParametricEdit();
+
+	// first layer of SculptCells_FillLayerStack_Parametric, see ComputeEditCellsFromCursor_TopLayer()
+	ModelGridCellEditSet ParametricFirstLayerCells;
+	bool bHaveParametricFirstLayerCells = false;
+
 	GridChangeInfo CurrentAccumChange = GridChangeInfo();
 	GridChangeInfo ExternalIncrementalChange = GridChangeInfo();
 
@@ -267,12 +328,44 @@ protected:
 	virtual void ComputeEditCellsFromCursor_Brush2D();
 	virtual void ComputeEditCellsFromCursor_Brush3D();
 	virtual void ComputeEditCellsFromCursor_TopLayer(bool bParametric);
+	virtual void ComputeFirstLayerEditCells(Vector3i FirstLayerCellIndex);
 	virtual void ComputeEditCellsFromCursor_FloodFillPlanar();
 	virtual void ComputeEditCellsFromCursor_AllConnected();
 	virtual void ComputeEditCellsFromCursor_Rect2D();
 
 	virtual void ComputeEditCellFacesFromCursor_Pencil();
 
+	//! set the cursor to the given cell and compute CurrentEditCellSet for PreviewEditState. Does not restore the cursor.
+	virtual void ComputePreviewEditCells(EditState PreviewEditState,
+		ModelGrid::CellKey CellIndex, const Vector3d& LocalPosition, const Vector3d& LocalNormal);
+	//! create a new edit machine for TargetGrid with a copy of the current edit settings, to compute previews in a background task
+	virtual std::shared_ptr<ModelGridEditMachine> CreatePreviewSnapshot() const;
+
+	// a preview request, shared between the machine and the background preview task
+	struct PreviewRequest
+	{
+		uint64_t RequestID = 0;
+		std::atomic<bool> bCancelled = false;
+		std::shared_ptr<ModelGridEditMachine> Snapshot;
+		EditState PreviewEditState = EditState::NotEditing;
+		ModelGrid::CellKey CellIndex;
+		Vector3d LocalPosition, LocalNormal;
+	};
+	//! compute Request and publish the result, unless it is cancelled
+	void ComputePreviewRequest(PreviewRequest& Request);
+
+	std::mutex PreviewLock;
+	std::shared_ptr<PreviewRequest> PendingPreview;		// next request for the preview task to compute
+	std::shared_ptr<PreviewRequest> ActivePreview;		// request the preview task is computing
+	bool bPreviewTaskRunning = false;
+	GS::TaskContainer PreviewTask;
+	std::shared_ptr<const ModelGridEditPreviewResult> CompletedPreview;
+	uint64_t LastPreviewRequestID = 0;
+
+	// set on preview snapshots, compute functions poll this via IsPreviewCancelled() to exit early
+	const std::atomic<bool>* PreviewCancelFlag = nullptr;
+	bool IsPreviewCancelled() const { return PreviewCancelFlag != nullptr && PreviewCancelFlag->load(std::memory_order_relaxed); }
+
 	virtual void ProcessCurrentEditCells();
 	virtual void FillCurrentEditCells();
 	virtual void ReplaceCurrentEditCells();
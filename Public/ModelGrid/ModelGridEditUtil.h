@@ -3,8 +3,10 @@
 
 #include "GradientspaceGridPlatform.h"
 #include "ModelGrid/ModelGrid.h"
+#include "GenericGrid/CellKeyHashMap.h"
 
 #include <vector>
+#include <bit>
 
 namespace GS
 {
@@ -14,9 +16,142 @@ struct GRADIENTSPACEGRID_API ModelGridAxisMirrorInfo
 	bool bMirror = false;
 	int MirrorOrigin = 0;
 	bool bCenterColumn = false;
+
+	bool operator==(const ModelGridAxisMirrorInfo& Other) const {
+		return bMirror == Other.bMirror && MirrorOrigin == Other.MirrorOrigin && bCenterColumn == Other.bCenterColumn;
+	}
+	bool operator!=(const ModelGridAxisMirrorInfo& Other) const { return !(*this == Other); }
+};
+
+
+/**
+ * Set of cell keys, stored as a bitset for each ModelGrid block that contains any cells.
+ * Insert and Contains are O(1), and consecutive inserts in the same block skip the block lookup.
+ * The const functions do not modify any state, so a set can be read from multiple threads (eg a shared preview result).
+ * Clear() keeps the allocated memory.
+ */
+class GRADIENTSPACEGRID_API ModelGridCellBitSet
+{
+public:
+	static constexpr int WordsPerBlock = (16 * 16 * 16) / 64;
+
+	void Clear()
+	{
+		BlockIndex.Clear();
+		BlockKeys.clear();
+		BlockBits.clear();
+		NumCells = 0;
+		LastBlockKey = Vector3i::MaxInt();
+		LastBlockOffset = -1;
+	}
+
+	size_t Size() const { return NumCells; }
+	bool IsEmpty() const { return NumCells == 0; }
+	size_t NumBlocks() const { return BlockKeys.size(); }
+
+	//! returns false if CellIndex was already in the set
+	bool Insert(const Vector3i& CellIndex)
+	{
+		int BitIndex = 0;
+		size_t Offset = (size_t)FindOrAddBlock(CellIndex, BitIndex);
+		uint64_t Mask = (uint64_t)1 << (BitIndex & 63);
+		uint64_t& Word = BlockBits[Offset + (size_t)(BitIndex >> 6)];
+		if (Word & Mask)
+			return false;
+		Word |= Mask;
+		NumCells++;
+		return true;
+	}
+
+	bool Contains(const Vector3i& CellIndex) const
+	{
+		int BitIndex = 0;
+		int Offset = FindBlock(CellIndex, BitIndex);
+		if (Offset < 0)
+			return false;
+		return (BlockBits[(size_t)Offset + (size_t)(BitIndex >> 6)] & ((uint64_t)1 << (BitIndex & 63))) != 0;
+	}
+
+	/**
+	 * Call BlockFunc for each block containing cells, in the order the blocks were added. BlockKey is CellIndex/16 (rounding down).
+	 * BlockBits are WordsPerBlock words, where the bit for a cell is at index (X&15) + 16*(Y&15) + 256*(Z&15)
+	 */
+	template<typename BlockFuncType>
+	void EnumerateBlocks(BlockFuncType BlockFunc) const
+	{
+		for (size_t k = 0; k < BlockKeys.size(); ++k)
+			BlockFunc(BlockKeys[k], &BlockBits[k * WordsPerBlock]);
+	}
+
+	//! call CellFunc for each cell in the set, ordered by block
+	template<typename CellFuncType>
+	void EnumerateCells(CellFuncType CellFunc) const
+	{
+		for (size_t k = 0; k < BlockKeys.size(); ++k)
+		{
+			Vector3i BlockOrigin(BlockKeys[k].X * 16, BlockKeys[k].Y * 16, BlockKeys[k].Z * 16);
+			const uint64_t* Words = &BlockBits[k * WordsPerBlock];
+			for (int wi = 0; wi < WordsPerBlock; ++wi)
+			{
+				uint64_t Word = Words[wi];
+				while (Word != 0)
+				{
+					int BitIndex = wi * 64 + std::countr_zero(Word);
+					Word &= (Word - 1);
+					CellFunc(BlockOrigin + Vector3i(BitIndex & 15, (BitIndex >> 4) & 15, BitIndex >> 8));
+				}
+			}
+		}
+	}
+
+protected:
+	static_assert(ModelGrid::BlockSize_XY == 16 && ModelGrid::BlockSize_Z == 16, "ModelGridCellBitSet assumes 16x16x16 blocks");
+
+	// block key -> offset of block bits in BlockBits
+	CellKeyHashMap<int> BlockIndex;
+	std::vector<Vector3i> BlockKeys;
+	std::vector<uint64_t> BlockBits;
+	size_t NumCells = 0;
+	// block of the most recent Insert(), cells are often inserted in runs in the same block
+	Vector3i LastBlockKey = Vector3i::MaxInt();
+	int LastBlockOffset = -1;
+
+	static Vector3i GetBlockKey(const Vector3i& CellIndex, int& BitIndexOut)
+	{
+		BitIndexOut = (CellIndex.X & 15) | ((CellIndex.Y & 15) << 4) | ((CellIndex.Z & 15) << 8);
+		return Vector3i(CellIndex.X >> 4, CellIndex.Y >> 4, CellIndex.Z >> 4);
+	}
+
+	// does not use the LastBlock cache, so that const functions can be called concurrently
+	int FindBlock(const Vector3i& CellIndex, int& BitIndexOut) const
+	{
+		Vector3i BlockKey = GetBlockKey(CellIndex, BitIndexOut);
+		const int* Found = BlockIndex.Find(BlockKey);
+		return (Found != nullptr) ? *Found : -1;
+	}
+
+	int FindOrAddBlock(const Vector3i& CellIndex, int& BitIndexOut)
+	{
+		Vector3i BlockKey = GetBlockKey(CellIndex, BitIndexOut);
+		if (BlockKey == LastBlockKey)
+			return LastBlockOffset;
+
+		const int* Found = BlockIndex.Find(BlockKey);
+		int Offset = (Found != nullptr) ? *Found : (int)BlockBits.size();
+		if (Found == nullptr)
+		{
+			BlockIndex.Insert(BlockKey, Offset);
+			BlockKeys.push_back(BlockKey);
+			BlockBits.resize(BlockBits.size() + WordsPerBlock, 0);
+		}
+		LastBlockKey = BlockKey;
+		LastBlockOffset = Offset;
+		return Offset;
+	}
 };
 
 
+
 class GRADIENTSPACEGRID_API ModelGridCellEditSet
 {
 public:
@@ -40,12 +175,22 @@ public:
 	void AppendCell(Vector3i CellIndex, int8_t FaceIndex, bool bFlipY = false, bool bFlipZ = false);
 	void AppendCell(Vector3i CellIndex, Vector3i SourceCellIndex);
 	void AppendCell(const EditCell& NewCell);
+	//! append cells (MinX,Y,Z)...(MaxX,Y,Z), inclusive
+	void AppendCellSpan(int MinX, int MaxX, int Y, int Z);
+	//! remove cells with repeated CellIndex, keeping the first occurrence. The order of the remaining cells is preserved.
 	void RemoveDuplicates();
+	//! RemoveDuplicates(), and initialize CellBitsOut with the remaining cells. Further cells can then be appended via AppendUniqueCell().
+	void RemoveDuplicates(ModelGridCellBitSet& CellBitsOut);
+	//! append NewCell if its CellIndex is not in CellBits (which is updated). Returns false if the cell was not appended.
+	bool AppendUniqueCell(const EditCell& NewCell, ModelGridCellBitSet& CellBits);
 
 	EditCell GetCell(int i) const { return Cells[i]; }
 	Vector3i GetCellIndex(int i) const { return Cells[i].CellIndex; }
 
+	//! linear search, use a ModelGridCellBitSet to test many cells
 	bool ContainsCell(Vector3i CellIndex) const;
+	//! add all CellIndex values to CellBits
+	void AddToCellBitSet(ModelGridCellBitSet& CellBits) const;
 
 	template<typename EnumerateFunc>
 	void EnumerateCells(EnumerateFunc func) const {
@@ -63,5 +208,30 @@ public:
 
 
 
+/**
+ * Brush rasterizers. These compute the cells covered by a brush centered at CenterCell directly from
+ * the brush shape, without accessing any grid data. Cells are emitted as inclusive spans along X, 
+ * row-by-row in increasing Z then Y. Only cells within HalfExtents of CenterCell and inside ClipBounds are emitted.
+ */
+
+//! emit all cells in the box CenterCell +/- HalfExtents. Set one HalfExtents axis to zero for a 2D square brush.
+GRADIENTSPACEGRID_API void RasterizeBoxBrushSpans(
+	Vector3i CenterCell, Vector3i HalfExtents, const AxisBox3i& ClipBounds,
+	FunctionRef<void(int MinX, int MaxX, int Y, int Z)> SpanFunc);
+
+//! emit cells where at least MinCornersInside of the 8 cell corners are strictly within Radius of the center point of CenterCell
+GRADIENTSPACEGRID_API void RasterizeSphereBrushSpans(
+	Vector3i CenterCell, Vector3i HalfExtents, const Vector3d& CellDimensions, double Radius, int MinCornersInside,
+	const AxisBox3i& ClipBounds,
+	FunctionRef<void(int MinX, int MaxX, int Y, int Z)> SpanFunc);
+
+//! emit cells in the plane through CenterCell perpendicular to PlaneAxis, where at least MinCornersInside 
+//! of the 4 in-plane cell corners are strictly within Radius of the center point of CenterCell
+GRADIENTSPACEGRID_API void RasterizeDiscBrushSpans(
+	Vector3i CenterCell, int PlaneAxis, Vector3i HalfExtents, const Vector3d& CellDimensions, double Radius, int MinCornersInside,
+	const AxisBox3i& ClipBounds,
+	FunctionRef<void(int MinX, int MaxX, int Y, int Z)> SpanFunc);
+
+
 
 } // end namespace GS
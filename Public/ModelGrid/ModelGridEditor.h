@@ -20,6 +20,11 @@ protected:
 	UniquePtr<ModelGridDeltaChangeTracker> ActiveChangeTracker;
 
 public:
+	//! if false, batched edits are always applied serially
+	bool bEnableParallelEdits = true;
+	//! batched edits with fewer cells than this are applied serially
+	static constexpr size_t MinParallelEditCells = 1024;
+
 	ModelGridEditor(ModelGrid& GridIn)
 	{
 		this->Grid = &GridIn;
@@ -30,7 +35,16 @@ public:
 	virtual UniquePtr<ModelGridDeltaChange> EndChange();
 	bool IsTrackingChange() const;
 	virtual void ReapplyChange(const ModelGridDeltaChange& Change, bool bRevert);
-	virtual AxisBox3i RevertInProgressChange();
+	//! calls EndChange() and converts the result to a ModelGridCompactDeltaChange, eg for storing in undo history
+	UniquePtr<ModelGridCompactDeltaChange> EndCompactChange();
+	//! reapply compact change. Cells are written per block, via ModelGrid::EditMultipleBlockCells_Parallel()
+	virtual void ReapplyChange(const ModelGridCompactDeltaChange& Change, bool bRevert);
+	//! revert the active change. Returns bounds of reverted cells. If ModifiedBlocksOut is non-null, the blocks affected by the reverted cells
+	//! (see GridChangeInfo::ModifiedBlocks) are added to it.
+	virtual AxisBox3i RevertInProgressChange(std::vector<Vector3i>* ModifiedBlocksOut = nullptr);
+	//! revert any of CellKeys that were modified in the active change to their previous state, and remove them from the change. Returns bounds of reverted cells.
+	//! If ModifiedBlocksOut is non-null, the blocks affected by the reverted cells (see GridChangeInfo::ModifiedBlocks) are added to it.
+	virtual AxisBox3i RevertInProgressCells(const std::vector<Vector3i>& CellKeys, std::vector<Vector3i>* ModifiedBlocksOut = nullptr);
 
 	/**
 	 * Main cell-edit function, other functions below all call this to actually modify grid cells.
@@ -52,6 +66,21 @@ public:
 	//! flip entire grid in X direction, around X=0 origin (X=0 becomes X=-1)
 	void FlipX();
 
+	/**
+	 * Batched edit of the cells in CellEditSet. The cells are sorted by (block, index in block), and all the edits
+	 * to each block are applied together via ModelGrid::EditBlockCells(), so each block is only looked up once. 
+	 * EditFunc is called with the current cell and a copy of it to modify, and returns false if the cell should not be modified.
+	 * The ModelGridCellEditSet overloads of the XYZCells() functions below use this path.
+	 * @param ModifiedBlocksOut if non-null, indices of blocks affected by the modified cells are added here (eg for remeshing), see GridChangeInfo::ModifiedBlocks
+	 * @param bEditFuncIsThreadSafe if true, and the edit is large enough, blocks are edited in parallel via ModelGrid::EditMultipleBlockCells_Parallel().
+	 *    EditFunc is then called concurrently for different blocks. The resulting change is the same as for the serial path.
+	 */
+	GridChangeInfo EditCells_Batched(
+		const ModelGridCellEditSet& CellEditSet,
+		FunctionRef<bool(const ModelGridCellEditSet::EditCell& EditCell, const ModelGridCell& CurCell, ModelGridCell& NewCell)> EditFunc,
+		std::vector<Vector3i>* ModifiedBlocksOut = nullptr,
+		bool bEditFuncIsThreadSafe = false);
+
 	template<typename EnumerableType>
 	GridChangeInfo EraseCells(const EnumerableType& Cells)
 	{
@@ -62,15 +91,7 @@ public:
 		}
 		return Result;
 	}
-	GridChangeInfo EraseCells(const ModelGridCellEditSet& CellEditSet)
-	{
-		GridChangeInfo Result;
-		for (const ModelGridCellEditSet::EditCell& Cell : CellEditSet.Cells) {
-			if (EraseCell(Cell.CellIndex))
-				Result.AppendChangedCell(Cell.CellIndex);
-		}
-		return Result;
-	}
+	GridChangeInfo EraseCells(const ModelGridCellEditSet& CellEditSet, std::vector<Vector3i>* ModifiedBlocksOut = nullptr);
 
 
 	template<typename EnumerableType>
@@ -91,15 +112,9 @@ public:
 		const ModelGridCellEditSet& CellEditSet,
 		const ModelGridCell& NewCell,
 		FunctionRef<bool(const ModelGridCell&)> CellFilterFunc,
-		FunctionRef<void(const ModelGridCell& CurCell, ModelGridCell& NewCell)> NewCellModifierFunc)
-	{
-		GridChangeInfo Result;
-		for (const ModelGridCellEditSet::EditCell& Cell : CellEditSet.Cells) {
-			if (FillCell(Cell.CellIndex, NewCell, CellFilterFunc, NewCellModifierFunc))
-				Result.AppendChangedCell(Cell.CellIndex);
-		}
-		return Result;
-	}
+		FunctionRef<void(const ModelGridCell& CurCell, ModelGridCell& NewCell)> NewCellModifierFunc,
+		std::vector<Vector3i>* ModifiedBlocksOut = nullptr,
+		bool bFuncsAreThreadSafe = false);
 
 
 	template<typename EnumerableType>
@@ -112,15 +127,7 @@ public:
 		}
 		return Result;
 	}
-	GridChangeInfo PaintCells(const ModelGridCellEditSet& CellEditSet, const Color3b& NewColor)
-	{
-		GridChangeInfo Result;
-		for (const ModelGridCellEditSet::EditCell& Cell : CellEditSet.Cells) {
-			if (PaintCell(Cell.CellIndex, NewColor))
-				Result.AppendChangedCell(Cell.CellIndex);
-		}
-		return Result;
-	}
+	GridChangeInfo PaintCells(const ModelGridCellEditSet& CellEditSet, const Color3b& NewColor, std::vector<Vector3i>* ModifiedBlocksOut = nullptr);
 
 
 	template<typename EnumerableType>
@@ -133,15 +140,7 @@ public:
 		}
 		return Result;
 	}
-	GridChangeInfo PaintCells_Complex(const ModelGridCellEditSet& CellEditSet, FunctionRef<Color3b(const ModelGridCell& Cell)> GenerateColorFunc)
-	{
-		GridChangeInfo Result;
-		for (const ModelGridCellEditSet::EditCell& Cell : CellEditSet.Cells) {
-			if (PaintCell_Complex(Cell.CellIndex, GenerateColorFunc))
-				Result.AppendChangedCell(Cell.CellIndex);
-		}
-		return Result;
-	}
+	GridChangeInfo PaintCells_Complex(const ModelGridCellEditSet& CellEditSet, FunctionRef<Color3b(const ModelGridCell& Cell)> GenerateColorFunc, std::vector<Vector3i>* ModifiedBlocksOut = nullptr, bool bFuncsAreThreadSafe = false);
 
 
 	template<typename EnumerableType>
@@ -154,15 +153,7 @@ public:
 		}
 		return Result;
 	}
-	GridChangeInfo PaintCells(const ModelGridCellEditSet& CellEditSet, uint8_t NewMaterialIndex)
-	{
-		GridChangeInfo Result;
-		for (const ModelGridCellEditSet::EditCell& Cell : CellEditSet.Cells) {
-			if (PaintCell(Cell.CellIndex, NewMaterialIndex))
-				Result.AppendChangedCell(Cell.CellIndex);
-		}
-		return Result;
-	}
+	GridChangeInfo PaintCells(const ModelGridCellEditSet& CellEditSet, uint8_t NewMaterialIndex, std::vector<Vector3i>* ModifiedBlocksOut = nullptr);
 
 
 	template<typename GridCellFaceEnumerableType>
@@ -175,15 +166,7 @@ public:
 		}
 		return Result;
 	}
-	GridChangeInfo PaintCellFaces(const ModelGridCellEditSet& CellEditSet, const Color4b& NewColor)
-	{
-		GridChangeInfo Result;
-		for (const ModelGridCellEditSet::EditCell& Cell : CellEditSet.Cells) {
-			if (PaintCellFace(Cell.CellIndex, (uint8_t)Cell.FaceIndex, NewColor))
-				Result.AppendChangedCell(Cell.CellIndex);
-		}
-		return Result;
-	}
+	GridChangeInfo PaintCellFaces(const ModelGridCellEditSet& CellEditSet, const Color4b& NewColor, std::vector<Vector3i>* ModifiedBlocksOut = nullptr);
 };
 
 
@@ -11,11 +11,74 @@
 
 #include <unordered_map>
 #include <mutex>
+#include <atomic>
 #include <functional>
+#include <string>
 
 namespace GS
 {
 
+/**
+ * Optional interface that an IMeshBuilder implementation can also implement. If it is available, 
+ * ModelGridMeshCache will call ResetMeshAndReserve() instead of IMeshBuilder::ResetMesh() when rebuilding
+ * a block mesh, passing the triangle count of the previous build of that block. Implementations should
+ * keep their existing allocations and grow them to fit the expected size, so that repeated remeshing of
+ * the same block does not need to allocate.
+ */
+class IReusableMeshBuilder
+{
+public:
+	virtual ~IReusableMeshBuilder() {}
+	virtual void ResetMeshAndReserve(int ExpectedTriangleCount) = 0;
+};
+
+
+/**
+ * Log2-bucketed histogram of durations in nanoseconds. Bucket k counts samples in range [2^k, 2^(k+1)),
+ * bucket 0 also includes 0. All fields are atomic so samples can be added from any thread.
+ */
+struct GRADIENTSPACEGRID_API MeshCacheLatencyHistogram
+{
+	static constexpr int NumBuckets = 36;		// top bucket is ~34s
+	std::atomic<uint64_t> Count = 0;
+	std::atomic<uint64_t> TotalNS = 0;
+	std::atomic<uint64_t> MaxNS = 0;
+	std::atomic<uint64_t> Buckets[NumBuckets] = {};
+
+	void AddSample(uint64_t Nanoseconds);
+	void Reset();
+	double GetMeanMicroseconds() const;
+	//! approximate percentile (in range [0,1]) in microseconds, based on bucket upper bounds
+	double GetPercentileMicroseconds(double Percentile) const;
+};
+
+/**
+ * Runtime statistics for a ModelGridMeshCache. Only updated if ModelGridMeshCache::bEnableStats is true.
+ */
+struct GRADIENTSPACEGRID_API ModelGridMeshCacheStats
+{
+	std::atomic<uint64_t> BlockBuilds = 0;
+	std::atomic<uint64_t> BlockBuildsWithUnchangedTriangleCount = 0;	// likely-redundant rebuilds
+	std::atomic<uint64_t> RequireBlockHits = 0;
+	std::atomic<uint64_t> RequireBlockMisses = 0;
+	std::atomic<uint64_t> CellsMeshed = 0;
+	std::atomic<uint64_t> BoxFacesMeshed = 0;
+	std::atomic<uint64_t> TrianglesMeshed = 0;
+	std::atomic<uint64_t> ColumnExtracts = 0;
+	std::atomic<uint64_t> MergedColumnBuilds = 0;
+	std::atomic<uint64_t> ColumnsEvicted = 0;
+
+	MeshCacheLatencyHistogram BlockBuildTime;
+	MeshCacheLatencyHistogram MergedColumnBuildTime;
+	MeshCacheLatencyHistogram ColumnExtractTime;
+	MeshCacheLatencyHistogram MeshesLockWaitTime;
+	MeshCacheLatencyHistogram ColumnLockWaitTime;
+
+	void Reset();
+	std::string ToJSON() const;
+};
+
+
 class GRADIENTSPACEGRID_API ModelGridMeshCache
 {
 public:
@@ -27,6 +90,13 @@ public:
 
 	bool bIsInitialized = false;
 
+	//! approximate memory cost of a single triangle in a block mesh, used to estimate cached mesh sizes (vertices are not shared between box faces, so this includes ~2 vertices and their attributes)
+	size_t EstimatedBytesPerTriangle = 128;
+
+	//! if true, build/extract counts and timings are accumulated in Stats. Adds some overhead to locking.
+	bool bEnableStats = false;
+	ModelGridMeshCacheStats Stats;
+
 public:
 	ModelGridMeshCache();
 	~ModelGridMeshCache();
@@ -40,6 +110,9 @@ public:
 
 	void UpdateInKeyBounds(const ModelGrid& TargetGrid, const AxisBox3i& IndexRange, FunctionRef<void(Vector2i)> OnColumnUpdatedFunc);
 
+	//! rebuild the meshes of the allocated blocks in BlockIndices, eg the GridChangeInfo::ModifiedBlocks of an edit
+	void UpdateBlocks(const ModelGrid& TargetGrid, const std::vector<Vector3i>& BlockIndices, FunctionRef<void(Vector2i)> OnColumnUpdatedFunc);
+
 	// TODO: this needs to take some kind of object that can thread-safely access a grid block(s)
 	void UpdateBlockIndex_Async(const ModelGrid& TargetGrid, Vector3i BlockIndex, Vector2i& UpdatedColumnIndexOut);
 	// Ensure block mesh is created. Calls UpdateBlockIndex_Async() if it isn't.
@@ -48,15 +121,72 @@ public:
 
 	void ExtractFullMesh(IMeshCollector& Collector);
 
+	//! if the column has a merged mesh (see UpdateMergedColumnMesh_Async), it is passed to the Collector as a single mesh, otherwise each block mesh is passed separately
 	void ExtractColumnMesh_Async(Vector2i ColumnIndex, IMeshCollector& Collector, bool bReleaseAllMeshes = false);
 
+	/**
+	 * Rebuild a single contiguous mesh for all the occupied blocks in the column, which will then be
+	 * returned by ExtractColumnMesh_Async() instead of the separate block meshes. The merged mesh is
+	 * double-buffered in the same way as the block meshes. Note that the merged mesh does not use the 
+	 * block meshes, so if only merged meshes are needed, the per-block functions do not need to be called.
+	 * 
+	 * Cost trade-off: IMeshBuilder is append-only and cannot be read back, so the merged mesh cannot be patched
+	 * or concatenated from the block meshes, and every call re-meshes all the occupied blocks in the column
+	 * (up to 16x the cost of UpdateBlockIndex_Async() for a single-block edit). This saves per-block concatenation
+	 * and draw calls on the render side, so it is only a win for columns that are extracted much more often
+	 * than they are edited. It is off by default, see WorldGridParameters::bMergeColumnMeshes.
+	 */
+	void UpdateMergedColumnMesh_Async(const ModelGrid& TargetGrid, Vector2i ColumnIndex);
+
+
+	//! set the maximum (estimated) size of all cached block meshes. 0 means no limit.
+	void SetMeshMemoryBudget(size_t MaxBytes) { MeshMemoryBudgetBytes = MaxBytes; }
+	size_t GetMeshMemoryBudget() const { return MeshMemoryBudgetBytes; }
+	//! estimated size of all currently-cached block meshes
+	size_t GetCachedMeshBytes() const { return CachedMeshBytes; }
+
+	/**
+	 * If the cached meshes exceed the memory budget, discard the meshes of least-recently-extracted columns
+	 * until the total is under budget. Columns that are currently being built or extracted are skipped.
+	 * Discarded blocks will be rebuilt by the next RequireBlockIndex_Async() call.
+	 * @return number of columns that were discarded
+	 */
+	int EnforceMeshMemoryBudget();
+
 protected:
 	GS::SharedPtr<ICellMaterialToIndexMap> ActiveMaterialMap;
 	
+	/**
+	 * Double-buffered mesh for a single block. The front mesh is published and can be read by any thread,
+	 * the back mesh is rebuilt and then atomically swapped to the front, so readers never see an empty or partial mesh.
+	 * Readers must use AcquireFrontMesh()/ReleaseFrontMesh(), which keep the builder from resetting a mesh that is still being read.
+	 */
+	struct BlockMeshSlot
+	{
+		Vector3i BlockIndex;
+		IMeshBuilder* Meshes[2] = { nullptr, nullptr };
+		std::atomic<int> FrontIndex = -1;			// index into Meshes of the published mesh, or -1 if no mesh has been published
+		std::atomic<int> ReaderCount[2] = { 0, 0 };
+		std::mutex BuildLock;						// only one thread can build the back mesh at a time
+
+		~BlockMeshSlot();
+		bool HasPublishedMesh() const { return FrontIndex.load() >= 0; }
+	};
+	// returns published mesh (and it's index in FrontIndexOut), or nullptr if there is none. Must call ReleaseFrontMesh() if a mesh is returned.
+	static const IMeshBuilder* AcquireFrontMesh(BlockMeshSlot& Slot, int& FrontIndexOut);
+	static void ReleaseFrontMesh(BlockMeshSlot& Slot, int FrontIndex);
+
 	// todo using map is dumb here...modelgrid chunks are in a fixed grid
-	std::unordered_map<Vector3i, IMeshBuilder*> ChunkMeshes;
+	std::unordered_map<Vector3i, BlockMeshSlot*> ChunkMeshes;
 	std::mutex MeshesLock;
 
+	// allocate new slot and add to ChunkMeshes and ZColumns. MeshesLock must be held by caller.
+	BlockMeshSlot* AllocateBlockSlot(Vector3i BlockIndex);
+	// rebuild the back mesh of the slot and publish it
+	void RebuildBlockSlot(const ModelGrid& TargetGrid, BlockMeshSlot& Slot);
+	// reset back mesh, call BuildFunc to fill it, then publish. Returns triangle count of front and back meshes.
+	size_t RebuildSlot(BlockMeshSlot& Slot, FunctionRef<void(IMeshBuilder&)> BuildFunc);
+
 	void BuildChunkMeshGeometry(const ModelGrid& TargetGrid, Vector3i ChunkIndex, IMeshBuilder& Mesh);
 	void UpdateChunkRange(const ModelGrid& TargetGrid, const AxisBox3i& ChunkIndexRange,
 		FunctionRef<void(Vector2i)> OnColumnUpdatedFunc);
@@ -67,13 +197,35 @@ protected:
 		Vector2i ColumnIndex;
 		Vector3d ColumnCenter;
 		GS::unsafe_vector<Vector3i> ColumnChunks;
-		GS::unsafe_vector<const IMeshBuilder*> ColumnChunkMeshes;
+		GS::unsafe_vector<BlockMeshSlot*> ColumnChunkSlots;
+		GS::unsafe_vector<size_t> ColumnChunkMeshBytes;
+
+		size_t ColumnMeshBytes = 0;
+		uint64_t LastUsedTimestamp = 0;		// value of UsageCounter when column was last built or extracted
+		int PinCount = 0;					// number of in-progress builds/extracts, column cannot be evicted if > 0
+
+		// optional merged mesh of all blocks in the column, see UpdateMergedColumnMesh_Async
+		BlockMeshSlot MergedMeshSlot;
+		size_t MergedMeshBytes = 0;
 	};
 	
 	std::unordered_map<Vector2i, ColumnCache*> ZColumns;
 	std::mutex ColumnLock;			// if also locking MeshesLock, ColumnLock comes second!
 
-	void AddNewMeshToColumn(Vector3i Index, const IMeshBuilder* MeshBuilder);
+	// lock MeshesLock/ColumnLock, recording wait time if bEnableStats is true
+	void LockMeshes();
+	void LockColumns();
+
+	void AddNewMeshToColumn(Vector3i Index, BlockMeshSlot* Slot);
+
+	size_t MeshMemoryBudgetBytes = 0;
+	std::atomic<size_t> CachedMeshBytes = 0;
+	std::atomic<uint64_t> UsageCounter = 0;
+
+	// these functions lock ColumnLock
+	void PinColumn(Vector2i ColumnIndex);
+	void UnpinColumn(Vector2i ColumnIndex);
+	void UpdateColumnMeshSize(Vector3i ChunkIndex, size_t NewMeshBytes);
 };
 
 
@@ -0,0 +1,118 @@
+// Copyright Gradientspace Corp. All Rights Reserved.
+#pragma once
+
+#include "GradientspaceGridPlatform.h"
+#include "WorldGrid/WorldGridInterfaces.h"
+#include "ModelGrid/ModelGridCollision.h"
+#include "Math/GSAxisBox3.h"
+#include "Math/GSRay3.h"
+#include "Core/unsafe_vector.h"
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace GS
+{
+
+class WorldGridSystem;
+class WorldGridDB;
+
+/**
+ * WorldGridCollisionManager maintains a ModelGridCollider for each loaded region of a WorldGridSystem,
+ * and answers collision queries in world coordinates, across region boundaries.
+ *
+ * The manager registers itself as a IWorldGridSystemClient. Region load/unload and column mesh update
+ * notifications are used to track which regions and ModelGrid columns need their colliders (re)built.
+ * These notifications arrive on arbitrary threads, so they only queue the updates, and UpdatePendingColliders()
+ * must be called (eg once per frame/tick) to apply them.
+ */
+class GRADIENTSPACEGRID_API WorldGridCollisionManager : public IWorldGridSystemClient
+{
+public:
+	virtual ~WorldGridCollisionManager();
+
+	//! register with the WorldGridSystem and queue collider builds for any already-loaded regions
+	void Initialize(WorldGridSystem* TargetSystem);
+	//! unregister from the WorldGridSystem and discard all colliders
+	void Shutdown();
+
+	//! rebuild colliders for the columns that have been modified since the last call. Regions are updated in parallel.
+	void UpdatePendingColliders();
+
+	//! queue the column containing each of the ModelGrid blocks of the region for update
+	void MarkRegionBlocksModified(WorldGridRegionIndex RegionIndex, const unsafe_vector<Vector3i>& ModelGridBlocks);
+
+	/**
+	 * queue the modified world cells for an incremental collider update, which only recomputes the modified cells and
+	 * their neighbours (see ModelGridCollider::UpdateModifiedCells()). This is much cheaper than rebuilding the columns.
+	 */
+	void MarkCellsModified(const unsafe_vector<WorldGridCellIndex>& ModifiedCells);
+
+	//! If true, mesh updates for edits (ie anything other than initial spawn) do not trigger column updates, and
+	//! the client is expected to report edited cells via MarkCellsModified()
+	bool bIgnoreEditMeshUpdates = false;
+
+	//
+	// queries, in world coordinates. These can be called from any thread, including while UpdatePendingColliders() is running.
+	//
+
+	/**
+	 * Find the first cell hit by the world-space ray. Loaded regions are visited in front-to-back order along the ray,
+	 * and the ray is tested against each region collider in the local coordinates of the region, until a hit is found.
+	 */
+	bool FindNearestHitCell(const Ray3d& WorldRay, double& RayParameterOut, Vector3d& HitNormalOut, WorldGridCellIndex& CellIndexOut) const;
+
+	//! see ModelGridCollider::SweepBox()
+	bool SweepBox(const AxisBox3d& WorldBox, const Vector3d& Delta, double& TimeOfImpactOut, Vector3d& ContactNormalOut, WorldGridCellIndex& CellIndexOut) const;
+
+	//! see ModelGridCollider::SweepCapsule()
+	bool SweepCapsule(const Vector3d& WorldCenter, double HalfHeight, double Radius, const Vector3d& Delta,
+		double& TimeOfImpactOut, Vector3d& ContactNormalOut, WorldGridCellIndex& CellIndexOut) const;
+
+	//! find all non-empty cells that overlap the world-space box
+	void FindOverlappingCells(const AxisBox3d& WorldBox, unsafe_vector<WorldGridCellIndex>& CellsOut) const;
+
+public:
+	// IWorldGridSystemClient impl
+	virtual void OnGridRegionLoaded_Async(WorldGridRegionHandle Handle) override;
+	virtual void OnGridRegionUnloaded_Async(WorldGridRegionHandle Handle) override;
+	virtual void OnGridRegionMeshUpdated_Async(WorldGridMeshUpdate MeshUpdate) override;
+
+protected:
+	WorldGridSystem* TargetSystem = nullptr;
+	const WorldGridDB* GridDB = nullptr;
+
+	struct RegionCollider
+	{
+		WorldGridRegionIndex RegionIndex;
+		AxisBox3d WorldBounds;
+		Vector3d LocalToWorld = Vector3d::Zero();				// translation from region ModelGrid coordinates to world
+		Vector3i LocalToWorldCell = Vector3i::Zero();			// offset from region ModelGrid cell keys to world cell indices
+		std::atomic<bool> bColliderInitialized = false;		// set after Collider and LocalToWorld are initialized
+		ModelGridCollider Collider;								// can be queried while it is being updated
+		std::mutex ColliderLock;								// held while updating Collider
+	};
+
+	std::unordered_map<WorldGridRegionIndex, std::shared_ptr<RegionCollider>> Regions;
+	mutable std::mutex RegionsLock;
+
+	// ModelGrid columns of each region that need to be updated
+	std::unordered_map<WorldGridRegionIndex, unsafe_vector<Vector2i>> PendingColumnUpdates;
+	// regions that need a full update
+	unsafe_vector<WorldGridRegionIndex> PendingRegionUpdates;
+	// modified world cells of each region, for incremental updates
+	std::unordered_map<WorldGridRegionIndex, std::vector<Vector3i>> PendingCellUpdates;
+	std::mutex PendingLock;
+
+	void AddRegion(WorldGridRegionIndex RegionIndex);
+	void UpdateRegionCollider(RegionCollider& Region, bool bFullUpdate, const unsafe_vector<Vector2i>& Columns, const std::vector<Vector3i>& WorldCells);
+
+	// returns loaded regions that intersect the world-space box
+	void CollectRegionsInBounds(const AxisBox3d& WorldBounds, std::vector<std::shared_ptr<RegionCollider>>& RegionsOut) const;
+};
+
+
+} // end namespace GS
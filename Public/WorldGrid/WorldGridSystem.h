@@ -13,6 +13,7 @@
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <string>
 
 
 namespace GS
@@ -25,7 +26,9 @@ class WorldGridHistory;
 enum EWorldGridMeshCachingPolicy
 {
 	AlwaysCache = 0,
-	NeverCache = 1
+	NeverCache = 1,
+	//! cache meshes up to WorldGridParameters::MeshCacheBudgetBytes per region, least-recently-extracted columns are discarded first
+	BudgetedCache = 2
 };
 
 
@@ -34,6 +37,13 @@ struct GRADIENTSPACEGRID_API WorldGridParameters
 	Vector3d CellDimensions = Vector3d(50,50,50);
 	bool bTrackHistory = true;
 	EWorldGridMeshCachingPolicy CachingPolicy = EWorldGridMeshCachingPolicy::NeverCache;
+	//! per-region mesh memory budget, only used with EWorldGridMeshCachingPolicy::BudgetedCache
+	size_t MeshCacheBudgetBytes = 64 * 1024 * 1024;
+	//! if true, each column is emitted as a single merged mesh instead of one mesh per ModelGrid block.
+	//! Any edit then re-meshes every occupied block in the modified columns, see ModelGridMeshCache::UpdateMergedColumnMesh_Async()
+	bool bMergeColumnMeshes = false;
+	//! if true, region mesh caches accumulate build/extract statistics, see GetMeshCacheStatsJSON()
+	bool bEnableMeshCacheStats = false;
 };
 
 
@@ -66,6 +76,9 @@ public:
 
 	double GetCurrentLoadingRadius() const { return CurrentLoadingRadius; }
 
+	//! returns JSON object with the mesh cache statistics of each live region (an empty object if WorldGridParameters::bEnableMeshCacheStats is false)
+	std::string GetMeshCacheStatsJSON();
+
 public:
 	virtual void TryPlaceBlock_Async(const WorldGridCellIndex& CellIndex, ModelGridCell NewCell);
 	virtual void TryPlaceBlocks_Async(const std::vector<WorldGridCellIndex>& CellIndices, const std::vector<ModelGridCell>& NewCells, bool bReplace);